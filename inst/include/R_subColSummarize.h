@@ -11,6 +11,7 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList);
+SEXP R_subColSummarize_multi(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_stats);
 
 
 #endif
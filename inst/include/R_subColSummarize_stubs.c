@@ -126,3 +126,13 @@ SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
   return fun(RMatrix, R_rowIndexList);
 }
 
+
+
+SEXP R_subColSummarize_multi(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_stats){
+  static SEXP(*fun)(SEXP, SEXP, SEXP) = NULL;
+  
+  if (fun == NULL)
+    fun =  (SEXP(*)(SEXP, SEXP, SEXP))R_GetCCallable("preprocessCore","R_subColSummarize_multi");
+  
+  return fun(RMatrix, R_rowIndexList, R_stats);
+}
@@ -9,6 +9,11 @@
 
 #include <stdlib.h>
 
+/*! \brief Default largest number of iterations */
+#define MEDIANPOLISH_MAXITER 10
+/*! \brief Default convergence tolerance */
+#define MEDIANPOLISH_EPS 0.01
+
 /*! \brief Compute medianpolish  
  *
  *
@@ -140,4 +145,93 @@ void MedianPolish(double *data, size_t rows, size_t cols, int *cur_rows, double
 void MedianPolish_no_log(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE);
 
 
+/*! \brief Fit medianpolish with given convergence settings
+ *
+ *
+ *      As median_polish_fit_no_copy() but with the iteration limit and convergence 
+ *      tolerance supplied by the caller. 
+ *
+ * @param data a matrix containing data stored column-wise stored in rows*cols length of memory. On output the residuals
+ * @param rows the number of rows in the matrix 
+ * @param cols the number of columns in the matrix
+ * @param r pre-allocated space to store estimated row effects. Should be of length rows. Assumed on input to be zero-ed out.
+ * @param c pre-allocated space to store estimated column effects. Should be of length cols. Assumed on input to be zero-ed out.
+ * @param t pre-allocated space to store the overall effect. Should be of length 1.
+ * @param maxiter the largest number of row and column sweeps to carry out (the default elsewhere is MEDIANPOLISH_MAXITER)
+ * @param eps stop once the sum of absolute residuals changes by less than this proportion between iterations (default MEDIANPOLISH_EPS)
+ * @param check_convergence if zero the convergence check is skipped and exactly maxiter sweeps are carried out
+ *
+ * @return the number of iterations carried out
+ *  
+ */
+
+int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t, int maxiter, double eps, int check_convergence);
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *
+ *      As median_polish_no_copy() but with the iteration limit and convergence 
+ *      tolerance supplied by the caller. 
+ *
+ * @param data a matrix containing data stored column-wise stored in rows*cols length of memory. On output the residuals
+ * @param rows the number of rows in the matrix 
+ * @param cols the number of columns in the matrix
+ * @param results pre-allocated space to store output column effects. Should be of length cols
+ * @param resultsSE pre-allocated space to store SE of results. Should be of length cols. Note that this is just NA values
+ * @param maxiter the largest number of row and column sweeps to carry out (the default elsewhere is MEDIANPOLISH_MAXITER)
+ * @param eps stop once the sum of absolute residuals changes by less than this proportion between iterations (default MEDIANPOLISH_EPS)
+ * @param check_convergence if zero the convergence check is skipped and exactly maxiter sweeps are carried out
+ *
+ * @return the number of iterations carried out
+ *  
+ */
+
+int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, int maxiter, double eps, int check_convergence);
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *
+ *      As median_polish() but with the iteration limit and convergence 
+ *      tolerance supplied by the caller. 
+ *
+ * @param data a matrix containing data stored column-wise stored in rows*cols length of memory
+ * @param rows the number of rows in the matrix 
+ * @param cols the number of columns in the matrix
+ * @param results pre-allocated space to store output column effects. Should be of length cols
+ * @param resultsSE pre-allocated space to store SE of results. Should be of length cols. Note that this is just NA values
+ * @param residuals pre-allocated space to store the residuals. Should be of length rows*cols
+ * @param maxiter the largest number of row and column sweeps to carry out (the default elsewhere is MEDIANPOLISH_MAXITER)
+ * @param eps stop once the sum of absolute residuals changes by less than this proportion between iterations (default MEDIANPOLISH_EPS)
+ * @param check_convergence if zero the convergence check is skipped and exactly maxiter sweeps are carried out
+ *
+ * @return the number of iterations carried out
+ *  
+ */
+
+int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals, int maxiter, double eps, int check_convergence);
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *
+ *      As MedianPolish() (log_transform non-zero) or MedianPolish_no_log() (log_transform zero)
+ *      but with the iteration limit and convergence tolerance supplied by the caller. 
+ *
+ * @param data a matrix containing data stored column-wise stored in rows*cols length of memory
+ * @param rows the number of rows in the matrix 
+ * @param cols the number of columns in the matrix
+ * @param cur_rows a vector containing row indices to use
+ * @param results pre-allocated space to store output log2 averages. Should be of length cols
+ * @param nprobes number of probes in current set
+ * @param resultsSE pre-allocated space to store SE of log2 averages. Should be of length cols. Note that this is just NA values
+ * @param log_transform if non-zero the data is \f$\log_2\f$ transformed before the median polish
+ * @param maxiter the largest number of row and column sweeps to carry out (the default elsewhere is MEDIANPOLISH_MAXITER)
+ * @param eps stop once the sum of absolute residuals changes by less than this proportion between iterations (default MEDIANPOLISH_EPS)
+ * @param check_convergence if zero the convergence check is skipped and exactly maxiter sweeps are carried out
+ *
+ * @return the number of iterations carried out
+ *  
+ */
+
+int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence);
+
 #endif
@@ -564,6 +564,70 @@ void MedianPolish_no_log(double *data, size_t rows, size_t cols, int *cur_rows,
 
 }
 
+/*! \brief Fit medianpolish with given convergence settings
+ *
+ *  See medianpolish.h
+ */
+
+int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t, int maxiter, double eps, int check_convergence){
+
+  static int(*fun)(double *, size_t, size_t, double *, double *, double *, int, double, int) = NULL;
+
+  if (fun == NULL)
+    fun = (int(*)(double *, size_t, size_t, double *, double *, double *, int, double, int))R_GetCCallable("preprocessCore","median_polish_fit_control");
+
+  return fun(data,rows,cols,r,c,t,maxiter,eps,check_convergence);
+
+}
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *  See medianpolish.h
+ */
+
+int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, int maxiter, double eps, int check_convergence){
+
+  static int(*fun)(double *, size_t, size_t, double *, double *, int, double, int) = NULL;
+
+  if (fun == NULL)
+    fun = (int(*)(double *, size_t, size_t, double *, double *, int, double, int))R_GetCCallable("preprocessCore","median_polish_no_copy_control");
+
+  return fun(data,rows,cols,results,resultsSE,maxiter,eps,check_convergence);
+
+}
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *  See medianpolish.h
+ */
+
+int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals, int maxiter, double eps, int check_convergence){
+
+  static int(*fun)(double *, size_t, size_t, double *, double *, double *, int, double, int) = NULL;
+
+  if (fun == NULL)
+    fun = (int(*)(double *, size_t, size_t, double *, double *, double *, int, double, int))R_GetCCallable("preprocessCore","median_polish_control");
+
+  return fun(data,rows,cols,results,resultsSE,residuals,maxiter,eps,check_convergence);
+
+}
+
+/*! \brief Compute medianpolish with given convergence settings
+ *
+ *  See medianpolish.h
+ */
+
+int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence){
+
+  static int(*fun)(double *, size_t, size_t, int *, double *, size_t, double *, int, int, double, int) = NULL;
+
+  if (fun == NULL)
+    fun = (int(*)(double *, size_t, size_t, int *, double *, size_t, double *, int, int, double, int))R_GetCCallable("preprocessCore","MedianPolish_control");
+
+  return fun(data,rows,cols,cur_rows,results,nprobes,resultsSE,log_transform,maxiter,eps,check_convergence);
+
+}
+
 
 
 
@@ -632,6 +696,18 @@ void rlm_fit_anova(double *y, int y_rows, int y_cols,double *out_beta, double *o
 }
 
 
+int rlm_fit_anova_control(double *y, int y_rows, int y_cols, double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work){
+
+  static int(*fun)(double *, int, int, double *, double *, double *, double *, double (*)(double, double, int), double, int, int, int, double *) = NULL;
+
+  if (fun == NULL)
+    fun = (int(*)(double *, int, int, double *, double *, double *, double *, double (*)(double, double, int), double, int, int, int, double *))R_GetCCallable("preprocessCore","rlm_fit_anova_control");
+
+  return fun(y, y_rows, y_cols, scale, out_beta, out_resids, out_weights, PsiFn, psi_k, max_iter, initialized, warm_start, work);
+
+}
+
+
 void rlm_wfit_anova(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
   static void(*fun)(double *, int, int, double *, double *, double *, double *, double (*)(double, double, int), double, int, int) = NULL;
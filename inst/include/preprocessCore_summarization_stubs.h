@@ -18,9 +18,14 @@ void median_polish_log2(double *data, size_t rows, size_t cols, double *results,
 void median_polish(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals);
 void MedianPolish(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE);
 void MedianPolish_no_log(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE);
+int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t, int maxiter, double eps, int check_convergence);
+int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, int maxiter, double eps, int check_convergence);
+int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals, int maxiter, double eps, int check_convergence);
+int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence);
 void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double *out_resids, double *out_weights, double (* PsiFn)(double, double, int), double psi_k, int max_iter,int initialized);
 void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_beta, double *out_resids, double *out_weights, double (* PsiFn)(double, double, int), double psi_k, int max_iter,int initialized);
 void rlm_fit_anova(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
+int rlm_fit_anova_control(double *y, int y_rows, int y_cols, double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work);
 void rlm_wfit_anova(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
 void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *resids,double *weights,double *se_estimates,double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k);
 void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k);
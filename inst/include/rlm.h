@@ -69,6 +69,29 @@ double med_abs(double *x, int length);
 
 void rlm_fit_anova(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
 
+/*! \brief robust linear regression fit row-colum model with control over the starting values
+ *
+ * As rlm_fit_anova() but the scale may be given and the IRLS may be started from a median polish fit
+ *
+ * @param y  dependent variable: length y_rows*y_cols
+ * @param y_rows  dimension of input
+ * @param y_cols  dimension of input
+ * @param scale  on input a scale estimate to use (if negative it is estimated at each iteration), on output the final scale estimate
+ * @param out_beta  place to output beta estimates: length (y_rows + y_cols -1)
+ * @param out_resids  place to output residuals: length y_rows*y_cols
+ * @param out_weights  place to output weights: length y_rows*y_cols
+ * @param PsiFn  a function used to determine weights based on standardized residuals
+ * @param psi_k  a tuning parameter for the PsiFn
+ * @param max_iter  maximum number of iterations (if don't converge before)
+ * @param initialized  do we have initial estimates of beta 
+ * @param warm_start  if non zero seed beta and residuals from a median polish fit (out_weights is then not used as input)
+ * @param work  scratch space of length y_rows*y_cols + y_rows*y_rows + 6*y_rows + y_cols, or NULL to have it allocated
+ *
+ * @return the number of IRLS iterations carried out
+ */
+
+int rlm_fit_anova_control(double *y, int y_rows, int y_cols, double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work);
+
 /*! \brief robust linear regression fit row-colum model
  *
  * Fits the model y = cols + rows + errors with constraint sum rows = 0
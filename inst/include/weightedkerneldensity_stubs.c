@@ -21,5 +21,19 @@ void KernelDensity(double *x, size_t nxxx, double *weights, double *output, doub
 }
 
 
+void KernelDensity_matrix(double *x, size_t rows, size_t cols, double *weights, double *output, double *output_x, size_t nout, int kernel_fn, int bandwidth_fn, double bandwidth_adj, int common_grid){
+   
+  static void(*fun)(double*, size_t, size_t, double*, double*, double*, size_t, int, int, double, int) = NULL;
+  
+  if (fun == NULL)
+    fun =  (void(*)(double*, size_t, size_t, double*, double*, double*, size_t, int, int, double, int))R_GetCCallable("preprocessCore","KernelDensity_matrix");
+  
+  fun(x, rows, cols, weights, output, output_x, nout, kernel_fn, bandwidth_fn, bandwidth_adj, common_grid);
+  
+  return;
+
+}
+
+
 
 #endif
@@ -14,6 +14,14 @@
  ** History
  ** Sep 15, 2007 - Initial version
  ** Jan 15, 2009 - Fix issues with VECTOR_ELT/STRING_ELT
+ ** Oct 18, 2026 - Add multi-threaded implementation based on pthreads for
+ **                the column-wise summaries (each thread summarizes a range
+ **                of columns). Median polish fits all columns jointly so it
+ **                remains single threaded.
+ ** Oct 18, 2026 - add R_colSummarize_medianpolish_control, median polish with
+ **                maxiter, eps and whether to check convergence given, which
+ **                also returns the number of iterations. The original entry
+ **                points keep their one argument signatures.
  **
  **
  *********************************************************************/
@@ -34,9 +42,171 @@
 #include "log_median.h"
 #include "median_log.h"
 #include "median.h"
+#include "rma_common.h"
 
 #include "biweight.h"
 #include "medianpolish.h"
+#include "common.h"
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+#define THREADS_ENV_VAR "R_THREADS"
+struct loop_data{
+  double *matrix;
+  double *results;
+  double *resultsSE;
+  size_t rows;
+  size_t start_col;
+  size_t end_col;
+  void (*summarize)(double *, size_t, size_t, double *, double *);
+};
+#endif
+
+
+#ifdef USE_PTHREADS
+
+static void *colSummarize_group(void *data){
+  
+  struct loop_data *args = (struct loop_data *) data;
+  size_t ncols = args->end_col - args->start_col + 1;
+
+  args->summarize(&(args->matrix[args->start_col*args->rows]), args->rows, ncols, &(args->results[args->start_col]), &(args->resultsSE[args->start_col]));
+
+  return NULL;
+}
+
+#endif
+
+
+/*********************************************************************
+ **
+ ** static void colSummarize_by_col(double *matrix, size_t rows, size_t cols, double *results, double *resultsSE,
+ **                                 void (*summarize)(double *, size_t, size_t, double *, double *))
+ **
+ ** double *matrix - data matrix (column major) of dimension rows*cols
+ ** size_t rows, cols - dimensions of matrix
+ ** double *results, *resultsSE - on output summaries for each column
+ ** summarize - one of colaverage, averagelog, logaverage, colmedian, 
+ **             logmedian, medianlog, tukeybiweight, tukeybiweight_no_log
+ **
+ ** Each of the summarize functions above works on each column separately,
+ ** so a block of consecutive columns is itself a (smaller) matrix. When 
+ ** built with pthreads, the columns are divided up into ranges and each 
+ ** range is summarized in its own thread (number of threads given by the
+ ** R_THREADS environment variable).
+ **
+ *********************************************************************/
+
+static void colSummarize_by_col(double *matrix, size_t rows, size_t cols, double *results, double *resultsSE, void (*summarize)(double *, size_t, size_t, double *, double *)){
+
+#ifdef USE_PTHREADS
+  int i, t, returnCode, chunk_size, num_threads = 1;
+  double chunk_size_d, chunk_tot_d;
+  char *nthreads;
+  pthread_attr_t attr;
+  pthread_t *threads;
+  struct loop_data *args;
+  void *status;
+#ifdef PTHREAD_STACK_MIN
+  size_t stacksize = PTHREAD_STACK_MIN + sysconf(_SC_PAGE_SIZE);
+#else
+  size_t stacksize = 0x8000;
+#endif
+
+  nthreads = getenv(THREADS_ENV_VAR);
+  if(nthreads != NULL){
+    num_threads = atoi(nthreads);
+    if(num_threads <= 0){
+      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
+    }
+  }
+
+  if (num_threads == 1 || cols < 2){
+    summarize(matrix, rows, cols, results, resultsSE);
+    return;
+  }
+
+  /* Initialize thread attribute */
+  pthread_attr_init(&attr);
+  threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
+
+  /* Set thread detached attribute */
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setstacksize (&attr, stacksize);
+  
+  /* this code works out how many threads to use and allocates ranges of columns to each thread */
+  /* The aim is to try to be as fair as possible in dividing up the matrix */
+  /* A special cases to be aware of: 
+     1) Number of columns is less than the number of threads
+  */
+  
+  if (num_threads < cols){
+    chunk_size = cols/num_threads;
+    chunk_size_d = ((double) cols)/((double) num_threads);
+  } else {
+    chunk_size = 1;
+    chunk_size_d = 1;
+  }
+
+  if(chunk_size == 0){
+    chunk_size = 1;
+  }
+  args = (struct loop_data *) R_Calloc((cols < num_threads ? cols : num_threads), struct loop_data);
+
+  args[0].matrix = matrix;
+  args[0].results = results;
+  args[0].resultsSE = resultsSE;
+  args[0].rows = rows;  
+  args[0].summarize = summarize;
+
+  t = 0; /* t = number of actual threads doing work */
+  chunk_tot_d = 0;
+  for (i=0; floor(chunk_tot_d+0.00001) < cols; i+=chunk_size){
+     if(t != 0){
+       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
+     }
+
+     args[t].start_col = i;     
+     /* take care of distribution of the remainder (when #cols%#threads != 0) */
+     chunk_tot_d += chunk_size_d;
+     // Add 0.00001 in case there was a rounding issue with the division
+     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
+       args[t].end_col = i+chunk_size;
+       i++;
+     }
+     else{
+       args[t].end_col = i+chunk_size-1;
+     }
+     t++;
+  }
+
+  
+  for (i =0; i < t; i++){
+     returnCode = pthread_create(&threads[i], &attr, colSummarize_group, (void *) &(args[i]));
+     if (returnCode){
+         error("ERROR; return code from pthread_create() is %d\n", returnCode);
+     }
+  }
+  /* Wait for the other threads */
+  for(i = 0; i < t; i++){
+      returnCode = pthread_join(threads[i], &status);
+      if (returnCode){
+         error("ERROR; return code from pthread_join(thread #%d) is %d, exit status for thread was %d\n", 
+               i, returnCode, *((int *) status));
+      }
+  }
+
+  pthread_attr_destroy(&attr);  
+  R_Free(threads);
+  R_Free(args);  
+#else
+  summarize(matrix, rows, cols, results, resultsSE);
+#endif
+}
+
+
 
 SEXP R_colSummarize_avg_log(SEXP RMatrix){
 
@@ -71,7 +241,7 @@ SEXP R_colSummarize_avg_log(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  averagelog(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, averagelog);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -120,7 +290,7 @@ SEXP R_colSummarize_log_avg(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  logaverage(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, logaverage);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -168,7 +338,7 @@ SEXP R_colSummarize_avg(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  colaverage(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, colaverage);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -231,7 +401,7 @@ SEXP R_colSummarize_log_median(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  logmedian(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, logmedian);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -278,7 +448,7 @@ SEXP R_colSummarize_median_log(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  medianlog(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, medianlog);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -326,7 +496,7 @@ SEXP R_colSummarize_median(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  colmedian(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, colmedian);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -374,7 +544,7 @@ SEXP R_colSummarize_biweight_log(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  tukeybiweight(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, tukeybiweight);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -420,7 +590,7 @@ SEXP R_colSummarize_biweight(SEXP RMatrix){
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  tukeybiweight_no_log(matrix, rows, cols, results, resultsSE);
+  colSummarize_by_col(matrix, rows, cols, results, resultsSE, tukeybiweight_no_log);
   
   PROTECT(R_return_value_names= allocVector(STRSXP,2));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
@@ -441,7 +611,18 @@ SEXP R_colSummarize_biweight(SEXP RMatrix){
 
 
 
-SEXP R_colSummarize_medianpolish_log(SEXP RMatrix){
+/*********************************************************************
+ **
+ ** static SEXP colSummarize_medianpolish(SEXP RMatrix, int log_transform, int maxiter, 
+ **                                      double eps, int check_convergence, int report_iterations)
+ **
+ ** median polish of RMatrix (log2 transformed first if log_transform). Returns
+ ** list(Estimates, StdErrors), with a third element Iterations (the number 
+ ** of iterations carried out) if report_iterations.
+ **
+ *********************************************************************/
+
+static SEXP colSummarize_medianpolish(SEXP RMatrix, int log_transform, int maxiter, double eps, int check_convergence, int report_iterations){
 
 
   SEXP R_return_value;
@@ -449,6 +630,7 @@ SEXP R_colSummarize_medianpolish_log(SEXP RMatrix){
 
   SEXP R_summaries;
   SEXP R_summaries_se;
+  SEXP R_iterations = R_NilValue;
 
   
   SEXP dim1;
@@ -457,7 +639,8 @@ SEXP R_colSummarize_medianpolish_log(SEXP RMatrix){
   double *results, *resultsSE;
   
   double *resids;
-
+  int iterations;
+  int nreturn = (report_iterations ? 3 : 2);
   
   int rows, cols;
 
@@ -467,89 +650,72 @@ SEXP R_colSummarize_medianpolish_log(SEXP RMatrix){
   UNPROTECT(1);
 
 
-  PROTECT(R_return_value = allocVector(VECSXP,2));
+  PROTECT(R_return_value = allocVector(VECSXP,nreturn));
   PROTECT(R_summaries = allocVector(REALSXP,cols));
   PROTECT(R_summaries_se = allocVector(REALSXP,cols));
   SET_VECTOR_ELT(R_return_value,0,R_summaries);
   SET_VECTOR_ELT(R_return_value,1,R_summaries_se);
-  
+  UNPROTECT(2);
+  if (report_iterations){
+    R_iterations = allocVector(INTSXP,1);
+    SET_VECTOR_ELT(R_return_value,2,R_iterations);
+  }
 
   results = NUMERIC_POINTER(R_summaries);
   resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  resids = R_Calloc(rows*cols, double);
+  resids = R_Calloc((size_t)rows*cols, double);
   
-  memcpy(resids, matrix, rows*cols*sizeof(double));
-  
-  median_polish_log2_no_copy(resids, rows, cols, results, resultsSE);
+  if (log_transform){
+    log2_transform(matrix, resids, (size_t)rows*cols);
+    iterations = median_polish_no_copy_control(resids, rows, cols, results, resultsSE, maxiter, eps, check_convergence);
+  } else {
+    iterations = median_polish_control(matrix, rows, cols, results, resultsSE, resids, maxiter, eps, check_convergence);
+  }
   
   R_Free(resids);
   
+  if (report_iterations)
+    INTEGER(R_iterations)[0] = iterations;
 
-  PROTECT(R_return_value_names= allocVector(STRSXP,2));
+  PROTECT(R_return_value_names= allocVector(STRSXP,nreturn));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
   SET_STRING_ELT(R_return_value_names,1,mkChar("StdErrors"));
+  if (report_iterations)
+    SET_STRING_ELT(R_return_value_names,2,mkChar("Iterations"));
   setAttrib(R_return_value, R_NamesSymbol,R_return_value_names);
   UNPROTECT(1);
 
-  UNPROTECT(3);
+  UNPROTECT(1);
   return R_return_value;
 }
 
 
 
+SEXP R_colSummarize_medianpolish_log(SEXP RMatrix){
+  return colSummarize_medianpolish(RMatrix, 1, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1, 0);
+}
 
-SEXP R_colSummarize_medianpolish(SEXP RMatrix){
-
-
-  SEXP R_return_value;
-  SEXP R_return_value_names;
-
-  SEXP R_summaries;
-  SEXP R_summaries_se;
-
-  
-  SEXP dim1;
-
-  double *matrix=NUMERIC_POINTER(RMatrix);
-  double *results, *resultsSE;
-  
-  double *resids;
-
-  
-  int rows, cols;
-
-  PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
-  rows = INTEGER(dim1)[0];
-  cols = INTEGER(dim1)[1];
-  UNPROTECT(1);
 
 
-  PROTECT(R_return_value = allocVector(VECSXP,2));
-  PROTECT(R_summaries = allocVector(REALSXP,cols));
-  PROTECT(R_summaries_se = allocVector(REALSXP,cols));
-  SET_VECTOR_ELT(R_return_value,0,R_summaries);
-  SET_VECTOR_ELT(R_return_value,1,R_summaries_se);
-  
+SEXP R_colSummarize_medianpolish(SEXP RMatrix){
+  return colSummarize_medianpolish(RMatrix, 0, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1, 0);
+}
 
-  results = NUMERIC_POINTER(R_summaries);
-  resultsSE = NUMERIC_POINTER(R_summaries_se);
 
-  resids = R_Calloc(rows*cols, double);
-  
-  memcpy(resids, matrix, rows*cols*sizeof(double));
-  
-  median_polish_no_copy(resids, rows, cols, results, resultsSE);
-  
-  R_Free(resids);
-  
 
-  PROTECT(R_return_value_names= allocVector(STRSXP,2));
-  SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-  SET_STRING_ELT(R_return_value_names,1,mkChar("StdErrors"));
-  setAttrib(R_return_value, R_NamesSymbol,R_return_value_names);
-  UNPROTECT(1);
+/*********************************************************************
+ **
+ ** SEXP R_colSummarize_medianpolish_control(SEXP RMatrix, SEXP R_log_transform,
+ **                                          SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence)
+ **
+ ** as R_colSummarize_medianpolish_log() (R_log_transform TRUE) or 
+ ** R_colSummarize_medianpolish() (FALSE) but with the convergence settings
+ ** given. The number of iterations used is returned as a third list 
+ ** element, Iterations.
+ **
+ *********************************************************************/
 
-  UNPROTECT(3);
-  return R_return_value;
+SEXP R_colSummarize_medianpolish_control(SEXP RMatrix, SEXP R_log_transform, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence){
+  return colSummarize_medianpolish(RMatrix, asLogical(R_log_transform), asInteger(R_maxiter), asReal(R_eps), asLogical(R_check_convergence), 1);
 }
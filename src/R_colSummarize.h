@@ -12,5 +12,6 @@ SEXP R_colSummarize_avg(SEXP RMatrix);
 SEXP R_colSummarize_median(SEXP RMatrix);
 SEXP R_colSummarize_biweight(SEXP RMatrix);
 SEXP R_colSummarize_medianpolish(SEXP RMatrix);
+SEXP R_colSummarize_medianpolish_control(SEXP RMatrix, SEXP R_log_transform, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence);
 
 #endif
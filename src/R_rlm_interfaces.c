@@ -20,6 +20,10 @@
  ** Apr 23, 2009 - R_rlm_rma_default_model now returns scale estimate
  ** Apr 28, 2009 - R_wrlm_rma_default_model now returns scale estimate
  ** Aug 22, 2009 - fix issue with input scales
+ ** Oct 18, 2026 - add R_rlm_rma_default_model_output and R_wrlm_rma_default_model_output
+ **                which only compute and return the components asked for
+ ** Oct 18, 2026 - R_rlm_rma_default_model_output can warm start from median polish and
+ **                return the number of iterations
  **
  *********************************************************************/
 
@@ -41,32 +45,34 @@
 
 /**********************************************************************************
  **
- ** SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP transform)
+ ** static SEXP rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, 
+ **                                   SEXP Scales, int output, int warm_start)
  **
  ** 
  ** SEXP Y - A matrix with probes in rows and arrays in columns
  ** SEXP PsiCode - An integer code corresponding to the function that should be used to determine
  **                how outliers are down weighted.
  ** SEXP PsiK - a parameter for weighting algorithm.
+ ** SEXP Weights - input weights (same size as Y) or R_NilValue for an unweighted fit
+ ** SEXP Scales - NULL or a scale to use rather than estimating it
+ ** int output - which components to return, a combination of the RCMODEL_* bits
+ **              in R_rlm_interfaces.h. Those not asked for are NULL. The weights and 
+ **              residuals are then kept in scratch space and the standard errors are 
+ **              not computed at all. RCMODEL_ITERATIONS adds a sixth component, the
+ **              number of IRLS iterations (unweighted fits only)
+ ** int warm_start - start the IRLS from a median polish fit (unweighted fits only)
  **
  ** Returns 
- ** parameter estimates. weights, residuals, Standard error estimates
+ ** parameter estimates. weights, residuals, Standard error estimates, scale
+ ** (and the number of iterations if asked for)
  **
  *********************************************************************/
 
-
-
-
-
-SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
+static SEXP rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales, int output, int warm_start){
 
 
   SEXP R_return_value;
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  SEXP R_scale;
+  SEXP R_elt;
   
   SEXP R_return_value_names;
 
@@ -75,45 +81,73 @@ SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
   double *beta;
   double *residuals;
   double *weights;
-  double *se;
+  double *se = NULL;
 
-  /* double scale=-1.0; */
-  double *scaleptr;
+  double scale;
+  double *scaleptr = &scale;
 
   double residSE;
 
   double *Ymat;
+  double *w = NULL;
+
+  double *work;
+  double *next;
 
   int rows;
   int cols;
 
   int i;
+  int iterations;
+  int nreturn = (output & RCMODEL_ITERATIONS) ? 6 : 5;
   
   PROTECT(dim1 = getAttrib(Y,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
-  PROTECT(R_return_value = allocVector(VECSXP,5));
-  PROTECT(R_beta = allocVector(REALSXP, rows + cols));
-  PROTECT(R_weights = allocMatrix(REALSXP,rows,cols));
-  PROTECT(R_residuals = allocMatrix(REALSXP,rows,cols));
-  PROTECT(R_SE = allocVector(REALSXP,rows+cols));
-  PROTECT(R_scale = allocVector(REALSXP,1));
-
-  SET_VECTOR_ELT(R_return_value,0,R_beta);
-  SET_VECTOR_ELT(R_return_value,1,R_weights);
-  SET_VECTOR_ELT(R_return_value,2,R_residuals);
-  SET_VECTOR_ELT(R_return_value,3,R_SE);
-  SET_VECTOR_ELT(R_return_value,4,R_scale);
-
-  UNPROTECT(5);
-
-  beta = NUMERIC_POINTER(R_beta);
-  residuals = NUMERIC_POINTER(R_residuals);
-  weights = NUMERIC_POINTER(R_weights);
-  se = NUMERIC_POINTER(R_SE);
-  scaleptr = NUMERIC_POINTER(R_scale);
+  /* fitting scratch, followed by the residuals and weights when they are not returned */
+  work = R_Calloc(RLM_FIT_ANOVA_WORK(rows, cols) + 
+                  ((output & RCMODEL_RESIDUALS) ? 0 : (size_t)rows*cols) + 
+                  ((output & RCMODEL_WEIGHTS) ? 0 : (size_t)rows*cols) + rows + cols, double);
+  next = work + RLM_FIT_ANOVA_WORK(rows, cols);
+
+  PROTECT(R_return_value = allocVector(VECSXP,nreturn));
+
+  if (output & RCMODEL_ESTIMATES){
+    R_elt = allocVector(REALSXP, rows + cols);
+    SET_VECTOR_ELT(R_return_value,0,R_elt);
+    beta = NUMERIC_POINTER(R_elt);
+  } else {
+    beta = next;
+    next += rows + cols;
+  }
+  if (output & RCMODEL_WEIGHTS){
+    R_elt = allocMatrix(REALSXP,rows,cols);
+    SET_VECTOR_ELT(R_return_value,1,R_elt);
+    weights = NUMERIC_POINTER(R_elt);
+  } else {
+    weights = next;
+    next += (size_t)rows*cols;
+  }
+  if (output & RCMODEL_RESIDUALS){
+    R_elt = allocMatrix(REALSXP,rows,cols);
+    SET_VECTOR_ELT(R_return_value,2,R_elt);
+    residuals = NUMERIC_POINTER(R_elt);
+  } else {
+    residuals = next;
+    next += (size_t)rows*cols;
+  }
+  if (output & RCMODEL_STDERRORS){
+    R_elt = allocVector(REALSXP,rows+cols);
+    SET_VECTOR_ELT(R_return_value,3,R_elt);
+    se = NUMERIC_POINTER(R_elt);
+  }
+  if (output & RCMODEL_SCALE){
+    R_elt = allocVector(REALSXP,1);
+    SET_VECTOR_ELT(R_return_value,4,R_elt);
+    scaleptr = NUMERIC_POINTER(R_elt);
+  }
 
   if (isNull(Scales)){
     scaleptr[0] = -1.0;
@@ -124,15 +158,22 @@ SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
 
   Ymat = NUMERIC_POINTER(Y);
   
-  
-  
-
-  
-  rlm_fit_anova_scale(Ymat, rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0);
-  
-  rlm_compute_se_anova(Ymat, rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(PsiCode)),asReal(PsiK));
-
+  if (!isNull(Weights)){
+    w = NUMERIC_POINTER(Weights);
+    rlm_wfit_anova_scale_ws(Ymat, rows, cols, scaleptr, w, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0, work);
+  } else {
+    iterations = rlm_fit_anova_control(Ymat, rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0, warm_start, work);
+    if (output & RCMODEL_ITERATIONS){
+      SET_VECTOR_ELT(R_return_value,5,ScalarInteger(iterations));
+    }
+  }
 
+  if (se != NULL){
+    rlm_compute_se_anova(Ymat, rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(PsiCode)),asReal(PsiK));
+    if (w != NULL){
+      se[rows+cols -1] = 0.0;
+    }
+  }
   
 
   beta[rows+cols -1] = 0.0;
@@ -141,17 +182,17 @@ SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
   for (i = cols; i < rows + cols -1; i++)
     beta[rows+cols -1]-=beta[i];
 
+  R_Free(work);
 
-
-
-
-
-  PROTECT(R_return_value_names= allocVector(STRSXP,5));
+  PROTECT(R_return_value_names= allocVector(STRSXP,nreturn));
   SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
   SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
   SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
   SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
   SET_STRING_ELT(R_return_value_names,4,mkChar("Scale"));
+  if (nreturn > 5){
+    SET_STRING_ELT(R_return_value_names,5,mkChar("Iterations"));
+  }
   setAttrib(R_return_value, R_NamesSymbol,R_return_value_names);
   UNPROTECT(2);
   return R_return_value;
@@ -160,113 +201,38 @@ SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
 
 
 
+SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales){
 
-
-
-
-
-
+  return rlm_rma_default_model(Y, PsiCode, PsiK, R_NilValue, Scales, RCMODEL_ALL, 0);
+}
 
 
 SEXP R_wrlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales){
 
-
-  SEXP R_return_value;
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  SEXP R_scale;
- 
-  SEXP R_return_value_names;
-
-  SEXP dim1;
-
-  double *beta;
-  double *residuals;
-  double *weights;
-  double *se;
-
-  /* double scale=-1.0;*/
-  double *scaleptr;
-
-  double residSE;
-
-  double *Ymat;
-  double *w;
-
-  int rows;
-  int cols;
-
-  int i;
-  
-  PROTECT(dim1 = getAttrib(Y,R_DimSymbol));
-  rows = INTEGER(dim1)[0];
-  cols = INTEGER(dim1)[1];
-  UNPROTECT(1);
-
-  PROTECT(R_return_value = allocVector(VECSXP,5));
-  PROTECT(R_beta = allocVector(REALSXP, rows + cols));
-  PROTECT(R_weights = allocMatrix(REALSXP,rows,cols));
-  PROTECT(R_residuals = allocMatrix(REALSXP,rows,cols));
-  PROTECT(R_SE = allocVector(REALSXP,rows+cols));
-  PROTECT(R_scale = allocVector(REALSXP,1));
-  
-  SET_VECTOR_ELT(R_return_value,0,R_beta);
-  SET_VECTOR_ELT(R_return_value,1,R_weights);
-  SET_VECTOR_ELT(R_return_value,2,R_residuals);
-  SET_VECTOR_ELT(R_return_value,3,R_SE);
-  SET_VECTOR_ELT(R_return_value,4,R_scale);
-  
-  UNPROTECT(5);
-
-  beta = NUMERIC_POINTER(R_beta);
-  residuals = NUMERIC_POINTER(R_residuals);
-  weights = NUMERIC_POINTER(R_weights);
-  se = NUMERIC_POINTER(R_SE);
-  scaleptr = NUMERIC_POINTER(R_scale);
-
-  if (isNull(Scales)){
-    scaleptr[0] = -1.0;
-  } else if (length(Scales) != cols) {
-    scaleptr[0] = NUMERIC_POINTER(Scales)[0];
-  }
-
-
-
-  Ymat = NUMERIC_POINTER(Y);
-  
-  w = NUMERIC_POINTER(Weights);
-  
-
-  
-  rlm_wfit_anova_scale(Ymat, rows, cols, scaleptr, w, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0);
-  rlm_compute_se_anova(Ymat, rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(PsiCode)),asReal(PsiK));
-
-
-  beta[rows+cols -1] = 0.0;
-  se[rows+cols -1] = 0.0;
-
-  for (i = cols; i < rows + cols -1; i++)
-    beta[rows+cols -1]-=beta[i];
-
-
+  return rlm_rma_default_model(Y, PsiCode, PsiK, Weights, Scales, RCMODEL_ALL, 0);
+}
 
 
+/**********************************************************************************
+ **
+ ** SEXP R_rlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales, SEXP Output, SEXP WarmStart)
+ ** SEXP R_wrlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales, SEXP Output)
+ **
+ ** as R_rlm_rma_default_model and R_wrlm_rma_default_model, but SEXP Output (an integer
+ ** made up of the RCMODEL_* bits) selects which components are computed and returned.
+ ** If SEXP WarmStart is TRUE the unweighted fit starts from a median polish fit
+ **
+ *********************************************************************/
 
+SEXP R_rlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales, SEXP Output, SEXP WarmStart){
 
+  return rlm_rma_default_model(Y, PsiCode, PsiK, R_NilValue, Scales, asInteger(Output), asLogical(WarmStart));
+}
 
 
-  PROTECT(R_return_value_names= allocVector(STRSXP,5));
-  SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-  SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
-  SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
-  SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
-  SET_STRING_ELT(R_return_value_names,4,mkChar("Scale"));
-  setAttrib(R_return_value, R_NamesSymbol,R_return_value_names);
-  UNPROTECT(2);
-  return R_return_value;
+SEXP R_wrlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales, SEXP Output){
 
+  return rlm_rma_default_model(Y, PsiCode, PsiK, Weights, Scales, asInteger(Output) & ~RCMODEL_ITERATIONS, 0);
 }
 
 
@@ -1,9 +1,20 @@
 #ifndef R_RLM_INTERFACES_H
 #define R_RLM_INTERFACES_H
 
+/* the components returned by R_rlm_rma_default_model_output and R_wrlm_rma_default_model_output */
+
+#define RCMODEL_ESTIMATES 1
+#define RCMODEL_WEIGHTS 2
+#define RCMODEL_RESIDUALS 4
+#define RCMODEL_STDERRORS 8
+#define RCMODEL_SCALE 16
+#define RCMODEL_ALL 31
+#define RCMODEL_ITERATIONS 32
 
 SEXP R_rlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales);
 SEXP R_wrlm_rma_default_model(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales);
+SEXP R_rlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Scales, SEXP Output, SEXP WarmStart);
+SEXP R_wrlm_rma_default_model_output(SEXP Y, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales, SEXP Output);
 SEXP R_medianpolish_rma_default_model(SEXP Y);
 SEXP R_rlm_rma_given_probe_effects(SEXP Y, SEXP probe_effects, SEXP PsiCode, SEXP PsiK, SEXP Scales);
 SEXP R_wrlm_rma_given_probe_effects(SEXP Y, SEXP probe_effects, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Scales);
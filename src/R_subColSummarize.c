@@ -17,6 +17,22 @@
  **                for each R_subColSummarize_*
  **
  ** Dec 1, 2010 - change how PTHREAD_STACK_MIN is used
+ ** Oct 18, 2026 - worker threads no longer take mutex_R when storing results
+ **                (each owns its own range of probesets). Results are staged
+ **                in a small per-thread tile and stored a column at a time.
+ ** Oct 18, 2026 - R_rowIndexList may also be a ProbeGroupIndex. Groups are 
+ **                always accessed in CSR form (see probe_group_index.c)
+ ** Oct 18, 2026 - threads take blocks of probesets from a shared schedule,
+ **                largest first, rather than a fixed equal count each
+ ** Oct 18, 2026 - add R_subColSummarize_multi
+ ** Oct 18, 2026 - RMatrix may be a Log2MatrixCache (see log2_matrix_cache.c)
+ ** Oct 18, 2026 - the median polish summaries share one implementation, add
+ **                R_subColSummarize_medianpolish_control. The threaded
+ **                R_subColSummarize_medianpolish was computing medians
+ **                rather than median polish.
+ ** Oct 18, 2026 - R_THREADS is checked before the probe groups are made, and
+ **                a failed pthread_create() frees the groups and thread
+ **                buffers before reporting the error
  **
  *********************************************************************/
 
@@ -37,22 +53,33 @@
 #include "median.h"
 
 #include "medianpolish.h"
+#include "multi_summarize.h"
+#include "log2_matrix_cache.h"
+#include "R_subColSummarize.h"
+#include "probe_group_index.h"
 #include "common.h"
 
 #ifdef USE_PTHREADS
 #include <pthread.h>
 #include <limits.h>
 #include <unistd.h>
-#define THREADS_ENV_VAR "R_THREADS"
 struct loop_data{
   double *matrix;
   double *results;
-  SEXP *R_rowIndexList;
+  struct probe_group_index *groups;
   int rows;
   int cols;
   int length_rowIndexList;
-  int start_row;
-  int end_row;
+  struct probe_group_schedule *schedule;
+  double *log_matrix;    /* R_subColSummarize_multi only */
+  int *stats;
+  int nstats;
+  double **results_multi;
+  int log_transform;     /* the median polish summaries only */
+  int maxiter;
+  double eps;
+  int check_convergence;
+  int *iterations;
 };
 
 #ifdef __linux__
@@ -71,27 +98,53 @@ struct loop_data{
 
 #ifdef USE_PTHREADS
 
+/*********************************************************************
+ **
+ ** Each worker thread takes blocks of consecutive probesets (rows of the
+ ** results matrix) from a shared schedule, so no two threads ever write 
+ ** to the same element and no locking is needed. Writing each probeset's
+ ** summaries straight into results would be a store every 
+ ** length_rowIndexList doubles, so instead a block (at most SUBCOL_TILE 
+ ** probesets) is summarized into a tile (one row of the tile per
+ ** probeset) and then copied to results a column at a time, giving runs
+ ** of consecutive doubles.
+ **
+ *********************************************************************/
+
+#define SUBCOL_TILE 32
+
+static void store_tile(double *results, double *tile, int length_rowIndexList, int cols, int tile_start, int tile_len){
+  int i, j;
+  double *cur_results;
+
+  for (i = 0; i < cols; i++){
+    cur_results = &results[(size_t)i*length_rowIndexList + tile_start];
+    for (j = 0; j < tile_len; j++){
+      cur_results[j] = tile[(size_t)j*cols + i];
+    }
+  }
+}
+
+
 static void *subColSummarize_avg_log_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    AverageLog_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      AverageLog_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 
@@ -105,20 +158,21 @@ SEXP R_subColSummarize_avg_log(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -136,80 +190,70 @@ SEXP R_subColSummarize_avg_log(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  /* the log2 values are already in the cache, so summarize them as they are */
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_avg(log2_matrix_cache_log2(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
   results = NUMERIC_POINTER(R_summaries);
  
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_avg_log_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -223,15 +267,15 @@ SEXP R_subColSummarize_avg_log(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else
  
   buffer = R_Calloc(cols,double);
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     AverageLog_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -240,6 +284,8 @@ SEXP R_subColSummarize_avg_log(SEXP RMatrix, SEXP R_rowIndexList){
   }
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -251,23 +297,21 @@ static void *subColSummarize_log_avg_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    LogAverage_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      LogAverage_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -278,20 +322,21 @@ SEXP R_subColSummarize_log_avg(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -309,81 +354,70 @@ SEXP R_subColSummarize_log_avg(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_log_avg(log2_matrix_cache_source(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_log_avg_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -397,7 +431,7 @@ SEXP R_subColSummarize_log_avg(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else
@@ -405,8 +439,8 @@ SEXP R_subColSummarize_log_avg(SEXP RMatrix, SEXP R_rowIndexList){
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     LogAverage_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -416,6 +450,8 @@ SEXP R_subColSummarize_log_avg(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -427,23 +463,21 @@ static void *subColSummarize_avg_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    ColAverage_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      ColAverage_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -454,20 +488,21 @@ SEXP R_subColSummarize_avg(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -485,81 +520,70 @@ SEXP R_subColSummarize_avg(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_avg(log2_matrix_cache_source(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_avg_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -573,15 +597,15 @@ SEXP R_subColSummarize_avg(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     ColAverage_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -591,6 +615,8 @@ SEXP R_subColSummarize_avg(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -602,23 +628,21 @@ static void *subColSummarize_biweight_log_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    TukeyBiweight_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      TukeyBiweight_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -631,20 +655,21 @@ SEXP R_subColSummarize_biweight_log(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -663,80 +688,70 @@ SEXP R_subColSummarize_biweight_log(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 
 
+  /* the log2 values are already in the cache, so summarize them as they are */
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_biweight(log2_matrix_cache_log2(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_biweight_log_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -750,15 +765,15 @@ SEXP R_subColSummarize_biweight_log(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else 
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     TukeyBiweight_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -768,6 +783,8 @@ SEXP R_subColSummarize_biweight_log(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -779,23 +796,21 @@ static void *subColSummarize_biweight_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    TukeyBiweight_no_log_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      TukeyBiweight_no_log_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -807,20 +822,21 @@ SEXP R_subColSummarize_biweight(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -838,81 +854,70 @@ SEXP R_subColSummarize_biweight(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_biweight(log2_matrix_cache_source(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_biweight_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -926,7 +931,7 @@ SEXP R_subColSummarize_biweight(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else 
@@ -934,8 +939,8 @@ SEXP R_subColSummarize_biweight(SEXP RMatrix, SEXP R_rowIndexList){
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     TukeyBiweight_no_log_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -945,6 +950,8 @@ SEXP R_subColSummarize_biweight(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -955,23 +962,21 @@ static void *subColSummarize_median_log_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    MedianLog_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      MedianLog_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -984,20 +989,21 @@ SEXP R_subColSummarize_median_log(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -1015,81 +1021,71 @@ SEXP R_subColSummarize_median_log(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  /* the log2 values are already in the cache, so summarize them as they are */
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_median(log2_matrix_cache_log2(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_median_log_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -1103,15 +1099,15 @@ SEXP R_subColSummarize_median_log(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else  
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     MedianLog_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -1121,6 +1117,8 @@ SEXP R_subColSummarize_median_log(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -1131,23 +1129,21 @@ static void *subColSummarize_log_median_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    LogMedian_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      LogMedian_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -1159,20 +1155,21 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -1190,81 +1187,70 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_log_median(log2_matrix_cache_source(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_log_median_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -1278,15 +1264,15 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else   
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     LogMedian_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -1296,6 +1282,8 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -1306,23 +1294,21 @@ static void *subColSummarize_median_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer;
-  int i, j;
+  double *tile;
+  int j, start_row, end_row;
   int ncur_rows;
   
-  buffer = R_Calloc(args->cols,double);
-
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    ColMedian_noSE(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      ColMedian_noSE(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows);
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
+  R_Free(tile);
   return NULL;
 }
 #endif
@@ -1333,20 +1319,21 @@ SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList){
   SEXP R_summaries;  
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
+  double *matrix;
   double *results, *buffer;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -1364,81 +1351,70 @@ SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    return R_subColSummarize_median(log2_matrix_cache_source(RMatrix), R_rowIndexList);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
  
   results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, subColSummarize_median_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -1452,15 +1428,15 @@ SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else    
   buffer = R_Calloc(cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
     ColMedian_noSE(matrix, rows, cols, cur_rows, buffer, ncur_rows);
     
     for (i = 0; i < cols; i++){
@@ -1470,6 +1446,8 @@ SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList){
   
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_summaries;
 }
@@ -1477,55 +1455,67 @@ SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList){
 
 
 #ifdef  USE_PTHREADS
-static void *subColSummarize_medianpolish_log_group(void *data){
+static void *subColSummarize_medianpolish_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer, *buffer2;
-  int i, j;
-  int ncur_rows;
+  double *tile, *buffer2;
+  int j, start_row, end_row;
+  int ncur_rows, iterations;
   
-  buffer = R_Calloc(args->cols,double);
+  tile = R_Calloc(SUBCOL_TILE*args->cols,double);
   buffer2 = R_Calloc(args->cols,double);
 
- 
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    MedianPolish(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows, buffer2);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      iterations = MedianPolish_control(args->matrix, args->rows, args->cols, cur_rows, &tile[(j - start_row)*args->cols], ncur_rows, buffer2,
+					args->log_transform, args->maxiter, args->eps, args->check_convergence);
+      if (args->iterations != NULL)
+	args->iterations[j] = iterations;
     }
-    pthread_mutex_unlock (&mutex_R);
+    store_tile(args->results, tile, args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
   }
-  R_Free(buffer);
-  R_Free(buffer2); 
+  R_Free(tile);
+  R_Free(buffer2);
   return NULL;
 }
 #endif
 
 
+/*********************************************************************
+ **
+ ** static SEXP subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList, int log_transform,
+ **                                          int maxiter, double eps, int check_convergence, 
+ **                                          int report_iterations)
+ **
+ ** median polish each probeset (log2 transforming first if log_transform is
+ ** non zero) with the given convergence settings (see median_polish_fit_control()).
+ ** If report_iterations is non zero the number of iterations used for each 
+ ** probeset is attached to the result as the "iterations" attribute.
+ **
+ *********************************************************************/
 
-SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList){
+static SEXP subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList, int log_transform, int maxiter, double eps, int check_convergence, int report_iterations){
 
   SEXP R_summaries;  
+  SEXP R_iterations = R_NilValue;
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
-  double *results, *buffer, *buffer2;
+  double *matrix;
+  double *results;
+  int *iterations = NULL;
   
-  int *cur_rows;
-
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
-  int ncur_rows;
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
 
-  int i,j;
+  int i;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -1541,87 +1531,89 @@ SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList){
 #else
   size_t stacksize = 0x8000;
 #endif
+#else
+  double *buffer, *buffer2;
+  int *cur_rows;
+  int j, ncur_rows, iter;
 #endif
 
+  /* the log2 values are already in the cache, so summarize them as they are */
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+#ifdef USE_PTHREADS
+    pthread_attr_destroy(&attr);
+#endif
+    if (log_transform)
+      return subColSummarize_medianpolish(log2_matrix_cache_log2(RMatrix), R_rowIndexList, 0, maxiter, eps, check_convergence, report_iterations);
+    else
+      return subColSummarize_medianpolish(log2_matrix_cache_source(RMatrix), R_rowIndexList, 0, maxiter, eps, check_convergence, report_iterations);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
 
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
   PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
- 
   results = NUMERIC_POINTER(R_summaries);
- 
-  buffer = R_Calloc(cols,double);
-  buffer2 = R_Calloc(cols,double);
-#ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
+
+  if (report_iterations){
+    PROTECT(R_iterations = allocVector(INTSXP,length_rowIndexList));
+    iterations = INTEGER(R_iterations);
   }
+#ifdef  USE_PTHREADS
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
   args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
+  args[0].log_transform = log_transform;
+  args[0].maxiter = maxiter;
+  args[0].eps = eps;
+  args[0].check_convergence = check_convergence;
+  args[0].iterations = iterations;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
-     returnCode = pthread_create(&threads[i], &attr, subColSummarize_medianpolish_log_group, (void *) &(args[i]));
+     returnCode = pthread_create(&threads[i], &attr, subColSummarize_medianpolish_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -1635,14 +1627,19 @@ SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else    
+  buffer = R_Calloc(cols,double);
+  buffer2 = R_Calloc(cols,double);
+
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
-    MedianPolish(matrix, rows, cols, cur_rows, buffer, ncur_rows, buffer2);
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
+    iter = MedianPolish_control(matrix, rows, cols, cur_rows, buffer, ncur_rows, buffer2, log_transform, maxiter, eps, check_convergence);
+    if (iterations != NULL)
+      iterations[j] = iter;
     
     for (i = 0; i < cols; i++){
       results[i*length_rowIndexList + j] = buffer[i];
@@ -1651,61 +1648,118 @@ SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList){
   R_Free(buffer2);
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
+
+  if (report_iterations){
+    setAttrib(R_summaries, install("iterations"), R_iterations);
+    UNPROTECT(1);
+  }
   UNPROTECT(1);
   return R_summaries;
 }
 
 
-#ifdef  USE_PTHREADS
-static void *subColSummarize_medianpolish_group(void *data){
+
+SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList){
+  return subColSummarize_medianpolish(RMatrix, R_rowIndexList, 1, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1, 0);
+}
+
+
+
+SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
+  return subColSummarize_medianpolish(RMatrix, R_rowIndexList, 0, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1, 0);
+}
+
+
+
+/*********************************************************************
+ **
+ ** SEXP R_subColSummarize_medianpolish_control(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_log_transform,
+ **                                             SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence)
+ **
+ ** as R_subColSummarize_medianpolish_log() (R_log_transform TRUE) or 
+ ** R_subColSummarize_medianpolish() (FALSE) but with the convergence settings
+ ** given. The number of iterations used for each probeset is returned as the
+ ** "iterations" attribute of the result.
+ **
+ *********************************************************************/
+
+SEXP R_subColSummarize_medianpolish_control(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_log_transform, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence){
+  return subColSummarize_medianpolish(RMatrix, R_rowIndexList, asLogical(R_log_transform), asInteger(R_maxiter), asReal(R_eps), asLogical(R_check_convergence), 1);
+}
+
+
+
+
+#ifdef USE_PTHREADS
+static void *subColSummarize_multi_group(void *data){
   
   struct loop_data *args = (struct loop_data *) data;
   int *cur_rows;
-  double *buffer, *buffer2;
-  int i, j;
+  double *tile;
+  int j, s, start_row, end_row;
   int ncur_rows;
+  size_t tile_size = (size_t)SUBCOL_TILE*args->cols;
   
-  buffer = R_Calloc(args->cols,double);
-  buffer2 = R_Calloc(args->cols,double);
+  /* one tile per statistic */
+  tile = R_Calloc(args->nstats*tile_size,double);
 
- 
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
-    MedianPolish_no_log(args->matrix, args->rows, args->cols, cur_rows, buffer, ncur_rows, buffer2);
-    pthread_mutex_lock (&mutex_R);
-    for (i = 0; i < args->cols; i++){
-      args->results[i*args->length_rowIndexList + j] = buffer[i];
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
+      MultiSummarize_noSE(args->matrix, args->log_matrix, args->rows, args->cols, cur_rows, ncur_rows, args->stats, args->nstats, &tile[(j - start_row)*args->cols], tile_size);
+    }
+    for (s = 0; s < args->nstats; s++){
+      store_tile(args->results_multi[s], &tile[s*tile_size], args->length_rowIndexList, args->cols, start_row, end_row - start_row + 1);
     }
-    pthread_mutex_unlock (&mutex_R);
   }
-  R_Free(buffer);
-  R_Free(buffer2);
+  R_Free(tile);
   return NULL;
 }
 #endif
 
 
 
-SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
+/*********************************************************************
+ **
+ ** SEXP R_subColSummarize_multi(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_stats)
+ **
+ ** SEXP RMatrix - probes by arrays matrix (or a Log2MatrixCache)
+ ** SEXP R_rowIndexList - list of row indices (or a ProbeGroupIndex) defining the probesets
+ ** SEXP R_stats - integer vector of statistics to compute (MULTI_SUMMARY_* codes, 
+ **                see multi_summarize.h)
+ **
+ ** returns a list with one probesets by arrays matrix per statistic, in 
+ ** the order requested. Each probeset is gathered and log transformed once
+ ** for all the statistics.
+ **
+ *********************************************************************/
+
+SEXP R_subColSummarize_multi(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_stats){
 
   SEXP R_summaries;  
+  SEXP R_cur;
   SEXP dim1;
 
-  double *matrix=NUMERIC_POINTER(RMatrix);
-  double *results, *buffer, *buffer2;
+  double *matrix, *log_matrix = NULL;
+  double **results, *buffer;
   
   int *cur_rows;
+  int *stats = INTEGER(R_stats);
+  int nstats = LENGTH(R_stats);
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
-  int i,j;
+  int i,j,s;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -1723,81 +1777,94 @@ SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #endif
 
+  for (s = 0; s < nstats; s++){
+    if (stats[s] == NA_INTEGER || stats[s] < 0 || stats[s] >= MULTI_SUMMARY_N){
+      error("unknown summary statistic code %d", stats[s]);
+    }
+  }
+
+  /* with a Log2MatrixCache the log scale statistics read its log2 matrix */
+  if (TYPEOF(RMatrix) == EXTPTRSXP){
+    log_matrix = NUMERIC_POINTER(log2_matrix_cache_log2(RMatrix));
+    RMatrix = log2_matrix_cache_source(RMatrix);
+  }
+  matrix = NUMERIC_POINTER(RMatrix);
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
-  PROTECT(R_summaries = allocMatrix(REALSXP,length_rowIndexList,cols));
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
+  PROTECT(R_summaries = allocVector(VECSXP,nstats));
+  results = R_Calloc((nstats > 0 ? nstats : 1), double *);
+  for (s = 0; s < nstats; s++){
+    PROTECT(R_cur = allocMatrix(REALSXP,length_rowIndexList,cols));
+    SET_VECTOR_ELT(R_summaries,s,R_cur);
+    UNPROTECT(1);
+    results[s] = NUMERIC_POINTER(R_cur);
+  }
+
+  if (nstats == 0){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    R_Free(results);
+    UNPROTECT(1);
+    return R_summaries;
+  }
  
-  results = NUMERIC_POINTER(R_summaries);
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBCOL_TILE, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
-  args[0].results = results;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].log_matrix = log_matrix;
+  args[0].results = NULL;
+  args[0].results_multi = results;
+  args[0].stats = stats;
+  args[0].nstats = nstats;
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
-     returnCode = pthread_create(&threads[i], &attr, subColSummarize_median_group, (void *) &(args[i]));
+     returnCode = pthread_create(&threads[i], &attr, subColSummarize_multi_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         R_Free(results);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -1811,25 +1878,28 @@ SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else     
-  buffer = R_Calloc(cols,double);
-  buffer2 = R_Calloc(cols,double);
+  buffer = R_Calloc(nstats*cols,double);
 
   for (j =0; j < length_rowIndexList; j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
-    MedianPolish_no_log(matrix, rows, cols, cur_rows, buffer, ncur_rows, buffer2);
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
+    MultiSummarize_noSE(matrix, log_matrix, rows, cols, cur_rows, ncur_rows, stats, nstats, buffer, cols);
     
-    for (i = 0; i < cols; i++){
-      results[i*length_rowIndexList + j] = buffer[i];
+    for (s = 0; s < nstats; s++){
+      for (i = 0; i < cols; i++){
+	results[s][i*length_rowIndexList + j] = buffer[s*cols + i];
+      }
     }
   }
-  R_Free(buffer2);
   R_Free(buffer);
 #endif
+  if (temporary_groups)
+    probe_group_index_free(groups);
+  R_Free(results);
   UNPROTECT(1);
   return R_summaries;
 }
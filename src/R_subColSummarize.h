@@ -11,6 +11,8 @@ SEXP R_subColSummarize_log_median(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_median(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_medianpolish_log(SEXP RMatrix, SEXP R_rowIndexList);
 SEXP R_subColSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList);
+SEXP R_subColSummarize_medianpolish_control(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_log_transform, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence);
+SEXP R_subColSummarize_multi(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_stats);
 
 
 #endif
@@ -13,6 +13,23 @@
  **
  ** History
  ** Mar 7, 2012 - Initial version
+ ** Oct 18, 2026 - R_rowIndexList may also be a ProbeGroupIndex (see probe_group_index.c)
+ ** Oct 18, 2026 - threads take blocks of probesets from a shared schedule,
+ **                most expensive first, rather than a fixed equal count each
+ ** Oct 18, 2026 - add R_sub_rcModelSummarize_medianpolish_control, which takes maxiter, 
+ **                eps and whether to check convergence, and reports the iterations 
+ **                for each probeset
+ ** Oct 18, 2026 - R_sub_rcModelSummarize_plm fits every probeset in one workspace
+ **                (per thread) sized to the largest probeset
+ ** Oct 18, 2026 - all output is allocated on the main thread before the workers start,
+ **                so they no longer take mutex_R for every probeset
+ ** Oct 18, 2026 - add R_sub_rcModelSummarize_plm_compact and
+ **                R_sub_rcModelSummarize_medianpolish_compact which return dense
+ **                probesets by arrays matrices rather than a list per probeset
+ ** Oct 18, 2026 - add R_sub_rcModelSummarize_plmr and R_sub_rcModelSummarize_plmd,
+ **                the PLM-r (and -rr, -rc) and PLM-d fits of every probeset
+ ** Oct 18, 2026 - nothing allocated is leaked when R_THREADS is invalid or
+ **                a thread cannot be started
  **
  *********************************************************************/
 
@@ -24,11 +41,312 @@
 
 #include "rlm.h"
 #include "rlm_se.h"
+#include "plmr.h"
+#include "plmd.h"
 #include "psi_fns.h"
 #include "medianpolish.h"
+#include "probe_group_index.h"
 #include "common.h"
 
 
+/* workspace for one PLM fit and its standard errors, the probeset data first */
+#define SUB_RCMODEL_PLM_WORK(y_rows, y_cols) ((size_t)(y_rows)*(y_cols) + RLM_FIT_ANOVA_WORK(y_rows, y_cols) + RLM_COMPUTE_SE_ANOVA_WORK(y_rows, y_cols, 4))
+
+static int largest_group(struct probe_group_index *groups){
+
+  int j, n, largest = 1;
+
+  for (j = 0; j < groups->ngroups; j++){
+    n = groups->offsets[j+1] - groups->offsets[j];
+    if (n > largest)
+      largest = n;
+  }
+  return largest;
+}
+
+
+/* 
+   where the fit of one probeset is stored. Everything is allocated 
+   (on the main thread) before any fitting starts, so that the worker 
+   threads only ever write into these arrays. Unused components are NULL
+*/
+
+struct sub_rcModel_output{
+  double *beta;
+  double *weights;
+  double *residuals;
+  double *se;
+  double *scale;    /* PLM only */
+  int *iterations;  /* median polish only */
+  int *was_split;   /* PLM-d only */
+};
+
+/* the models sub_rcModel_output_alloc() knows the output of */
+#define SUB_RCMODEL_MEDIANPOLISH 0
+#define SUB_RCMODEL_PLM 1
+#define SUB_RCMODEL_PLMR 2
+#define SUB_RCMODEL_PLMD 3
+#define SUB_RCMODEL_MEDIANPOLISH_ITERATIONS 4
+
+
+/**********************************************************************************
+ **
+ ** static struct sub_rcModel_output *sub_rcModel_output_alloc(SEXP R_return_value, 
+ **                 struct probe_group_index *groups, int cols, int model)
+ **
+ ** SEXP R_return_value - list of length groups->ngroups, filled in with a list
+ **                       (Estimates, Weights, Residuals, StdErrors and then Scale, 
+ **                       Iterations or WasSplit) for each probeset
+ ** int model - one of the SUB_RCMODEL_* codes above. PLM-r and median polish
+ **             (unless SUB_RCMODEL_MEDIANPOLISH_ITERATIONS) have no fifth item.
+ **             For PLM-d the number of parameters is not known until the probeset
+ **             has been fitted, so Estimates and StdErrors are left for the caller
+ **             and beta and se are not set
+ **
+ ** returns the raw storage of each probeset's output (free with R_Free)
+ **
+ *********************************************************************************/
+
+static struct sub_rcModel_output *sub_rcModel_output_alloc(SEXP R_return_value, struct probe_group_index *groups, int cols, int model){
+
+  SEXP R_return_value_cur;
+  SEXP R_weights;
+  SEXP R_residuals;
+  SEXP R_beta;
+  SEXP R_SE;
+  SEXP R_last;
+  SEXP R_return_value_names;
+
+  struct sub_rcModel_output *output = R_Calloc(groups->ngroups > 0 ? groups->ngroups : 1, struct sub_rcModel_output);
+  int j, ncur_rows;
+  int nreturn = ((model == SUB_RCMODEL_PLMR || model == SUB_RCMODEL_MEDIANPOLISH) ? 4 : 5);
+  int medianpolish = (model == SUB_RCMODEL_MEDIANPOLISH || model == SUB_RCMODEL_MEDIANPOLISH_ITERATIONS);
+
+  PROTECT(R_return_value_names= allocVector(STRSXP,nreturn));
+  SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
+  SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
+  SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
+  SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
+  if (model == SUB_RCMODEL_PLM){
+    SET_STRING_ELT(R_return_value_names,4,mkChar("Scale"));
+  } else if (model == SUB_RCMODEL_MEDIANPOLISH_ITERATIONS){
+    SET_STRING_ELT(R_return_value_names,4,mkChar("Iterations"));
+  } else if (model == SUB_RCMODEL_PLMD){
+    SET_STRING_ELT(R_return_value_names,4,mkChar("WasSplit"));
+  }
+
+  for (j =0; j < groups->ngroups; j++){
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+
+    PROTECT(R_return_value_cur = allocVector(VECSXP,nreturn));
+    SET_VECTOR_ELT(R_return_value,j,R_return_value_cur);
+    UNPROTECT(1);
+
+    if (model != SUB_RCMODEL_PLMD){
+      R_beta = allocVector(REALSXP, ncur_rows + cols);
+      SET_VECTOR_ELT(R_return_value_cur,0,R_beta);
+      output[j].beta = NUMERIC_POINTER(R_beta);
+    }
+    R_residuals = allocMatrix(REALSXP,ncur_rows,cols);
+    SET_VECTOR_ELT(R_return_value_cur,2,R_residuals);
+    output[j].residuals = NUMERIC_POINTER(R_residuals);
+
+    if (medianpolish){
+      if (model == SUB_RCMODEL_MEDIANPOLISH_ITERATIONS){
+        R_last = allocVector(INTSXP,1);
+        SET_VECTOR_ELT(R_return_value_cur,4,R_last);
+        output[j].iterations = INTEGER(R_last);
+      }
+    } else {
+      R_weights = allocMatrix(REALSXP,ncur_rows,cols);
+      SET_VECTOR_ELT(R_return_value_cur,1,R_weights);
+      output[j].weights = NUMERIC_POINTER(R_weights);
+
+      if (model != SUB_RCMODEL_PLMD){
+        R_SE = allocVector(REALSXP,ncur_rows+cols);
+        SET_VECTOR_ELT(R_return_value_cur,3,R_SE);
+        output[j].se = NUMERIC_POINTER(R_SE);
+      }
+
+      if (model == SUB_RCMODEL_PLM){
+        R_last = allocVector(REALSXP,1);
+        SET_VECTOR_ELT(R_return_value_cur,4,R_last);
+        output[j].scale = NUMERIC_POINTER(R_last);
+      } else if (model == SUB_RCMODEL_PLMD){
+        R_last = allocVector(INTSXP,ncur_rows);
+        SET_VECTOR_ELT(R_return_value_cur,4,R_last);
+        output[j].was_split = INTEGER(R_last);
+      }
+    }
+
+    setAttrib(R_return_value_cur, R_NamesSymbol,R_return_value_names);
+  }
+  UNPROTECT(1);
+
+  return output;
+}
+
+
+/*
+  the compact form of the output: the column (chip) effects and their 
+  standard errors as probesets by columns matrices and, if asked for,
+  the row (probe) effects and residuals of every probeset one after
+  the other (in the order of groups->rows). Unused components are NULL
+*/
+
+struct sub_rcModel_compact{
+  int ngroups;
+  int nprobes;            /* groups->offsets[ngroups] */
+  double *estimates;      /* ngroups by cols */
+  double *se;             /* ngroups by cols, PLM only */
+  double *probe_effects;  /* length nprobes */
+  double *residuals;      /* nprobes by cols */
+};
+
+/* scratch each probeset is fitted into before being stored in compact form */
+#define SUB_RCMODEL_SCRATCH(y_rows, y_cols) (2*((size_t)(y_rows) + (y_cols)) + 2*(size_t)(y_rows)*(y_cols))
+
+
+/**********************************************************************************
+ **
+ ** static struct sub_rcModel_output *sub_rcModel_compact_alloc(SEXP R_return_value, 
+ **                 struct probe_group_index *groups, int cols, int plm,
+ **                 int want_probe_effects, int want_residuals, 
+ **                 struct sub_rcModel_compact *compact)
+ **
+ ** SEXP R_return_value - list of length 7 which is filled in with Estimates,
+ **                       StdErrors, Scale (or Iterations), ProbeEffects,
+ **                       Residuals, Offsets and Rows
+ ** int plm - non zero for the PLM output, otherwise the median polish output
+ ** int want_probe_effects, int want_residuals - whether to keep these, 
+ **                       Rows is given whenever either is kept
+ ** struct sub_rcModel_compact *compact - on output where to store each fit
+ **
+ ** Offsets is zero based, the rows of probeset j are Offsets[j]+1 ... Offsets[j+1]
+ ** of ProbeEffects and Residuals. Rows gives the row of the input matrix for each.
+ **
+ ** returns the per probeset output, only the scale (or iterations) is used
+ ** (free with R_Free)
+ **
+ *********************************************************************************/
+
+static struct sub_rcModel_output *sub_rcModel_compact_alloc(SEXP R_return_value, struct probe_group_index *groups, int cols, int plm, int want_probe_effects, int want_residuals, struct sub_rcModel_compact *compact){
+
+  SEXP R_elt;
+  SEXP R_return_value_names;
+
+  struct sub_rcModel_output *output = R_Calloc(groups->ngroups > 0 ? groups->ngroups : 1, struct sub_rcModel_output);
+  int j;
+  double *scale = NULL;
+  int *iterations = NULL;
+
+  compact->ngroups = groups->ngroups;
+  compact->nprobes = groups->offsets[groups->ngroups];
+  compact->se = NULL;
+  compact->probe_effects = NULL;
+  compact->residuals = NULL;
+
+  R_elt = allocMatrix(REALSXP, compact->ngroups, cols);
+  SET_VECTOR_ELT(R_return_value,0,R_elt);
+  compact->estimates = NUMERIC_POINTER(R_elt);
+
+  if (plm){
+    R_elt = allocMatrix(REALSXP, compact->ngroups, cols);
+    SET_VECTOR_ELT(R_return_value,1,R_elt);
+    compact->se = NUMERIC_POINTER(R_elt);
+
+    R_elt = allocVector(REALSXP, compact->ngroups);
+    SET_VECTOR_ELT(R_return_value,2,R_elt);
+    scale = NUMERIC_POINTER(R_elt);
+  } else {
+    R_elt = allocVector(INTSXP, compact->ngroups);
+    SET_VECTOR_ELT(R_return_value,2,R_elt);
+    iterations = INTEGER(R_elt);
+  }
+
+  if (want_probe_effects){
+    R_elt = allocVector(REALSXP, compact->nprobes);
+    SET_VECTOR_ELT(R_return_value,3,R_elt);
+    compact->probe_effects = NUMERIC_POINTER(R_elt);
+  }
+
+  if (want_residuals){
+    R_elt = allocMatrix(REALSXP, compact->nprobes, cols);
+    SET_VECTOR_ELT(R_return_value,4,R_elt);
+    compact->residuals = NUMERIC_POINTER(R_elt);
+  }
+
+  R_elt = allocVector(INTSXP, compact->ngroups + 1);
+  SET_VECTOR_ELT(R_return_value,5,R_elt);
+  memcpy(INTEGER(R_elt), groups->offsets, (compact->ngroups + 1)*sizeof(int));
+
+  if (want_probe_effects || want_residuals){
+    R_elt = allocVector(INTSXP, compact->nprobes);
+    SET_VECTOR_ELT(R_return_value,6,R_elt);
+    for (j = 0; j < compact->nprobes; j++){
+      INTEGER(R_elt)[j] = groups->rows[j] + 1;
+    }
+  }
+
+  for (j = 0; j < compact->ngroups; j++){
+    if (plm){
+      output[j].scale = &scale[j];
+    } else {
+      output[j].iterations = &iterations[j];
+    }
+  }
+
+  PROTECT(R_return_value_names= allocVector(STRSXP,7));
+  SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
+  SET_STRING_ELT(R_return_value_names,1,mkChar("StdErrors"));
+  SET_STRING_ELT(R_return_value_names,2,mkChar(plm ? "Scale" : "Iterations"));
+  SET_STRING_ELT(R_return_value_names,3,mkChar("ProbeEffects"));
+  SET_STRING_ELT(R_return_value_names,4,mkChar("Residuals"));
+  SET_STRING_ELT(R_return_value_names,5,mkChar("Offsets"));
+  SET_STRING_ELT(R_return_value_names,6,mkChar("Rows"));
+  setAttrib(R_return_value, R_NamesSymbol,R_return_value_names);
+  UNPROTECT(1);
+
+  return output;
+}
+
+
+/**********************************************************************************
+ **
+ ** static void sub_rcModel_compact_store(struct sub_rcModel_compact *compact, 
+ **                 struct probe_group_index *groups, int j, int cols, 
+ **                 double *beta, double *se, double *residuals)
+ **
+ ** copies the fit of probeset j (column effects then row effects in beta, 
+ ** se in the same order or NULL) into the compact output
+ **
+ *********************************************************************************/
+
+static void sub_rcModel_compact_store(struct sub_rcModel_compact *compact, struct probe_group_index *groups, int j, int cols, double *beta, double *se, double *residuals){
+
+  int k;
+  int offset = groups->offsets[j];
+  int ncur_rows = groups->offsets[j+1] - offset;
+
+  for (k = 0; k < cols; k++){
+    compact->estimates[(size_t)k*compact->ngroups + j] = beta[k];
+  }
+  if (compact->se != NULL){
+    for (k = 0; k < cols; k++){
+      compact->se[(size_t)k*compact->ngroups + j] = se[k];
+    }
+  }
+  if (compact->probe_effects != NULL){
+    memcpy(&compact->probe_effects[offset], &beta[cols], ncur_rows*sizeof(double));
+  }
+  if (compact->residuals != NULL){
+    for (k = 0; k < cols; k++){
+      memcpy(&compact->residuals[(size_t)k*compact->nprobes + offset], &residuals[(size_t)k*ncur_rows], ncur_rows*sizeof(double));
+    }
+  }
+}
+
+
 
 
 
@@ -36,19 +354,32 @@
 #include <pthread.h>
 #include <limits.h>
 #include <unistd.h>
-#define THREADS_ENV_VAR "R_THREADS"
+
+/* most probesets handed to a thread at a time */
+#define SUBRCMODEL_BLOCK 16
+
 struct loop_data{
   double *matrix;
-  SEXP *R_return_value;
-  SEXP *R_rowIndexList;
+  struct sub_rcModel_output *output;
+  struct sub_rcModel_compact *compact;   /* NULL unless the compact output is wanted */
+  struct probe_group_index *groups;
   SEXP *PsiCode;
   SEXP *PsiK;
   SEXP *Scales; 
   int rows;
   int cols;
   int length_rowIndexList;
-  int start_row;
-  int end_row;
+  struct probe_group_schedule *schedule;
+  int maxiter;             /* the median polish fits only */
+  double eps;
+  int check_convergence;
+  int largest_group;
+  double *weights;         /* the PLM-r and PLM-d fits only */
+  int robust;
+  int ngroups;
+  int *grouplabels;
+  pt2psi PsiFn;
+  double psi_k;
 };
 
 #ifdef __linux__
@@ -74,81 +405,55 @@ static void *sub_rcModelSummarize_medianpolish_group(void *data){
   int *cur_rows;
   double *buffer, *buffer2;
   int i, j, k;
-  int ncur_rows;
-
-  
-  SEXP R_return_value_cur;
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  
-  SEXP R_return_value_names;
+  int start_row, end_row;
+  int ncur_rows, iter;
 
   double *beta;
   double *residuals;
-  double *weights;
-  double *se;
 
   double intercept;
 
   int cols = args->cols;
+  double *scratch = NULL;
+
+  if (args->compact != NULL)
+    scratch = R_Calloc(SUB_RCMODEL_SCRATCH(args->largest_group, cols),double);
  
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
     
-    pthread_mutex_lock(&mutex_R);
-    PROTECT(R_return_value_cur = allocVector(VECSXP,4));
-    PROTECT(R_beta = allocVector(REALSXP, ncur_rows + cols));
-    /* PROTECT(R_weights = allocMatrix(REALSXP,ncur_rows,cols));*/
-    PROTECT(R_residuals = allocMatrix(REALSXP,ncur_rows,cols));
-    /*  PROTECT(R_SE = allocVector(REALSXP,ncur_rows+cols)); */
-
-    R_weights = R_NilValue;
-    R_SE = R_NilValue;
-
-    beta = NUMERIC_POINTER(R_beta);
-    residuals = NUMERIC_POINTER(R_residuals);
-    /*  weights = NUMERIC_POINTER(R_weights);
-        se = NUMERIC_POINTER(R_SE);
-    */
-
-    SET_VECTOR_ELT(R_return_value_cur,0,R_beta);
-    SET_VECTOR_ELT(R_return_value_cur,1,R_weights);
-    SET_VECTOR_ELT(R_return_value_cur,2,R_residuals);
-    SET_VECTOR_ELT(R_return_value_cur,3,R_SE);
-    UNPROTECT(2);
-
-    PROTECT(R_return_value_names= allocVector(STRSXP,4));
-    SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-    SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
-    SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
-    SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
-    setAttrib(R_return_value_cur, R_NamesSymbol,R_return_value_names);
-    UNPROTECT(1);
-
-    SET_VECTOR_ELT(*(args->R_return_value),j,R_return_value_cur); 
-    UNPROTECT(1);
-    pthread_mutex_unlock(&mutex_R);
+      if (args->compact == NULL){
+        beta = args->output[j].beta;
+        residuals = args->output[j].residuals;
+      } else {
+        beta = scratch;
+        residuals = &scratch[2*(args->largest_group + cols)];
+      }
 
+      for (k = 0; k < cols; k++){
+          for (i =0; i < ncur_rows; i++){
+       	    residuals[k*ncur_rows + i] = args->matrix[k*args->rows + cur_rows[i]];  
+          }
+      } 
 
+      memset(beta, 0, (ncur_rows+cols)*sizeof(double));
 
+      iter = median_polish_fit_control(residuals, ncur_rows, cols, &beta[cols], &beta[0], &intercept,
+				       args->maxiter, args->eps, args->check_convergence);
+      if (args->output[j].iterations != NULL)
+        args->output[j].iterations[0] = iter;
 
-    for (k = 0; k < cols; k++){
-        for (i =0; i < ncur_rows; i++){
-     	    residuals[k*ncur_rows + i] = args->matrix[k*args->rows + cur_rows[i]];  
-        }
-    } 
+      for (i=0; i < cols; i++)
+          beta[i]+=intercept;
 
-    memset(beta, 0, (ncur_rows+cols)*sizeof(double));
-
-    median_polish_fit_no_copy(residuals, ncur_rows, cols, &beta[cols], &beta[0], &intercept);
-
-    for (i=0; i < cols; i++)
-        beta[i]+=intercept;
-
-  }  
+      if (args->compact != NULL)
+        sub_rcModel_compact_store(args->compact, args->groups, j, cols, beta, NULL, residuals);
+    }
+  }
+  if (scratch != NULL)
+    R_Free(scratch);
   return NULL;
 }
 #endif
@@ -156,7 +461,7 @@ static void *sub_rcModelSummarize_medianpolish_group(void *data){
 
 
 
-SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
+static SEXP sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList, int maxiter, double eps, int check_convergence, int report_iterations, int want_compact, int want_probe_effects, int want_residuals){
 
   SEXP R_return_value;  
   SEXP dim1;
@@ -167,14 +472,18 @@ SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
+  struct sub_rcModel_output *output;
+  struct sub_rcModel_compact compact;
+
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -192,99 +501,84 @@ SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
 #endif
 #else
 
-  SEXP R_return_value_cur;
-
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  
-  SEXP R_return_value_names;
-
   double *beta;
   double *residuals;
-  double *weights;
-  double *se;
 
   double intercept;
 
-  int k;
+  double *scratch = NULL;
+  int largest;
+
+  int k, iter;
 #endif
 
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
-  PROTECT(R_return_value = allocVector(VECSXP,length_rowIndexList));
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
+  if (want_compact){
+    PROTECT(R_return_value = allocVector(VECSXP,7));
+    output = sub_rcModel_compact_alloc(R_return_value, groups, cols, 0, want_probe_effects, want_residuals, &compact);
+  } else {
+    PROTECT(R_return_value = allocVector(VECSXP,length_rowIndexList));
+    output = sub_rcModel_output_alloc(R_return_value, groups, cols, (report_iterations ? SUB_RCMODEL_MEDIANPOLISH_ITERATIONS : SUB_RCMODEL_MEDIANPOLISH));
+  }
   
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBRCMODEL_BLOCK, 1);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
-  args[0].R_return_value = &R_return_value;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].output = output;
+  args[0].compact = (want_compact ? &compact : NULL);
+  args[0].groups = groups;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
-
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].largest_group = largest_group(groups);
+  args[0].maxiter = maxiter;
+  args[0].eps = eps;
+  args[0].check_convergence = check_convergence;
+
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, sub_rcModelSummarize_medianpolish_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         R_Free(output);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -298,38 +592,27 @@ SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else     
 
-  for (j =0; j < length_rowIndexList; j++){    
-
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
-
-    PROTECT(R_return_value_cur = allocVector(VECSXP,4));
-    PROTECT(R_beta = allocVector(REALSXP, ncur_rows + cols));
-    /* PROTECT(R_weights = allocMatrix(REALSXP,ncur_rows,cols));*/
-    PROTECT(R_residuals = allocMatrix(REALSXP,ncur_rows,cols));
-    /*  PROTECT(R_SE = allocVector(REALSXP,ncur_rows+cols)); */
+  largest = largest_group(groups);
+  if (want_compact)
+    scratch = R_Calloc(SUB_RCMODEL_SCRATCH(largest, cols),double);
 
-    R_weights = R_NilValue;
-    R_SE = R_NilValue;
-
-
-    SET_VECTOR_ELT(R_return_value_cur,0,R_beta);
-    SET_VECTOR_ELT(R_return_value_cur,1,R_weights);
-    SET_VECTOR_ELT(R_return_value_cur,2,R_residuals);
-    SET_VECTOR_ELT(R_return_value_cur,3,R_SE);
+  for (j =0; j < length_rowIndexList; j++){    
 
-    UNPROTECT(2);
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
 
-    beta = NUMERIC_POINTER(R_beta);
-    residuals = NUMERIC_POINTER(R_residuals);
-    /*  weights = NUMERIC_POINTER(R_weights);
-        se = NUMERIC_POINTER(R_SE);
-    */
+    if (!want_compact){
+      beta = output[j].beta;
+      residuals = output[j].residuals;
+    } else {
+      beta = scratch;
+      residuals = &scratch[2*(largest + cols)];
+    }
 
     for (k = 0; k < cols; k++){
         for (i =0; i < ncur_rows; i++){
@@ -339,27 +622,70 @@ SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
 
     memset(beta, 0, (ncur_rows+cols)*sizeof(double));
 
-    median_polish_fit_no_copy(residuals, ncur_rows, cols, &beta[cols], &beta[0], &intercept);
+    iter = median_polish_fit_control(residuals, ncur_rows, cols, &beta[cols], &beta[0], &intercept, maxiter, eps, check_convergence);
+    if (output[j].iterations != NULL)
+      output[j].iterations[0] = iter;
 
     for (i=0; i < cols; i++)
         beta[i]+=intercept;
 
-    PROTECT(R_return_value_names= allocVector(STRSXP,4));
-    SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-    SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
-    SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
-    SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
-    setAttrib(R_return_value_cur, R_NamesSymbol,R_return_value_names);
-    UNPROTECT(2);
-    SET_VECTOR_ELT(R_return_value,j,R_return_value_cur);
+    if (want_compact)
+      sub_rcModel_compact_store(&compact, groups, j, cols, beta, NULL, residuals);
   }
+  if (scratch != NULL)
+    R_Free(scratch);
 #endif
+  R_Free(output);
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_return_value;
 }
 
 
 
+SEXP R_sub_rcModelSummarize_medianpolish(SEXP RMatrix, SEXP R_rowIndexList){
+
+  return sub_rcModelSummarize_medianpolish(RMatrix, R_rowIndexList, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1, 0, 0, 0, 0);
+}
+
+
+/*********************************************************************
+ **
+ ** SEXP R_sub_rcModelSummarize_medianpolish_control(SEXP RMatrix, SEXP R_rowIndexList, 
+ **          SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence)
+ **
+ ** as R_sub_rcModelSummarize_medianpolish but with the convergence settings
+ ** given. Each probeset's list also has the number of iterations used
+ ** (Iterations).
+ **
+ *********************************************************************/
+
+SEXP R_sub_rcModelSummarize_medianpolish_control(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence){
+
+  return sub_rcModelSummarize_medianpolish(RMatrix, R_rowIndexList, asInteger(R_maxiter), asReal(R_eps), asLogical(R_check_convergence), 1, 0, 0, 0);
+}
+
+
+/*********************************************************************
+ **
+ ** SEXP R_sub_rcModelSummarize_medianpolish_compact(SEXP RMatrix, SEXP R_rowIndexList, 
+ **          SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence,
+ **          SEXP R_probe_effects, SEXP R_residuals)
+ **
+ ** as R_sub_rcModelSummarize_medianpolish_control but returns a single list
+ ** (see sub_rcModel_compact_alloc), with the probe effects and
+ ** residuals only if R_probe_effects and R_residuals are TRUE
+ **
+ *********************************************************************/
+
+SEXP R_sub_rcModelSummarize_medianpolish_compact(SEXP RMatrix, SEXP R_rowIndexList, SEXP R_maxiter, SEXP R_eps, SEXP R_check_convergence, SEXP R_probe_effects, SEXP R_residuals){
+
+  return sub_rcModelSummarize_medianpolish(RMatrix, R_rowIndexList, asInteger(R_maxiter), asReal(R_eps), asLogical(R_check_convergence), 1, 1, asLogical(R_probe_effects), asLogical(R_residuals));
+}
+
+
+
 
 
 
@@ -376,18 +702,9 @@ static void *sub_rcModelSummarize_plm_group(void *data){
   int *cur_rows;
   double *buffer, *buffer2;
   int i, j, k;
+  int start_row, end_row;
   int ncur_rows;
 
-  
-  SEXP R_return_value_cur;
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  SEXP R_scale;
-
-  SEXP R_return_value_names;
-
   double *Ymat;
 
   double *beta;
@@ -401,73 +718,64 @@ static void *sub_rcModelSummarize_plm_group(void *data){
   double residSE;
 
   int cols = args->cols;
+  double *work = R_Calloc(SUB_RCMODEL_PLM_WORK(args->largest_group, cols),double);
+  double *fit_work, *se_work;
+  double *scratch = NULL;
+
+  if (args->compact != NULL)
+    scratch = R_Calloc(SUB_RCMODEL_SCRATCH(args->largest_group, cols),double);
  
-  for (j = args->start_row; j <= args->end_row;  j++){    
-    ncur_rows = LENGTH(VECTOR_ELT(*(args->R_rowIndexList),j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(*(args->R_rowIndexList),j));
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      ncur_rows = args->groups->offsets[j+1] - args->groups->offsets[j];
+      cur_rows = &(args->groups->rows[args->groups->offsets[j]]);
   
-    pthread_mutex_lock(&mutex_R);
-    PROTECT(R_return_value_cur = allocVector(VECSXP,5));
-    PROTECT(R_beta = allocVector(REALSXP, ncur_rows + cols));
-    PROTECT(R_weights = allocMatrix(REALSXP,ncur_rows,cols));
-    PROTECT(R_residuals = allocMatrix(REALSXP,ncur_rows,cols));
-    PROTECT(R_SE = allocVector(REALSXP,ncur_rows+cols)); 
-    PROTECT(R_scale = allocVector(REALSXP,1));
-  
-    beta = NUMERIC_POINTER(R_beta);
-    residuals = NUMERIC_POINTER(R_residuals);
-    weights = NUMERIC_POINTER(R_weights);
-    se = NUMERIC_POINTER(R_SE);
-    scaleptr = NUMERIC_POINTER(R_scale);
-
-    SET_VECTOR_ELT(R_return_value_cur,0,R_beta);
-    SET_VECTOR_ELT(R_return_value_cur,1,R_weights);
-    SET_VECTOR_ELT(R_return_value_cur,2,R_residuals);
-    SET_VECTOR_ELT(R_return_value_cur,3,R_SE);
-    SET_VECTOR_ELT(R_return_value_cur,4,R_scale);
-    UNPROTECT(5); 
-   
-    PROTECT(R_return_value_names= allocVector(STRSXP,5));
-    SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-    SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
-    SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
-    SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
-    SET_STRING_ELT(R_return_value_names,4,mkChar("Scale"));
-    setAttrib(R_return_value_cur, R_NamesSymbol,R_return_value_names);
-    UNPROTECT(1);
- 
-    SET_VECTOR_ELT(*(args->R_return_value),j,R_return_value_cur);
-    UNPROTECT(1);
-    pthread_mutex_unlock(&mutex_R);	
+      if (args->compact == NULL){
+        beta = args->output[j].beta;
+        residuals = args->output[j].residuals;
+        weights = args->output[j].weights;
+        se = args->output[j].se;
+      } else {
+        beta = scratch;
+        se = &beta[args->largest_group + cols];
+        residuals = &se[args->largest_group + cols];
+        weights = &residuals[(size_t)args->largest_group*cols];
+      }
+      scaleptr = args->output[j].scale;
   
-    if (isNull(*args->Scales)){
-      scaleptr[0] = -1.0;
-    } else if (length(*args->Scales) != cols) {
-      scaleptr[0] = NUMERIC_POINTER(*args->Scales)[0];
-    }
+      if (isNull(*args->Scales)){
+        scaleptr[0] = -1.0;
+      } else if (length(*args->Scales) != cols) {
+        scaleptr[0] = NUMERIC_POINTER(*args->Scales)[0];
+      }
 
 
-    Ymat = R_Calloc(ncur_rows*cols,double);
-    
+      Ymat = work;
+      fit_work = Ymat + (size_t)ncur_rows*cols;
+      se_work = fit_work + RLM_FIT_ANOVA_WORK(ncur_rows, cols);
     
-    for (k = 0; k < cols; k++){
-        for (i =0; i < ncur_rows; i++){
-     	    Ymat[k*ncur_rows + i] = args->matrix[k*args->rows + cur_rows[i]];  
-        }
-    } 
+      for (k = 0; k < cols; k++){
+          for (i =0; i < ncur_rows; i++){
+       	    Ymat[k*ncur_rows + i] = args->matrix[k*args->rows + cur_rows[i]];  
+          }
+      } 
 
-    rlm_fit_anova_scale(Ymat, ncur_rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(*args->PsiCode)),asReal(*args->PsiK), 20, 0);
+      rlm_fit_anova_scale_ws(Ymat, ncur_rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(*args->PsiCode)),asReal(*args->PsiK), 20, 0, fit_work);
   
-    rlm_compute_se_anova(Ymat, ncur_rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(*args->PsiCode)),asReal(*args->PsiK));
+      rlm_compute_se_anova_ws(Ymat, ncur_rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(*args->PsiCode)),asReal(*args->PsiK), se_work);
 
-    beta[ncur_rows+cols -1] = 0.0;
+      beta[ncur_rows+cols -1] = 0.0;
 
-    for (i = cols; i < ncur_rows + cols -1; i++)
-       beta[ncur_rows+cols -1]-=beta[i];
+      for (i = cols; i < ncur_rows + cols -1; i++)
+         beta[ncur_rows+cols -1]-=beta[i];
 
-    R_Free(Ymat);
-     
+      if (args->compact != NULL)
+        sub_rcModel_compact_store(args->compact, args->groups, j, cols, beta, se, residuals);
+    }
   }
+  R_Free(work);
+  if (scratch != NULL)
+    R_Free(scratch);
   return NULL;
 }
 #endif
@@ -476,25 +784,29 @@ static void *sub_rcModelSummarize_plm_group(void *data){
 
 
 
-SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Scales){
+static SEXP sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Scales, int want_compact, int want_probe_effects, int want_residuals){
 
   SEXP R_return_value;  
   SEXP dim1;
 
+  struct sub_rcModel_output *output;
+  struct sub_rcModel_compact compact;
+
   double *matrix=NUMERIC_POINTER(RMatrix);
   double *results, *buffer, *buffer2;
   
   int *cur_rows;
 
   int rows, cols;
-  int length_rowIndexList = LENGTH(R_rowIndexList);
+  int length_rowIndexList;
+  struct probe_group_index *groups;
+  int temporary_groups;
   int ncur_rows;
 
   int i,j;
 #ifdef USE_PTHREADS
-  int t, returnCode, chunk_size, num_threads = 1;
-  double chunk_size_d, chunk_tot_d;
-  char *nthreads;
+  int t, returnCode, num_threads = 1;
+  struct probe_group_schedule schedule;
   pthread_attr_t attr;
   /* Initialize thread attribute */
   pthread_attr_init(&attr);
@@ -512,16 +824,6 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
 #endif
 #else
 
-  SEXP R_return_value_cur;
-
-  SEXP R_weights;
-  SEXP R_residuals;
-  SEXP R_beta;
-  SEXP R_SE;
-  SEXP R_scale;
-
-  SEXP R_return_value_names;
-
   double *Ymat;
 
   double *beta;
@@ -534,86 +836,80 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
 
   double residSE;
 
+  double *work, *fit_work, *se_work;
+  double *scratch = NULL;
+  int largest;
+
   int k;
 #endif
 
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+  length_rowIndexList = groups->ngroups;
+
   PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
   rows = INTEGER(dim1)[0];
   cols = INTEGER(dim1)[1];
   UNPROTECT(1);
 
-  PROTECT(R_return_value = allocVector(VECSXP,length_rowIndexList));
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
+  if (want_compact){
+    PROTECT(R_return_value = allocVector(VECSXP,7));
+    output = sub_rcModel_compact_alloc(R_return_value, groups, cols, 1, want_probe_effects, want_residuals, &compact);
+  } else {
+    PROTECT(R_return_value = allocVector(VECSXP,length_rowIndexList));
+    output = sub_rcModel_output_alloc(R_return_value, groups, cols, SUB_RCMODEL_PLM);
+  }
   
 #ifdef  USE_PTHREADS
-  nthreads = getenv(THREADS_ENV_VAR);
-  if(nthreads != NULL){
-    num_threads = atoi(nthreads);
-    if(num_threads <= 0){
-      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
-    }
-  }
   threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
 
   /* Set thread detached attribute */
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   pthread_attr_setstacksize (&attr, stacksize);
   
-  /* this code works out how many threads to use and allocates ranges of subColumns to each thread */
-  /* The aim is to try to be as fair as possible in dividing up the matrix */
-  /* A special cases to be aware of: 
-     1) Number of subColumns is less than the number of threads
-  */
-  
-  if (num_threads < length_rowIndexList){
-    chunk_size = length_rowIndexList/num_threads;
-    chunk_size_d = ((double) length_rowIndexList)/((double) num_threads);
-  } else {
-    chunk_size = 1;
-    chunk_size_d = 1;
-  }
-
-  if(chunk_size == 0){
-    chunk_size = 1;
-  }
-  args = (struct loop_data *) R_Calloc((length_rowIndexList < num_threads ? length_rowIndexList : num_threads), struct loop_data);
+  /* probesets are handed out to the threads a block at a time, the most expensive blocks first (see probe_group_index.c) */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBRCMODEL_BLOCK, 2);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
 
   args[0].matrix = matrix;
-  args[0].R_return_value = &R_return_value;
-  args[0].R_rowIndexList = &R_rowIndexList;
+  args[0].output = output;
+  args[0].compact = (want_compact ? &compact : NULL);
+  args[0].groups = groups;
   args[0].PsiCode = &PsiCode;
   args[0].PsiK = &PsiK;
   args[0].Scales = &Scales;
   args[0].rows = rows;  
   args[0].cols = cols;
   args[0].length_rowIndexList = length_rowIndexList;
+  args[0].largest_group = largest_group(groups);
 
-  pthread_mutex_init(&mutex_R, NULL);
-
-  t = 0; /* t = number of actual threads doing work */
-  chunk_tot_d = 0;
-  for (i=0; floor(chunk_tot_d+0.00001) < length_rowIndexList; i+=chunk_size){
-     if(t != 0){
-       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
-     }
-
-     args[t].start_row = i;     
-     /* take care of distribution of the remainder (when #chips%#threads != 0) */
-     chunk_tot_d += chunk_size_d;
-     // Add 0.00001 in case there was a rounding issue with the division
-     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
-       args[t].end_row = i+chunk_size;
-       i++;
-     }
-     else{
-       args[t].end_row = i+chunk_size-1;
-     }
-     t++;
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
   }
 
   
   for (i =0; i < t; i++){
      returnCode = pthread_create(&threads[i], &attr, sub_rcModelSummarize_plm_group, (void *) &(args[i]));
      if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         R_Free(output);
+         if (temporary_groups)
+           probe_group_index_free(groups);
          error("ERROR; return code from pthread_create() is %d\n", returnCode);
      }
   }
@@ -627,38 +923,33 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
   }
 
   pthread_attr_destroy(&attr);  
-  pthread_mutex_destroy(&mutex_R);
+  probe_group_schedule_free(&schedule);
   R_Free(threads);
   R_Free(args);  
 #else     
 
-  for (j =0; j < length_rowIndexList; j++){    
-
-    ncur_rows = LENGTH(VECTOR_ELT(R_rowIndexList,j)); 
-    cur_rows = INTEGER_POINTER(VECTOR_ELT(R_rowIndexList,j));
-
-    PROTECT(R_return_value_cur = allocVector(VECSXP,5));
-    PROTECT(R_beta = allocVector(REALSXP, ncur_rows + cols));
-    PROTECT(R_weights = allocMatrix(REALSXP,ncur_rows,cols));
-    PROTECT(R_residuals = allocMatrix(REALSXP,ncur_rows,cols));
-    PROTECT(R_SE = allocVector(REALSXP,ncur_rows+cols)); 
-    PROTECT(R_scale = allocVector(REALSXP,1));
-
-    SET_VECTOR_ELT(R_return_value_cur,0,R_beta);
-    SET_VECTOR_ELT(R_return_value_cur,1,R_weights);
-    SET_VECTOR_ELT(R_return_value_cur,2,R_residuals);
-    SET_VECTOR_ELT(R_return_value_cur,3,R_SE);
-    SET_VECTOR_ELT(R_return_value_cur,4,R_scale);
-
-    UNPROTECT(5);
+  largest = largest_group(groups);
+  work = R_Calloc(SUB_RCMODEL_PLM_WORK(largest, cols),double);
+  if (want_compact)
+    scratch = R_Calloc(SUB_RCMODEL_SCRATCH(largest, cols),double);
 
-    beta = NUMERIC_POINTER(R_beta);
-    residuals = NUMERIC_POINTER(R_residuals);
-    weights = NUMERIC_POINTER(R_weights);
-    se = NUMERIC_POINTER(R_SE);
-    
+  for (j =0; j < length_rowIndexList; j++){    
 
-   scaleptr = NUMERIC_POINTER(R_scale);
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    cur_rows = &(groups->rows[groups->offsets[j]]);
+
+    if (!want_compact){
+      beta = output[j].beta;
+      residuals = output[j].residuals;
+      weights = output[j].weights;
+      se = output[j].se;
+    } else {
+      beta = scratch;
+      se = &beta[largest + cols];
+      residuals = &se[largest + cols];
+      weights = &residuals[(size_t)largest*cols];
+    }
+    scaleptr = output[j].scale;
 
 
     if (isNull(Scales)){
@@ -668,8 +959,9 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
     }
 
 
-    Ymat = R_Calloc(ncur_rows*cols,double);
-    
+    Ymat = work;
+    fit_work = Ymat + (size_t)ncur_rows*cols;
+    se_work = fit_work + RLM_FIT_ANOVA_WORK(ncur_rows, cols);
     
     for (k = 0; k < cols; k++){
         for (i =0; i < ncur_rows; i++){
@@ -677,9 +969,9 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
         }
     } 
 
-    rlm_fit_anova_scale(Ymat, ncur_rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0);
+    rlm_fit_anova_scale_ws(Ymat, ncur_rows, cols, scaleptr, beta, residuals, weights, PsiFunc(asInteger(PsiCode)),asReal(PsiK), 20, 0, fit_work);
   
-    rlm_compute_se_anova(Ymat, ncur_rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(PsiCode)),asReal(PsiK));
+    rlm_compute_se_anova_ws(Ymat, ncur_rows, cols, beta, residuals, weights,se, (double *)NULL, &residSE, 4, PsiFunc(asInteger(PsiCode)),asReal(PsiK), se_work);
 
 
   
@@ -690,24 +982,500 @@ SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode,
      for (i = cols; i < ncur_rows + cols -1; i++)
         beta[ncur_rows+cols -1]-=beta[i];
 
-     R_Free(Ymat);
-     PROTECT(R_return_value_names= allocVector(STRSXP,5));
-     SET_STRING_ELT(R_return_value_names,0,mkChar("Estimates"));
-     SET_STRING_ELT(R_return_value_names,1,mkChar("Weights"));
-     SET_STRING_ELT(R_return_value_names,2,mkChar("Residuals"));
-     SET_STRING_ELT(R_return_value_names,3,mkChar("StdErrors"));
-     SET_STRING_ELT(R_return_value_names,4,mkChar("Scale"));
-     setAttrib(R_return_value_cur, R_NamesSymbol,R_return_value_names);
-     UNPROTECT(2);
-     SET_VECTOR_ELT(R_return_value,j,R_return_value_cur);
+     if (want_compact)
+       sub_rcModel_compact_store(&compact, groups, j, cols, beta, se, residuals);
+  }
+  R_Free(work);
+  if (scratch != NULL)
+    R_Free(scratch);
+#endif
+  R_Free(output);
+  if (temporary_groups)
+    probe_group_index_free(groups);
+  UNPROTECT(1);
+  return R_return_value;
+}
+
+
+
+SEXP R_sub_rcModelSummarize_plm(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Scales){
+
+  return sub_rcModelSummarize_plm(RMatrix, R_rowIndexList, PsiCode, PsiK, Scales, 0, 0, 0);
+}
+
+
+/*********************************************************************
+ **
+ ** SEXP R_sub_rcModelSummarize_plm_compact(SEXP RMatrix, SEXP R_rowIndexList, 
+ **          SEXP PsiCode, SEXP PsiK, SEXP Scales,
+ **          SEXP R_probe_effects, SEXP R_residuals)
+ **
+ ** as R_sub_rcModelSummarize_plm but returns a single list
+ ** (see sub_rcModel_compact_alloc), with the probe effects and
+ ** residuals only if R_probe_effects and R_residuals are TRUE
+ **
+ *********************************************************************/
+
+SEXP R_sub_rcModelSummarize_plm_compact(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Scales, SEXP R_probe_effects, SEXP R_residuals){
+
+  return sub_rcModelSummarize_plm(RMatrix, R_rowIndexList, PsiCode, PsiK, Scales, 1, asLogical(R_probe_effects), asLogical(R_residuals));
+}
+
+
+
+
+
+
+
+
+
+
+/* workspace for one PLM-r fit and its standard errors, the probeset data and weights first */
+#define SUB_RCMODEL_PLMR_WORK(y_rows, y_cols) (2*(size_t)(y_rows)*(y_cols) + PLMR_FIT_WORK(y_rows, y_cols) + RLM_COMPUTE_SE_ANOVA_WORK(y_rows, y_cols, 2))
+
+
+/*********************************************************************
+ **
+ ** static void sub_rcModel_plmr_fit(double *matrix, double *w, int rows, int cols,
+ **          struct probe_group_index *groups, int j, int robust, 
+ **          pt2psi PsiFn, double psi_k, struct sub_rcModel_output *output, double *work)
+ **
+ ** fits the PLM-r model (robust = 0), PLM-rr (robust = 1) or PLM-rc (robust = 2)
+ ** to probeset j of matrix, with the prior weights w (same dimensions as matrix)
+ ** unless w is NULL. work should have SUB_RCMODEL_PLMR_WORK() space for the
+ ** probeset. The same as R_plmr_model() and friends for a single probeset.
+ **
+ *********************************************************************/
+
+static void sub_rcModel_plmr_fit(double *matrix, double *w, int rows, int cols, struct probe_group_index *groups, int j, int robust, pt2psi PsiFn, double psi_k, struct sub_rcModel_output *output, double *work){
+
+  int i, k;
+  int ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+  int *cur_rows = &(groups->rows[groups->offsets[j]]);
+
+  double *beta = output->beta;
+  double *se = output->se;
+  double residSE;
+
+  double *Ymat = work;
+  double *Wmat = Ymat + (size_t)ncur_rows*cols;
+  double *fit_work = Wmat + (size_t)ncur_rows*cols;
+  double *se_work = fit_work + PLMR_FIT_WORK(ncur_rows, cols);
+
+  for (k = 0; k < cols; k++){
+    for (i =0; i < ncur_rows; i++){
+      Ymat[k*ncur_rows + i] = matrix[(size_t)k*rows + cur_rows[i]];
+    }
+  }
+
+  if (w == NULL){
+    if (robust == 1){
+      plmrr_fit_ws(Ymat, ncur_rows, cols, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    } else if (robust == 2){
+      plmrc_fit_ws(Ymat, ncur_rows, cols, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    } else {
+      plmr_fit_ws(Ymat, ncur_rows, cols, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    }
+  } else {
+    for (k = 0; k < cols; k++){
+      for (i =0; i < ncur_rows; i++){
+        Wmat[k*ncur_rows + i] = w[(size_t)k*rows + cur_rows[i]];
+      }
+    }
+    if (robust == 1){
+      plmrr_wfit_ws(Ymat, ncur_rows, cols, Wmat, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    } else if (robust == 2){
+      plmrc_wfit_ws(Ymat, ncur_rows, cols, Wmat, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    } else {
+      plmr_wfit_ws(Ymat, ncur_rows, cols, Wmat, beta, output->residuals, output->weights, PsiFn, psi_k, 20, 0, fit_work);
+    }
+  }
+
+  /* Note use 2 rather than 4  for SE method */
+  rlm_compute_se_anova_ws(Ymat, ncur_rows, cols, beta, output->residuals, output->weights, se, (double *)NULL, &residSE, 2, PsiFn, psi_k, se_work);
+
+  beta[ncur_rows+cols -1] = 0.0;
+  se[ncur_rows+cols -1] = 0.0;
+
+  for (i = cols; i < ncur_rows + cols -1; i++)
+    beta[ncur_rows+cols -1]-=beta[i];
+}
+
+
+/*********************************************************************
+ **
+ ** static void sub_rcModel_plmd_fit(double *matrix, int rows, int cols,
+ **          struct probe_group_index *groups, int j, int ngroups, int *grouplabels,
+ **          pt2psi PsiFn, double psi_k, struct sub_rcModel_output *output, double *work)
+ **
+ ** fits the PLM-d model to probeset j of matrix. output->beta and output->se
+ ** need space for cols + ngroups*(rows in probeset) values, of which the first 
+ ** rows + cols + (ngroups-1)*(number of probes split) are used. work should
+ ** have space for the probeset data. The same as R_plmd_model() for a single
+ ** probeset.
+ **
+ *********************************************************************/
+
+static void sub_rcModel_plmd_fit(double *matrix, int rows, int cols, struct probe_group_index *groups, int j, int ngroups, int *grouplabels, pt2psi PsiFn, double psi_k, struct sub_rcModel_output *output, double *work){
+
+  int i, k;
+  int ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+  int *cur_rows = &(groups->rows[groups->offsets[j]]);
+  int howmany_split = 0;
+  int nbeta;
+
+  double *beta = output->beta;
+  double *se = output->se;
+  double residSE;
+
+  double *Ymat = work;
+  double *X;
+  int X_rows, X_cols;
+
+  for (k = 0; k < cols; k++){
+    for (i =0; i < ncur_rows; i++){
+      Ymat[k*ncur_rows + i] = matrix[(size_t)k*rows + cur_rows[i]];
+    }
+  }
+
+  plmd_fit(Ymat, ncur_rows, cols, ngroups, grouplabels, output->was_split, beta, output->residuals, output->weights, PsiFn, psi_k, 20);
+
+  for (i = 0; i < ncur_rows; i++){
+    howmany_split+=output->was_split[i];
+  }
+
+  if (howmany_split > 0){
+    X = plmd_get_design_matrix(ncur_rows, cols, ngroups, grouplabels, output->was_split, &X_rows, &X_cols);
+    rlm_compute_se(X, Ymat, X_rows, X_cols, beta, output->residuals, output->weights, se, (double *)NULL, &residSE, 2, PsiFn, psi_k);
+    R_Free(X);
+  } else {
+    /* Note use 2 rather than 4  for SE method */
+    rlm_compute_se_anova(Ymat, ncur_rows, cols, beta, output->residuals, output->weights, se, (double *)NULL, &residSE, 2, PsiFn, psi_k);
+  }
+
+  nbeta = ncur_rows + cols + howmany_split*(ngroups-1);
+  beta[nbeta -1] = 0.0;
+  se[nbeta -1] = 0.0;
+
+  for (i = cols; i < nbeta -1; i++)
+    beta[nbeta -1]-=beta[i];
+}
+
+
+
+#ifdef  USE_PTHREADS
+static void *sub_rcModelSummarize_plmr_group(void *data){
+
+  struct loop_data *args = (struct loop_data *) data;
+  int j, start_row, end_row;
+  double *work = R_Calloc(SUB_RCMODEL_PLMR_WORK(args->largest_group, args->cols),double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      sub_rcModel_plmr_fit(args->matrix, args->weights, args->rows, args->cols, args->groups, j, args->robust, args->PsiFn, args->psi_k, &(args->output[j]), work);
+    }
+  }
+  R_Free(work);
+  return NULL;
+}
+
+
+static void *sub_rcModelSummarize_plmd_group(void *data){
+
+  struct loop_data *args = (struct loop_data *) data;
+  int j, start_row, end_row;
+  double *work = R_Calloc((size_t)args->largest_group*args->cols,double);
+
+  while (probe_group_schedule_next(args->schedule, args->length_rowIndexList, &start_row, &end_row)){
+    for (j = start_row; j <= end_row;  j++){
+      sub_rcModel_plmd_fit(args->matrix, args->rows, args->cols, args->groups, j, args->ngroups, args->grouplabels, args->PsiFn, args->psi_k, &(args->output[j]), work);
+    }
+  }
+  R_Free(work);
+  return NULL;
+}
+#endif
+
+
+
+/*********************************************************************
+ **
+ ** static int sub_rcModel_run(double *matrix, int rows, int cols, 
+ **          struct probe_group_index *groups, struct sub_rcModel_output *output,
+ **          int plmd, double *weights, int robust, int ngroups, int *grouplabels,
+ **          pt2psi PsiFn, double psi_k, int num_threads)
+ **
+ ** fits the PLM-r (plmd = 0) or PLM-d (plmd = 1) model to every probeset, 
+ ** on num_threads threads when built with pthreads. Returns 0, or the 
+ ** pthread_create() error code if a thread could not be started (the
+ ** caller still owns output and groups, so frees them before reporting it)
+ **
+ *********************************************************************/
+
+static int sub_rcModel_run(double *matrix, int rows, int cols, struct probe_group_index *groups, struct sub_rcModel_output *output, int plmd, double *weights, int robust, int ngroups, int *grouplabels, pt2psi PsiFn, double psi_k, int num_threads){
+
+  int i;
+#ifdef USE_PTHREADS
+  int t, returnCode;
+  struct probe_group_schedule schedule;
+  pthread_attr_t attr;
+  /* Initialize thread attribute */
+  pthread_attr_init(&attr);
+  pthread_t *threads;
+  struct loop_data *args;
+  void *status; 
+#ifdef PTHREAD_STACK_MIN
+#ifdef INFER_MIN_STACKSIZE
+  size_t stacksize = __pthread_get_minstack(&attr) + sysconf(_SC_PAGE_SIZE);
+#else
+  size_t stacksize = PTHREAD_STACK_MIN + sysconf(_SC_PAGE_SIZE);
+#endif
+#else
+  size_t stacksize = 0x8000;
+#endif
+
+  threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
+
+  /* Set thread detached attribute */
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setstacksize (&attr, stacksize);
+
+  /* PLM-d refits a probeset once for every probe it splits, so it is costed as for the PLM */
+  probe_group_schedule_init(&schedule, groups, num_threads, SUBRCMODEL_BLOCK, 2);
+  t = (num_threads < schedule.nblocks ? num_threads : schedule.nblocks); /* t = number of actual threads doing work */
+  args = (struct loop_data *) R_Calloc((t > 0 ? t : 1), struct loop_data);
+
+  args[0].matrix = matrix;
+  args[0].output = output;
+  args[0].compact = NULL;
+  args[0].groups = groups;
+  args[0].rows = rows;  
+  args[0].cols = cols;
+  args[0].length_rowIndexList = groups->ngroups;
+  args[0].largest_group = largest_group(groups);
+  args[0].weights = weights;
+  args[0].robust = robust;
+  args[0].ngroups = ngroups;
+  args[0].grouplabels = grouplabels;
+  args[0].PsiFn = PsiFn;
+  args[0].psi_k = psi_k;
+
+  args[0].schedule = &schedule;
+  for (i = 1; i < t; i++){
+    memcpy(&(args[i]), &(args[0]), sizeof(struct loop_data));
+  }
+
+  for (i =0; i < t; i++){
+     returnCode = pthread_create(&threads[i], &attr, (plmd ? sub_rcModelSummarize_plmd_group : sub_rcModelSummarize_plmr_group), (void *) &(args[i]));
+     if (returnCode){
+         while (i-- > 0)
+           pthread_join(threads[i], &status);
+         pthread_attr_destroy(&attr);
+         probe_group_schedule_free(&schedule);
+         R_Free(threads);
+         R_Free(args);
+         return returnCode;
+     }
   }
+  /* Wait for the other threads */
+  for(i = 0; i < t; i++){
+      returnCode = pthread_join(threads[i], &status);
+      if (returnCode){
+         error("ERROR; return code from pthread_join(thread #%d) is %d, exit status for thread was %d\n", 
+               i, returnCode, *((int *) status));
+      }
+  }
+
+  pthread_attr_destroy(&attr);  
+  probe_group_schedule_free(&schedule);
+  R_Free(threads);
+  R_Free(args);  
+#else
+  int largest = largest_group(groups);
+  double *work;
+
+  if (plmd){
+    work = R_Calloc((size_t)largest*cols,double);
+    for (i = 0; i < groups->ngroups; i++){
+      sub_rcModel_plmd_fit(matrix, rows, cols, groups, i, ngroups, grouplabels, PsiFn, psi_k, &output[i], work);
+    }
+  } else {
+    work = R_Calloc(SUB_RCMODEL_PLMR_WORK(largest, cols),double);
+    for (i = 0; i < groups->ngroups; i++){
+      sub_rcModel_plmr_fit(matrix, weights, rows, cols, groups, i, robust, PsiFn, psi_k, &output[i], work);
+    }
+  }
+  R_Free(work);
+#endif
+  return 0;
+}
+
+
+
+/*********************************************************************
+ **
+ ** SEXP R_sub_rcModelSummarize_plmr(SEXP RMatrix, SEXP R_rowIndexList, 
+ **          SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Robust)
+ **
+ ** SEXP RMatrix - a matrix with probes in rows and arrays in columns
+ ** SEXP R_rowIndexList - the rows of each probeset, a list or a ProbeGroupIndex
+ ** SEXP PsiCode, PsiK - the psi function and its parameter
+ ** SEXP Weights - prior weights, the same size as RMatrix, or R_NilValue
+ ** SEXP Robust - 0 for PLM-r, 1 for PLM-rr (robust to rows only)
+ **               2 for PLM-rc (robust to columns only)
+ **
+ ** Returns a list with, for each probeset, what R_plmr_model() (or the
+ ** variant asked for) would return for it
+ **
+ *********************************************************************/
+
+SEXP R_sub_rcModelSummarize_plmr(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Weights, SEXP Robust){
+
+  SEXP R_return_value;  
+  SEXP dim1;
+
+  struct sub_rcModel_output *output;
+  struct probe_group_index *groups;
+  int temporary_groups;
+  int rows, cols;
+  int returnCode, num_threads = 1;
+
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
 #endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
+
+  PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
+  rows = INTEGER(dim1)[0];
+  cols = INTEGER(dim1)[1];
+  UNPROTECT(1);
+
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
+  PROTECT(R_return_value = allocVector(VECSXP,groups->ngroups));
+  output = sub_rcModel_output_alloc(R_return_value, groups, cols, SUB_RCMODEL_PLMR);
+
+  returnCode = sub_rcModel_run(NUMERIC_POINTER(RMatrix), rows, cols, groups, output, 0,
+		  (isNull(Weights) ? (double *)NULL : NUMERIC_POINTER(Weights)), asInteger(Robust), 0, (int *)NULL,
+		  PsiFunc(asInteger(PsiCode)), asReal(PsiK), num_threads);
+  if (returnCode){
+    R_Free(output);
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("ERROR; return code from pthread_create() is %d\n", returnCode);
+  }
+
+  R_Free(output);
+  if (temporary_groups)
+    probe_group_index_free(groups);
   UNPROTECT(1);
   return R_return_value;
 }
 
 
 
+/*********************************************************************
+ **
+ ** SEXP R_sub_rcModelSummarize_plmd(SEXP RMatrix, SEXP R_rowIndexList, 
+ **          SEXP PsiCode, SEXP PsiK, SEXP Groups, SEXP Ngroups)
+ **
+ ** SEXP RMatrix - a matrix with probes in rows and arrays in columns
+ ** SEXP R_rowIndexList - the rows of each probeset, a list or a ProbeGroupIndex
+ ** SEXP PsiCode, PsiK - the psi function and its parameter
+ ** SEXP Groups - the group (0, ..., Ngroups -1) of each array
+ ** SEXP Ngroups - the number of groups of arrays
+ **
+ ** Returns a list with, for each probeset, what R_plmd_model() would 
+ ** return for it
+ **
+ *********************************************************************/
+
+SEXP R_sub_rcModelSummarize_plmd(SEXP RMatrix, SEXP R_rowIndexList, SEXP PsiCode, SEXP PsiK, SEXP Groups, SEXP Ngroups){
+
+  SEXP R_return_value;  
+  SEXP R_beta;
+  SEXP R_SE;
+  SEXP dim1;
 
+  struct sub_rcModel_output *output;
+  struct probe_group_index *groups;
+  int temporary_groups;
+  int rows, cols;
+  int returnCode, num_threads = 1;
+  int ngroups = INTEGER(Ngroups)[0];
+
+  double *beta, *se;
+  size_t offset;
+  int i, j, ncur_rows, nbeta;
 
+#ifdef USE_PTHREADS
+  num_threads = probe_group_num_threads();
+#endif
+  groups = probe_group_index_get(R_rowIndexList, &temporary_groups);
 
+  PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
+  rows = INTEGER(dim1)[0];
+  cols = INTEGER(dim1)[1];
+  UNPROTECT(1);
+
+  if (groups->nrows > rows){
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("probe groups refer to row %d but the matrix has only %d rows", groups->nrows, rows);
+  }
+
+  PROTECT(R_return_value = allocVector(VECSXP,groups->ngroups));
+  output = sub_rcModel_output_alloc(R_return_value, groups, cols, SUB_RCMODEL_PLMD);
+
+  /* 
+     the estimates and standard errors are only copied into R vectors once
+     it is known how many probes of each probeset were split. Until then
+     probeset j has room for the most parameters it could need, 
+     cols + ngroups*(rows of probeset j)
+  */
+  beta = R_Calloc((size_t)groups->ngroups*cols + (size_t)ngroups*groups->offsets[groups->ngroups] + 1, double);
+  se = R_Calloc((size_t)groups->ngroups*cols + (size_t)ngroups*groups->offsets[groups->ngroups] + 1, double);
+  for (j = 0; j < groups->ngroups; j++){
+    offset = (size_t)j*cols + (size_t)ngroups*groups->offsets[j];
+    output[j].beta = &beta[offset];
+    output[j].se = &se[offset];
+  }
+
+  returnCode = sub_rcModel_run(NUMERIC_POINTER(RMatrix), rows, cols, groups, output, 1,
+		  (double *)NULL, 0, ngroups, INTEGER_POINTER(Groups),
+		  PsiFunc(asInteger(PsiCode)), asReal(PsiK), num_threads);
+  if (returnCode){
+    R_Free(output);
+    R_Free(beta);
+    R_Free(se);
+    if (temporary_groups)
+      probe_group_index_free(groups);
+    error("ERROR; return code from pthread_create() is %d\n", returnCode);
+  }
+
+  for (j = 0; j < groups->ngroups; j++){
+    ncur_rows = groups->offsets[j+1] - groups->offsets[j];
+    nbeta = ncur_rows + cols;
+    for (i = 0; i < ncur_rows; i++){
+      nbeta+= (ngroups-1)*output[j].was_split[i];
+    }
+    R_beta = allocVector(REALSXP,nbeta);
+    SET_VECTOR_ELT(VECTOR_ELT(R_return_value,j),0,R_beta);
+    memcpy(NUMERIC_POINTER(R_beta), output[j].beta, nbeta*sizeof(double));
+    R_SE = allocVector(REALSXP,nbeta);
+    SET_VECTOR_ELT(VECTOR_ELT(R_return_value,j),3,R_SE);
+    memcpy(NUMERIC_POINTER(R_SE), output[j].se, nbeta*sizeof(double));
+  }
+
+  R_Free(beta);
+  R_Free(se);
+  R_Free(output);
+  if (temporary_groups)
+    probe_group_index_free(groups);
+  UNPROTECT(1);
+  return R_return_value;
+}
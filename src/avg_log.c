@@ -33,6 +33,7 @@
  ** May 26, 2007 - fix memory leak in average_log. add additional interfaces
  ** Sep 16, 2007 - fix error in how StdError is computed
  ** Sep 2014 - Change to size_t rather than int for variables indexing pointers. Improve code documentation.
+ ** Oct 18, 2026 - use the shared log2 transform (log2_transform(), log2_gather()) in rma_common.c
  **
  **
  ************************************************************************/
@@ -47,6 +48,7 @@
 #include <math.h>
 #include <stddef.h>
 
+#include "rma_common.h"
 #include "avg_log.h"
 
 
@@ -140,12 +142,10 @@ static double AvgLogSE(double *x, double mean, size_t length){
  */
 
 void averagelog_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
-  int i,j;
+  int j;
 
   for (j = 0; j < cols; j++){
-    for (i =0; i < rows; i++){
-      data[j*rows + i] = log(data[j*rows + i])/log(2.0);  
-    }
+    log2_transform_in_place(&data[j*rows], rows);
     results[j] = AvgLog(&data[j*rows],rows);
     resultsSE[j] = AvgLogSE(&data[j*rows],results[j],rows);
   } 
@@ -187,13 +187,11 @@ void averagelog_no_copy(double *data, size_t rows, size_t cols, double *results,
  */
 
 void averagelog(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
-  int i,j;
+  int j;
   double *z = R_Calloc(rows,double);
 
   for (j = 0; j < cols; j++){
-    for (i =0; i < rows; i++){
-      z[i] = log(data[j*rows + i])/log(2.0);  
-    }
+    log2_transform(&data[j*rows], z, rows);
     results[j] = AvgLog(z,rows);
     resultsSE[j] = AvgLogSE(z,results[j],rows);
   } 
@@ -237,14 +235,10 @@ void averagelog(double *data, size_t rows, size_t cols, double *results, double
  */
 
 void AverageLog(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
-  int i,j;
+  int j;
   double *z = R_Calloc(nprobes*cols,double);
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-  } 
+  log2_gather(data, rows, cols, cur_rows, nprobes, z);
   
   for (j=0; j < cols; j++){
     results[j] = AvgLog(&z[j*nprobes],nprobes);
@@ -288,14 +282,10 @@ void AverageLog(double *data, size_t rows, size_t cols, int *cur_rows, double *r
  */
 
 void AverageLog_noSE(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes){
-  int i,j;
+  int j;
   double *z = R_Calloc(nprobes*cols,double);
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-  } 
+  log2_gather(data, rows, cols, cur_rows, nprobes, z);
   
   for (j=0; j < cols; j++){
     results[j] = AvgLog(&z[j*nprobes],nprobes);
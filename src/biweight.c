@@ -38,6 +38,11 @@
  ** Sep 16, 2007 - fix bug in tukeybiweight
  ** Sep 19, 2007 - add TukeyBiweight_noSE
  ** Sep, 2014 - Change to size_t where appropriate. Improve code documentation
+ ** Oct 18, 2026 - median and MAD found by selection (median_nocopy) rather than fully sorting
+ ** Oct 18, 2026 - log2 transform columns with log2_transform()/log2_gather()
+ ** Oct 18, 2026 - add Tukey_Biweight_buffer(), the column summaries give it (and
+ **                Tukey_Biweight_SE) their own scratch rather than it allocating
+ **                one on each call
  **
  ************************************************************************/
 
@@ -79,12 +84,15 @@ static double weight_bisquare(double x){
 /****************************************************************************
  **
  ** double Tukey_Biweight(double *x, size_t length)
+ ** double Tukey_Biweight_buffer(double *x, size_t length, double *buffer)
  **
  ** implements one step Tukey's Biweight as documented in the Affymetrix 
  ** Statistical Algorithms Description Document. 
  **
  ** double *x - vector of data
  ** size_t length - length of *x
+ ** double *buffer - scratch space of length doubles, supplied by the caller
+ **                  (Tukey_Biweight() allocates it only for long vectors)
  **
  ****************************************************************************/
 
@@ -96,14 +104,14 @@ static double weight_bisquare(double x){
  *
  * @param x  vector of data
  * @param length length of vector of data
+ * @param buffer scratch space of length doubles
  *
  */
 
-double Tukey_Biweight(double *x, size_t length){
+double Tukey_Biweight_buffer(double *x, size_t length, double *buffer){
   
   double median;
   size_t i;
-  double *buffer = (double *)R_Calloc(length,double);
   double c = 5.0;
   double epsilon = 0.0001;
   double S;
@@ -114,25 +122,13 @@ double Tukey_Biweight(double *x, size_t length){
     buffer[i] = x[i];
   }
 
-  qsort(buffer,length,sizeof(double),(int(*)(const void*, const void*))sort_double);
-
-  if (length%2 == 0){
-    median = (buffer[length/2 -1] + buffer[length/2])/2.0;
-  } else {
-    median = buffer[length/2];
-  }
+  median = median_nocopy(buffer,length);
 
   for (i=0; i < length; i++){
     buffer[i] = fabs(x[i] - median);
   }
 
-  qsort(buffer,length,sizeof(double),(int(*)(const void*, const void*))sort_double);
-
-  if (length%2 == 0){
-    S = (buffer[length/2 -1] + buffer[length/2])/2.0;
-  } else {
-    S = buffer[length/2];
-  }
+  S = median_nocopy(buffer,length);
   
 
 
@@ -144,29 +140,48 @@ double Tukey_Biweight(double *x, size_t length){
     sum+= weight_bisquare(buffer[i])*x[i];
     sumw += weight_bisquare(buffer[i]);
   }
-  R_Free(buffer);
   return(sum/sumw);
 }
 
 
+/* probesets up to this size are handled on the stack by Tukey_Biweight() */
+#define TUKEY_BIWEIGHT_STACK 64
+
+double Tukey_Biweight(double *x, size_t length){
+
+  double small[TUKEY_BIWEIGHT_STACK];
+  double *buffer = small;
+  double result;
+
+  if (length > TUKEY_BIWEIGHT_STACK)
+    buffer = (double *)R_Calloc(length,double);
+
+  result = Tukey_Biweight_buffer(x, length, buffer);
+
+  if (buffer != small)
+    R_Free(buffer);
+  return result;
+}
+
+
 
 /****************************************************************************
  **
- ** double Tukey_Biweight_SE(double *x, double BW, size_t length)
+ ** double Tukey_Biweight_SE(double *x, double BW, size_t length, double *buffer)
  **
  ** implements one step Tukey's Biweight SE as documented in the Affymetrix 
  ** Statistical Algorithms Description Document. 
  **
  ** double *x - vector of data
  ** size_t length - length of *x
+ ** double *buffer - scratch space of length doubles
  **
  ****************************************************************************/
 
-static double Tukey_Biweight_SE(double *x,double BW, size_t length){
+static double Tukey_Biweight_SE(double *x,double BW, size_t length, double *buffer){
   
   double median;
   size_t i;
-  double *buffer = (double *)R_Calloc(length,double);
   double c = 5.0;
   double epsilon = 0.0001;
   double S;
@@ -177,25 +192,13 @@ static double Tukey_Biweight_SE(double *x,double BW, size_t length){
     buffer[i] = x[i];
   }
 
-  qsort(buffer,length,sizeof(double),(int(*)(const void*, const void*))sort_double);
-
-  if (length%2 == 0){
-    median = (buffer[length/2 -1] + buffer[length/2])/2.0;
-  } else {
-    median = buffer[length/2];
-  }
+  median = median_nocopy(buffer,length);
 
   for (i=0; i < length; i++){
     buffer[i] = fabs(x[i] - median);
   }
 
-  qsort(buffer,length,sizeof(double),(int(*)(const void*, const void*))sort_double);
-
-  if (length%2 == 0){
-    S = (buffer[length/2 -1] + buffer[length/2])/2.0;
-  } else {
-    S = buffer[length/2];
-  }
+  S = median_nocopy(buffer,length);
   
 
 
@@ -209,7 +212,6 @@ static double Tukey_Biweight_SE(double *x,double BW, size_t length){
       sumw += (1.0-buffer[i]*buffer[i])*(1.0 - 5.0*buffer[i]*buffer[i]);
     }
   }
-  R_Free(buffer);
   return(sqrt(sum)/fabs(sumw));
 }
 
@@ -232,15 +234,14 @@ static double Tukey_Biweight_SE(double *x,double BW, size_t length){
 
 void tukeybiweight(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
 
-  size_t i,j;
-  double *z = R_Calloc(rows,double);
+  size_t j;
+  double *z = R_Calloc(2*rows,double);
+  double *buffer = &z[rows];
 
   for (j = 0; j < cols; j++){
-    for (i =0; i < rows; i++){
-      z[i] = log(data[j*rows + i])/log(2.0);  
-    }
-    results[j] = Tukey_Biweight(z,rows);
-    resultsSE[j] = Tukey_Biweight_SE(z,results[j],rows);
+    log2_transform(&data[j*rows], z, rows);
+    results[j] = Tukey_Biweight_buffer(z,rows,buffer);
+    resultsSE[j] = Tukey_Biweight_SE(z,results[j],rows,buffer);
   }
   R_Free(z);
 
@@ -269,14 +270,15 @@ void tukeybiweight(double *data, size_t rows, size_t cols, double *results, doub
 void tukeybiweight_no_log(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
 
   size_t i,j;
-  double *z = R_Calloc(rows,double);
+  double *z = R_Calloc(2*rows,double);
+  double *buffer = &z[rows];
 
   for (j = 0; j < cols; j++){
     for (i =0; i < rows; i++){
       z[i] = data[j*rows + i];  
     }
-    results[j] = Tukey_Biweight(z,rows);
-    resultsSE[j] = Tukey_Biweight_SE(z,results[j],rows);
+    results[j] = Tukey_Biweight_buffer(z,rows,buffer);
+    resultsSE[j] = Tukey_Biweight_SE(z,results[j],rows,buffer);
   }
   R_Free(z);
 }
@@ -319,15 +321,14 @@ void tukeybiweight_no_log(double *data, size_t rows, size_t cols, double *result
 
 void TukeyBiweight(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
 
-  size_t i,j;
-  double *z = R_Calloc(nprobes,double);
+  size_t j;
+  double *z = R_Calloc(2*nprobes,double);
+  double *buffer = &z[nprobes];
 
   for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-    results[j] = Tukey_Biweight(z,nprobes);
-    resultsSE[j] = Tukey_Biweight_SE(z,results[j],nprobes);
+    log2_gather(&data[j*rows], rows, 1, cur_rows, nprobes, z);
+    results[j] = Tukey_Biweight_buffer(z,nprobes,buffer);
+    resultsSE[j] = Tukey_Biweight_SE(z,results[j],nprobes,buffer);
   }
   R_Free(z);
 }
@@ -352,14 +353,13 @@ void TukeyBiweight(double *data, size_t rows, size_t cols, int *cur_rows, double
 
 void TukeyBiweight_noSE(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes){
 
-  size_t i,j;
-  double *z = R_Calloc(nprobes,double);
+  size_t j;
+  double *z = R_Calloc(2*nprobes,double);
+  double *buffer = &z[nprobes];
 
   for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-    results[j] = Tukey_Biweight(z,nprobes);
+    log2_gather(&data[j*rows], rows, 1, cur_rows, nprobes, z);
+    results[j] = Tukey_Biweight_buffer(z,nprobes,buffer);
   }
   R_Free(z);
 }
@@ -384,13 +384,14 @@ void TukeyBiweight_noSE(double *data, size_t rows, size_t cols, int *cur_rows, d
 void TukeyBiweight_no_log_noSE(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes){
 
   size_t i,j;
-  double *z = R_Calloc(nprobes,double);
+  double *z = R_Calloc(2*nprobes,double);
+  double *buffer = &z[nprobes];
 
   for (j = 0; j < cols; j++){
     for (i =0; i < nprobes; i++){
       z[i] = data[j*rows + cur_rows[i]];  
     }
-    results[j] = Tukey_Biweight(z,nprobes);
+    results[j] = Tukey_Biweight_buffer(z,nprobes,buffer);
   }
   R_Free(z);
 }
@@ -8,5 +8,6 @@ void TukeyBiweight_noSE(double *data, size_t rows, size_t cols, int *cur_rows, d
 void TukeyBiweight_no_log_noSE(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes);
 
 double Tukey_Biweight(double *x, size_t length);
+double Tukey_Biweight_buffer(double *x, size_t length, double *buffer);
 
 #endif
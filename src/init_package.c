@@ -41,6 +41,8 @@
 #include "rma_background4.h"
 
 #include "weightedkerneldensity.h"
+#include "probe_group_index.h"
+#include "log2_matrix_cache.h"
 
 
 #include <R_ext/Rdynload.h>
@@ -65,6 +67,8 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_qnorm_using_target_via_subset",(DL_FUNC)&R_qnorm_using_target_via_subset,4},
   {"R_rlm_rma_default_model",(DL_FUNC)&R_rlm_rma_default_model,4},
   {"R_wrlm_rma_default_model", (DL_FUNC)&R_wrlm_rma_default_model,5},
+  {"R_rlm_rma_default_model_output",(DL_FUNC)&R_rlm_rma_default_model_output,6},
+  {"R_wrlm_rma_default_model_output", (DL_FUNC)&R_wrlm_rma_default_model_output,6},
   {"R_medianpolish_rma_default_model", (DL_FUNC)&R_medianpolish_rma_default_model,1},
   {"R_colSummarize_avg_log", (DL_FUNC)&R_colSummarize_avg_log,1},  
   {"R_colSummarize_log_avg", (DL_FUNC)&R_colSummarize_log_avg,1},
@@ -76,6 +80,7 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_colSummarize_median",(DL_FUNC)&R_colSummarize_median,1},
   {"R_colSummarize_biweight", (DL_FUNC)&R_colSummarize_biweight,1},
   {"R_colSummarize_medianpolish",(DL_FUNC)&R_colSummarize_medianpolish,1},
+  {"R_colSummarize_medianpolish_control",(DL_FUNC)&R_colSummarize_medianpolish_control,5},
   {"R_subColSummarize_avg_log", (DL_FUNC)&R_subColSummarize_avg_log,2},  
   {"R_subColSummarize_log_avg", (DL_FUNC)&R_subColSummarize_log_avg,2},
   {"R_subColSummarize_avg", (DL_FUNC)&R_subColSummarize_avg,2},
@@ -86,6 +91,8 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_subColSummarize_median",(DL_FUNC)&R_subColSummarize_median,2},
   {"R_subColSummarize_medianpolish_log",(DL_FUNC)&R_subColSummarize_medianpolish_log,2},
   {"R_subColSummarize_medianpolish",(DL_FUNC)&R_subColSummarize_medianpolish,2},
+  {"R_subColSummarize_medianpolish_control",(DL_FUNC)&R_subColSummarize_medianpolish_control,6},
+  {"R_subColSummarize_multi",(DL_FUNC)&R_subColSummarize_multi,3},
   {"R_plmr_model",(DL_FUNC)&R_plmr_model,3},
   {"R_wplmr_model", (DL_FUNC)&R_wplmr_model,4},
   {"R_plmrr_model",(DL_FUNC)&R_plmrr_model,3},
@@ -95,6 +102,8 @@ static const R_CallMethodDef callMethods[]  = {
   {"R_rlm_rma_given_probe_effects", (DL_FUNC)&R_rlm_rma_given_probe_effects,5},
   {"R_wrlm_rma_given_probe_effects", (DL_FUNC)&R_wrlm_rma_given_probe_effects,6},
   {"R_rma_bg_correct",(DL_FUNC)&R_rma_bg_correct,2},
+  {"R_probe_group_index",(DL_FUNC)&R_probe_group_index,3},
+  {"R_log2_matrix_cache",(DL_FUNC)&R_log2_matrix_cache,1},
   {NULL, NULL, 0}
   };
 
@@ -120,6 +129,10 @@ void R_init_preprocessCore(DllInfo *info){
   R_RegisterCCallable("preprocessCore", "median_polish", (DL_FUNC)&median_polish);
   R_RegisterCCallable("preprocessCore", "MedianPolish", (DL_FUNC)&MedianPolish);
   R_RegisterCCallable("preprocessCore", "MedianPolish_no_log", (DL_FUNC)&MedianPolish_no_log);
+  R_RegisterCCallable("preprocessCore", "median_polish_fit_control", (DL_FUNC)&median_polish_fit_control);
+  R_RegisterCCallable("preprocessCore", "median_polish_no_copy_control", (DL_FUNC)&median_polish_no_copy_control);
+  R_RegisterCCallable("preprocessCore", "median_polish_control", (DL_FUNC)&median_polish_control);
+  R_RegisterCCallable("preprocessCore", "MedianPolish_control", (DL_FUNC)&MedianPolish_control);
 
 
   R_RegisterCCallable("preprocessCore","AverageLog", (DL_FUNC)&AverageLog);
@@ -171,6 +184,7 @@ void R_init_preprocessCore(DllInfo *info){
   
   /* The PLM functions */
   R_RegisterCCallable("preprocessCore","rlm_fit_anova", (DL_FUNC)&rlm_fit_anova);
+  R_RegisterCCallable("preprocessCore","rlm_fit_anova_control", (DL_FUNC)&rlm_fit_anova_control);
   R_RegisterCCallable("preprocessCore","rlm_wfit_anova", (DL_FUNC)&rlm_wfit_anova);
   R_RegisterCCallable("preprocessCore","rlm_compute_se_anova", (DL_FUNC)&rlm_compute_se_anova);
    
@@ -209,7 +223,9 @@ void R_init_preprocessCore(DllInfo *info){
   R_RegisterCCallable("preprocessCore","R_subColSummarize_median",(DL_FUNC)&R_subColSummarize_median);
   R_RegisterCCallable("preprocessCore","R_subColSummarize_medianpolish_log",(DL_FUNC)&R_subColSummarize_medianpolish_log);
   R_RegisterCCallable("preprocessCore","R_subColSummarize_medianpolish",(DL_FUNC)&R_subColSummarize_medianpolish);
+  R_RegisterCCallable("preprocessCore","R_subColSummarize_multi",(DL_FUNC)&R_subColSummarize_multi);
   
   /* KernelDensity */
   R_RegisterCCallable("preprocessCore","KernelDensity",  (DL_FUNC)&KernelDensity);
+  R_RegisterCCallable("preprocessCore","KernelDensity_matrix",  (DL_FUNC)&KernelDensity_matrix);
 }
@@ -26,6 +26,7 @@
  ** Sep 14, 2003 - fix a bug where k was where a j should be in a for loop
  ** Mar 1, 2006 - change all comments to ansi style
  ** May 19, 2007 - branch out of affyPLM into a new package preprocessCore, then restructure the code. Add doxygen style documentation
+ ** Oct 18, 2026 - add lm_wfit_ws, which takes its scratch space from the caller
  **
  ********************************************************************/
 
@@ -58,6 +59,30 @@
  *************************************************************************/
 
 void lm_wfit(double *x, double *y, double *w, int rows, int cols, double tol, double *out_beta, double *out_resids){
+
+  double *work = R_Calloc(LM_WFIT_WORK(rows, cols),double);
+  int *jpvt = R_Calloc(cols,int);
+
+  lm_wfit_ws(x, y, w, rows, cols, tol, out_beta, out_resids, work, jpvt);
+
+  R_Free(work);
+  R_Free(jpvt);
+}
+
+
+/*************************************************************************
+ **
+ ** void lm_wfit_ws(double *x, double *y, double *w, int rows, int cols, double tol, double *outbeta, double *outresid,
+ **                 double *ws, int *jpvt)
+ ** 
+ ** as lm_wfit() but with the scratch space supplied by the caller
+ **
+ ** double *ws - workspace of length LM_WFIT_WORK(rows, cols)
+ ** int *jpvt - workspace of length cols
+ **
+ *************************************************************************/
+
+void lm_wfit_ws(double *x, double *y, double *w, int rows, int cols, double tol, double *out_beta, double *out_resids, double *ws, int *jpvt){
   int i,j;
   int ny = 1;
   int k;
@@ -65,16 +90,14 @@ void lm_wfit(double *x, double *y, double *w, int rows, int cols, double tol, do
   
   double fittedvalue;
 
-  double *wts = R_Calloc(rows,double);
-  double *x_wts_f = R_Calloc(rows*cols,double);
-  double *y_wts_f = R_Calloc(rows,double);
-  double *beta = R_Calloc(cols,double);
-  double *resid = R_Calloc(rows,double);
-  double *qraux = R_Calloc(cols,double);
-  double *qty = R_Calloc(rows,double);
-  double *work = R_Calloc(2*cols,double);
-  
-  int *jpvt = R_Calloc(cols,int);
+  double *wts = ws;
+  double *x_wts_f = &wts[rows];
+  double *y_wts_f = &x_wts_f[(size_t)rows*cols];
+  double *beta = &y_wts_f[rows];
+  double *resid = &beta[cols];
+  double *qraux = &resid[rows];
+  double *qty = &qraux[cols];
+  double *work = &qty[rows];
 
   for (i=0; i < rows; i++){
     if (w[i] == 0.0){
@@ -198,16 +221,6 @@ void lm_wfit(double *x, double *y, double *w, int rows, int cols, double tol, do
       /* resid[i] = resid[i]/wts[i]; */
     }
   }
-  
-  R_Free(wts); 
-  R_Free(x_wts_f); 
-  R_Free(y_wts_f);
-  R_Free(beta);
-  R_Free(resid);
-  R_Free(qraux);
-  R_Free(qty);
-  R_Free(work);
-  R_Free(jpvt );
 }
 
 
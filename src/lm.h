@@ -5,5 +5,10 @@
 
 void lm_wfit(double *x, double *y, double *w, int rows, int cols, double tol, double *out_beta, double *out_resids);
 
+/* length of the double workspace needed by lm_wfit_ws() (it also needs cols ints) */
+#define LM_WFIT_WORK(rows, cols) ((size_t)(rows)*((cols) + 4) + 4*(size_t)(cols))
+
+void lm_wfit_ws(double *x, double *y, double *w, int rows, int cols, double tol, double *out_beta, double *out_resids, double *ws, int *jpvt);
+
 
 #endif
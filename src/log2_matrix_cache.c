@@ -0,0 +1,191 @@
+/*********************************************************************
+ **
+ ** file: log2_matrix_cache.c
+ **
+ ** Aim: hold log2 of an intensity matrix so that several *_log
+ ** summarizations of the same data do not each redo the transformation.
+ **
+ ** created on: Oct 18, 2026
+ **
+ ** History
+ ** Oct 18, 2026 - Initial version
+ ** Oct 18, 2026 - the fingerprint covers every value, not a sample
+ **
+ ** The cache is an R external pointer (class "Log2MatrixCache"). Its
+ ** protected value is list(source matrix, log2 of source matrix) and
+ ** its address is a fingerprint of the source taken when the cache was
+ ** made (length, data pointer and a hash of all of the values). The
+ ** hash is one pass over memory, which is still a small fraction of the
+ ** cost of the log2 transformation it saves.
+ **
+ ** Since the cache references the source, R will duplicate the source
+ ** rather than modify it if the user assigns into their copy. The
+ ** fingerprint is there to catch C code that changes the matrix in
+ ** place (eg normalize.quantiles(copy=FALSE)), in which case the cache
+ ** is refused rather than silently giving stale values.
+ **
+ ** The subColSummarize functions accept a cache in place of the matrix.
+ ** The log scale summaries read the log2 matrix, the others the source.
+ **
+ *********************************************************************/
+
+#include <R.h>
+#include <Rdefines.h>
+#include <Rinternals.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "rma_common.h"
+#include "log2_matrix_cache.h"
+
+struct log2_matrix_cache{
+  const double *data;
+  R_xlen_t length;
+  uint64_t fingerprint;
+};
+
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t log2_matrix_cache_fingerprint(const double *x, R_xlen_t length){
+
+  /* 
+     FNV-1a over the bits of every value. Four interleaved hashes are
+     kept, so the multiplies do not have to wait on one another, and 
+     folded together at the end
+  */
+  uint64_t h0 = FNV_OFFSET, h1 = FNV_OFFSET ^ 1, h2 = FNV_OFFSET ^ 2, h3 = FNV_OFFSET ^ 3;
+  uint64_t b0, b1, b2, b3;
+  R_xlen_t i;
+
+  for (i = 0; i + 4 <= length; i+=4){
+    memcpy(&b0, &x[i], sizeof(double));
+    memcpy(&b1, &x[i+1], sizeof(double));
+    memcpy(&b2, &x[i+2], sizeof(double));
+    memcpy(&b3, &x[i+3], sizeof(double));
+    h0 = (h0 ^ b0)*FNV_PRIME;
+    h1 = (h1 ^ b1)*FNV_PRIME;
+    h2 = (h2 ^ b2)*FNV_PRIME;
+    h3 = (h3 ^ b3)*FNV_PRIME;
+  }
+  for (; i < length; i++){
+    memcpy(&b0, &x[i], sizeof(double));
+    h0 = (h0 ^ b0)*FNV_PRIME;
+  }
+  
+  h0 = (h0 ^ h1)*FNV_PRIME;
+  h0 = (h0 ^ h2)*FNV_PRIME;
+  h0 = (h0 ^ h3)*FNV_PRIME;
+  return (h0 ^ (uint64_t)length)*FNV_PRIME;
+}
+
+
+static void log2_matrix_cache_finalizer(SEXP R_cache){
+
+  struct log2_matrix_cache *cache = (struct log2_matrix_cache *) R_ExternalPtrAddr(R_cache);
+
+  if (cache != NULL){
+    R_Free(cache);
+  }
+  R_ClearExternalPtr(R_cache);
+}
+
+
+
+/*********************************************************************
+ **
+ ** SEXP R_log2_matrix_cache(SEXP RMatrix)
+ **
+ ** SEXP RMatrix - a numeric (double) matrix
+ **
+ ** returns an external pointer (class "Log2MatrixCache") holding 
+ ** RMatrix and log2(RMatrix).
+ **
+ *********************************************************************/
+
+SEXP R_log2_matrix_cache(SEXP RMatrix){
+
+  SEXP R_cache, R_matrices, R_log2, dim1, R_class;
+  struct log2_matrix_cache *cache;
+  int rows, cols;
+
+  if (!isMatrix(RMatrix) || TYPEOF(RMatrix) != REALSXP){
+    error("argument should be a numeric (double) matrix");
+  }
+
+  PROTECT(dim1 = getAttrib(RMatrix,R_DimSymbol));
+  rows = INTEGER(dim1)[0];
+  cols = INTEGER(dim1)[1];
+  UNPROTECT(1);
+
+  PROTECT(R_matrices = allocVector(VECSXP,2));
+  SET_VECTOR_ELT(R_matrices,0,RMatrix);
+  PROTECT(R_log2 = allocMatrix(REALSXP,rows,cols));
+  SET_VECTOR_ELT(R_matrices,1,R_log2);
+  UNPROTECT(1);
+
+  log2_transform(REAL(RMatrix), REAL(R_log2), (size_t)XLENGTH(RMatrix));
+
+  cache = R_Calloc(1, struct log2_matrix_cache);
+  cache->data = REAL(RMatrix);
+  cache->length = XLENGTH(RMatrix);
+  cache->fingerprint = log2_matrix_cache_fingerprint(cache->data, cache->length);
+
+  PROTECT(R_cache = R_MakeExternalPtr(cache, install("Log2MatrixCache"), R_matrices));
+  R_RegisterCFinalizerEx(R_cache, log2_matrix_cache_finalizer, TRUE);
+
+  PROTECT(R_class = mkString("Log2MatrixCache"));
+  setAttrib(R_cache, R_ClassSymbol, R_class);
+
+  UNPROTECT(3);
+  return R_cache;
+}
+
+
+
+/*********************************************************************
+ **
+ ** SEXP log2_matrix_cache_get(SEXP R_cache)
+ **
+ ** checks that R_cache is a Log2MatrixCache whose source matrix has
+ ** not changed since it was made and returns list(source, log2 matrix)
+ **
+ *********************************************************************/
+
+static SEXP log2_matrix_cache_get(SEXP R_cache){
+
+  struct log2_matrix_cache *cache;
+  SEXP R_matrices, R_source;
+
+  if (TYPEOF(R_cache) != EXTPTRSXP || R_ExternalPtrTag(R_cache) != install("Log2MatrixCache")){
+    error("external pointer is not a Log2MatrixCache");
+  }
+  cache = (struct log2_matrix_cache *) R_ExternalPtrAddr(R_cache);
+  if (cache == NULL){
+    error("Log2MatrixCache is no longer valid (it can not be saved and reloaded). Rebuild it with log2MatrixCache()");
+  }
+
+  R_matrices = R_ExternalPtrProtected(R_cache);
+  R_source = VECTOR_ELT(R_matrices,0);
+
+  if (REAL(R_source) != cache->data || XLENGTH(R_source) != cache->length ||
+      log2_matrix_cache_fingerprint(REAL(R_source), XLENGTH(R_source)) != cache->fingerprint){
+    error("the matrix has been modified since the Log2MatrixCache was made. Rebuild it with log2MatrixCache()");
+  }
+
+  return R_matrices;
+}
+
+
+/* the log2 transformed matrix */
+SEXP log2_matrix_cache_log2(SEXP R_cache){
+  return VECTOR_ELT(log2_matrix_cache_get(R_cache),1);
+}
+
+
+/* the original (untransformed) matrix */
+SEXP log2_matrix_cache_source(SEXP R_cache){
+  return VECTOR_ELT(log2_matrix_cache_get(R_cache),0);
+}
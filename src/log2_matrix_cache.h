@@ -0,0 +1,11 @@
+#ifndef LOG2_MATRIX_CACHE_H
+#define LOG2_MATRIX_CACHE_H 1
+
+#include <Rinternals.h>
+
+SEXP R_log2_matrix_cache(SEXP RMatrix);
+
+SEXP log2_matrix_cache_log2(SEXP R_cache);
+SEXP log2_matrix_cache_source(SEXP R_cache);
+
+#endif
@@ -21,6 +21,7 @@
  ** May 19, 2007 - branch out of affyPLM into a new package preprocessCore, then restructure the code. Add doxygen style documentation
  ** Sep 19, 2007 - add LogAverage_noSE
  ** Sep, 2014 - change to size_t where appropriate. Clean up some of the code documentation. Actually implemented a SE computation.
+ ** Oct 18, 2026 - log2() rather than log()/log(2.0)
  ** 
  **
  ************************************************************************/
@@ -63,7 +64,7 @@ static double LogAvg(double *x, size_t length){
   
   mean = sum/(double)length;
   
-  mean = log(mean)/log(2.0);
+  mean = log2(mean);
 
   return (mean);    
 }
@@ -21,6 +21,10 @@
  ** Oct 10, 2003 - PLM version of threestep
  ** Sep 10, 2007 - move functionality out of affyPLM (and into preprocessCore)
  ** Sep 19, 2007 - add LogMedian_noSE
+ ** Oct 18, 2026 - log_median works in place. Every caller already hands it a 
+ **                scratch copy (or data it is allowed to change), so the extra
+ **                copy made by median() is not needed
+ ** Oct 18, 2026 - log2() rather than log()/log(2.0)
  **
  ************************************************************************/
 
@@ -46,7 +50,8 @@
  ** double *x - a vector of PM intensities 
  ** int length - length of *x
  **
- ** take the log2 of the median of PM intensities.
+ ** take the log2 of the median of PM intensities. note x is not order 
+ ** preserved when this function is called.
  **
  ***************************************************************************/
 
@@ -54,8 +59,8 @@ static double log_median(double *x, size_t length){
 
   double med = 0.0;
   
-  med = median(x,length);
-  med = log(med)/log(2.0);
+  med = median_nocopy(x,length);
+  med = log2(med);
 
   return (med);    
 }
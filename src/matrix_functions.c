@@ -15,6 +15,7 @@
  ** Mar 1, 2006 - change commenting style to ansi C style
  ** Aug 28, 2006 - change moduleCdynload to R_moduleCdynload
  ** Sept 26, 2006 - remove R_moduleCdynload. SHould fix windows build problems.
+ ** Oct 18, 2026 - add Choleski_solve
  **
  ********************************************************************/
 
@@ -80,6 +81,7 @@ void Lapack_Init(void)
 
 extern int dpofa_(double *x, int *lda, int *n, int *j);
 extern int dpodi_(double *x, int *lda, int *n, double *d, int *j);
+extern int dposl_(double *x, int *lda, int *n, double *b);
 
 
 /********************************************************************
@@ -91,6 +93,7 @@ extern int dpodi_(double *x, int *lda, int *n, double *d, int *j);
 
 extern int dpotrf_(const char *uplo, const int *n, double* a, const int *lda, int *info);
 extern int dpotri_(const char *uplo, const int *n, double* a, const int *lda, int *info);
+extern int dpotrs_(const char *uplo, const int *n, const int *nrhs, const double *a, const int *lda, double *b, const int *ldb, int *info);
 
 
 /*****************************************************************
@@ -246,6 +249,54 @@ int Choleski_inverse(double *X, double *Xinv, double *work, int n, int upperonly
 }
 
 
+/***********************************************************************
+ **
+ ** int Choleski_solve(double *X, double *b, int n)
+ **
+ ** double *X - a positive definite symmetric matrix, only the upper triangle
+ **             is used. On output the upper triangle holds its Choleski 
+ **             decomposition
+ ** double *b - vector of length n. On output the solution x of X x = b
+ ** int n - dimension of matrix
+ **
+ ** RETURNS integer code, indicating success 0  or error (non zero) 
+ **
+ ** This function solves a positive definite symmetric system using the
+ ** Choleski decomposition, without forming the inverse. The decomposition
+ ** is checked for small diagonal elements in the same way as Choleski_inverse()
+ **
+ **********************************************************************/
+
+int Choleski_solve(double *X, double *b, int n){
+
+  int i, error_code, one = 1;
+  char upper = 'U';
+
+  if (!use_lapack){
+    dpofa_(X,&n,&n,&error_code);
+  } else {
+    dpotrf_(&upper,&n,X,&n,&error_code);
+  }
+  if (error_code)
+    return error_code;
+
+  for (i=0; i < n; i++){ 
+    /* check for a zero or close to zero diagonal element */ 
+    if(fabs(X[i*n+ i]) < 1e-06){
+      return 1;
+    }
+  }
+
+  if (!use_lapack){
+    dposl_(X,&n,&n,b);
+  } else {
+    dpotrs_(&upper,&n,&one,X,&n,b,&n,&error_code);
+  }
+  return error_code;
+
+}
+
+
 
 /***************************************************************
  **
@@ -5,6 +5,7 @@
 void Lapack_Init(void);
 int SVD_inverse(double *X, double *Xinv, int n);
 int Choleski_inverse(double *X, double *Xinv, double *work, int n, int upperonly);
+int Choleski_solve(double *X, double *b, int n);
 
 
 
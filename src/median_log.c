@@ -21,6 +21,7 @@
  ** Oct 10, 2003 - added PLM version
  ** Sept 9, 2007 - branch out of affyPLM into a new package preprocessCore
  ** Sept, 2014 - Documentation clean up. Change to size_t where appropriate
+ ** Oct 18, 2026 - log2 values come from log2_transform()/log2_gather() (rma_common.c)
  **
  ************************************************************************/
 
@@ -96,14 +97,10 @@ static double median_log(double *x, size_t length){
 
 void MedianLog(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
 
-  size_t i,j;
+  size_t j;
   double *z = R_Calloc(nprobes*cols,double);
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-  } 
+  log2_gather(data, rows, cols, cur_rows, nprobes, z);
   
   for (j=0; j < cols; j++){
     results[j] = median_log(&z[j*nprobes],nprobes); 
@@ -148,14 +145,10 @@ void MedianLog(double *data, size_t rows, size_t cols, int *cur_rows, double *re
 
 void MedianLog_noSE(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes){
 
-  size_t i,j;
+  size_t j;
   double *z = R_Calloc(nprobes*cols,double);
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-  } 
+  log2_gather(data, rows, cols, cur_rows, nprobes, z);
   
   for (j=0; j < cols; j++){
     results[j] = median_log(&z[j*nprobes],nprobes);
@@ -185,13 +178,11 @@ void MedianLog_noSE(double *data, size_t rows, size_t cols, int *cur_rows, doubl
 
 void medianlog(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
 
-  size_t i,j;
+  size_t j;
   double *buffer = R_Calloc(rows, double);
   
   for (j=0; j < cols; j++){
-    for (i = 0; i < rows; i++){
-      buffer[i] = log(data[j*rows + i])/log(2.0);
-    }
+    log2_transform(&data[j*rows], buffer, rows);
     results[j] = median_log(buffer,rows); 
     resultsSE[j] = R_NaReal;
   }
@@ -220,12 +211,10 @@ void medianlog(double *data, size_t rows, size_t cols, double *results, double *
 
 void medianlog_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
 
-  size_t i,j;
+  size_t j;
     
   for (j=0; j < cols; j++){
-    for (i = 0; i < rows; i++){
-      data[j*rows + i]= log(data[j*rows + i])/log(2.0);
-    }
+    log2_transform_in_place(&data[j*rows], rows);
     results[j] = median_log(&data[j*rows],rows); 
     resultsSE[j] = R_NaReal;
   }
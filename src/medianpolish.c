@@ -29,6 +29,15 @@
  ** Nov 13, 2006 - make median calls to median_nocopy
  ** May 19, 2007 - branch out of affyPLM into a new package preprocessCore, then restructure the code. Add doxygen style documentation
  ** May 24, 2007 - break median polish functionality down into even smaller component parts.
+ ** Oct 18, 2026 - one median scratch buffer per fit, shared by the row, column and effect medians
+ ** Oct 18, 2026 - log2 transform via log2_transform() and friends
+ ** Oct 18, 2026 - median_polish_fit_no_copy keeps a row major copy of the residuals
+ **                for the row step and fuses the subtractions and convergence sum
+ **                into blocked transposes between the two copies
+ ** Oct 18, 2026 - add *_control versions taking maxiter, eps and whether to check
+ **                convergence at all, and returning the number of iterations
+ ** Oct 18, 2026 - the convergence sum is taken over the row major copy, in the
+ **                order sum_abs() always used, rather than tile by tile
  **
  ************************************************************************/
 
@@ -46,108 +55,164 @@
 #include "rma_common.h"
 
 
-/*******************************************************************************
- **
- ** double sum_abs(double *z, int rows, int cols)
- **
- ** double *z - matrix of doubles
- ** int rows - dimension of matrix
- ** int cols - dimension of matrix
+/********************************************************************************
  **
- ** returns the sum of the absolute values of elements of the matrix *z
+ ** Layout used while polishing
+ **
+ ** The residuals are stored column major (z[j*rows + i]), so the column 
+ ** medians read contiguous memory but the row medians, the row 
+ ** subtraction and the convergence sum each stride through the whole
+ ** matrix. For probesets measured on many arrays that is mostly cache 
+ ** misses. median_polish_fit_no_copy() therefore keeps a second copy of 
+ ** the residuals in row major order (zt[i*cols + j]) for the row step.
+ ** Moving between the two is done in MEDIANPOLISH_BLOCK by 
+ ** MEDIANPOLISH_BLOCK tiles and carries the subtraction along with it:
+ **
+ **   zt (row major) --row medians--> rdelta
+ **   zt - rdelta   --transpose-->   z (column major)
+ **   z             --col medians--> cdelta
+ **   z - cdelta    --transpose-->   zt
+ **   zt            --sum_abs-->     convergence sum
+ **
+ ** so each iteration makes two contiguous median passes, two blocked
+ ** passes and one contiguous sum over the matrix instead of five passes, 
+ ** three of them strided. Summing zt front to back adds the absolute
+ ** residuals in the same order as the old strided sum over z, so the 
+ ** convergence test (and with it the number of iterations) is unchanged.
  **
- ******************************************************************************/
-
-static double sum_abs(double *z, int rows, int cols){
- 
-  int i, j;
-  double sum = 0.0;
-
-  for (i=0; i < rows; i++)
-    for (j=0; j < cols; j++)
-      sum+=fabs(z[j*rows+i]);
+ ********************************************************************************/
 
-  return sum;
-}
+#define MEDIANPOLISH_BLOCK 32
 
 /********************************************************************************
  **
- ** void get_row_median(double *z, double *rdelta, int rows, int cols)
+ ** void get_row_median(double *zt, double *rdelta, int rows, int cols, double *buffer)
  **
- ** double *z - matrix of dimension  rows*cols
+ ** double *zt - matrix of dimension rows*cols stored row major (ie the transpose)
  ** double *rdelta - on output will contain row medians (vector of length rows)
  ** int rows, cols - dimesion of matrix
+ ** double *buffer - scratch space of length at least cols
  **
  ** get the row medians of a matrix 
  **
  ********************************************************************************/
 
-static void get_row_median(double *z, double *rdelta, int rows, int cols){
-  int i,j;
-  double *buffer = (double *)R_Calloc(cols,double);
+static void get_row_median(double *zt, double *rdelta, int rows, int cols, double *buffer){
+  int i;
 
   for (i = 0; i < rows; i++){ 
-    for (j = 0; j < cols; j++){
-      buffer[j] = z[j*rows + i];
-    }
-    rdelta[i] = median_nocopy(buffer,cols);
+    rdelta[i] = median_buffer(&zt[(size_t)i*cols],cols,buffer);
   }
-  
-  R_Free(buffer);
 }
 
 /********************************************************************************
  **
- ** void get_col_median(double *z, double *cdelta, int rows, int cols)
+ ** void get_col_median(double *z, double *cdelta, int rows, int cols, double *buffer)
  **
  ** double *z - matrix of dimension  rows*cols
  ** double *cdelta - on output will contain col medians (vector of length cols)
  ** int rows, cols - dimesion of matrix
+ ** double *buffer - scratch space of length at least rows
  **
  ** get the col medians of a matrix 
  **
  ********************************************************************************/
 
-static void get_col_median(double *z, double *cdelta, int rows, int cols){
+static void get_col_median(double *z, double *cdelta, int rows, int cols, double *buffer){
   
   int i, j;
   
-  double *buffer = (double *)R_Calloc(rows,double);
   for (j = 0; j < cols; j++){
     for (i = 0; i < rows; i++){  
       buffer[i] = z[j*rows + i];
     }
     cdelta[j] = median_nocopy(buffer,rows);
   }
-  
-  R_Free(buffer);
-
 }
 
 /***********************************************************************************
  **
- ** void subtract_by_row(double *z, double *rdelta, int rows, int cols)
+ ** void transpose_subtract_by_row(double *zt, double *z, double *rdelta, int rows, int cols)
  ** 
- ** double *z - matrix of dimension rows by cols
+ ** double *zt - matrix of dimension rows by cols stored row major
+ ** double *z - on output zt minus *rdelta off each row, stored column major
  ** double *rdelta - vector of length rows
  ** int rows, cols dimensions of matrix
  **
- ** subtract the elements of *rdelta off each row of *z
- **
  ***********************************************************************************/
 
-static void subtract_by_row(double *z, double *rdelta, int rows, int cols){
+static void transpose_subtract_by_row(double *zt, double *z, double *rdelta, int rows, int cols){
   
-  int i,j;
+  int i, j, ib, jb, iend, jend;
+
+  for (ib = 0; ib < rows; ib+=MEDIANPOLISH_BLOCK){
+    iend = (ib + MEDIANPOLISH_BLOCK < rows ? ib + MEDIANPOLISH_BLOCK : rows);
+    for (jb = 0; jb < cols; jb+=MEDIANPOLISH_BLOCK){
+      jend = (jb + MEDIANPOLISH_BLOCK < cols ? jb + MEDIANPOLISH_BLOCK : cols);
+      for (j = jb; j < jend; j++){
+	for (i = ib; i < iend; i++){
+	  z[(size_t)j*rows + i] = zt[(size_t)i*cols + j] - rdelta[i];
+	}
+      }
+    }
+  }
+}
 
-  for (i = 0; i < rows; i++){
-    for (j = 0; j < cols; j++){
-      z[j*rows +i]-= rdelta[i];
+
+/***********************************************************************************
+ **
+ ** void transpose_subtract_by_col(double *z, double *zt, double *cdelta, int rows, int cols)
+ ** 
+ ** double *z - matrix of dimension rows by cols stored column major
+ ** double *zt - on output z minus *cdelta off each col, stored row major
+ ** double *cdelta - vector of length cols
+ ** int rows, cols dimensions of matrix
+ **
+ ***********************************************************************************/
+
+static void transpose_subtract_by_col(double *z, double *zt, double *cdelta, int rows, int cols){
+  
+  int i, j, ib, jb, iend, jend;
+
+  for (jb = 0; jb < cols; jb+=MEDIANPOLISH_BLOCK){
+    jend = (jb + MEDIANPOLISH_BLOCK < cols ? jb + MEDIANPOLISH_BLOCK : cols);
+    for (ib = 0; ib < rows; ib+=MEDIANPOLISH_BLOCK){
+      iend = (ib + MEDIANPOLISH_BLOCK < rows ? ib + MEDIANPOLISH_BLOCK : rows);
+      for (i = ib; i < iend; i++){
+	for (j = jb; j < jend; j++){
+	  zt[(size_t)i*cols + j] = z[(size_t)j*rows + i] - cdelta[j];
+	}
+      }
     }
   }
 }
 
 
+/*******************************************************************************
+ **
+ ** double sum_abs(double *zt, size_t length)
+ **
+ ** double *zt - the row major copy of the residuals
+ ** size_t length - rows*cols
+ **
+ ** returns the sum of the absolute values of elements of *zt. Going through
+ ** zt in memory order visits the residuals row by row, as the original 
+ ** sum over the column major matrix did, so the rounding is the same.
+ **
+ ******************************************************************************/
+
+static double sum_abs(double *zt, size_t length){
+ 
+  size_t k;
+  double sum = 0.0;
+
+  for (k = 0; k < length; k++)
+    sum+=fabs(zt[k]);
+
+  return sum;
+}
+
+
 /***********************************************************************************
  **
  ** void subtract_by_col(double *z, double *cdelta, int rows, int cols)
@@ -213,55 +278,103 @@ static void cmod(double *c, double *cdelta, int cols){
 }
 
 
-void median_polish_fit_no_copy(double *data, size_t rows, size_t cols, double *r, double *c, double *t){
+/*************************************************************************************
+ **
+ ** int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t,
+ **                               int maxiter, double eps, int check_convergence)
+ **
+ ** double *data - a data matrix of dimension rows by cols. On output the residuals
+ ** size_t rows, cols - rows and columns dimensions of matrix
+ ** double *r, *c - row and column effects (rows and cols long, should be zero on input)
+ ** double *t - on output the overall effect
+ ** int maxiter - most row and column sweeps to carry out
+ ** double eps - stop once the sum of absolute residuals changes by less than this 
+ **              proportion between iterations
+ ** int check_convergence - if zero the sum of absolute residuals is not computed and
+ **                         exactly maxiter iterations are done
+ **
+ ** fits the median polish model, returns the number of iterations carried out.
+ **
+ *************************************************************************************/
+
+int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t, int maxiter, double eps, int check_convergence){
  
 
-  size_t i,j,iter;
-  int maxiter = 10;
-  double eps=0.01;
+  size_t i,j;
+  int iter, iterations = 0;
   double oldsum = 0.0,newsum = 0.0;
   double delta;
   double *rdelta = R_Calloc(rows,double);
   double *cdelta = R_Calloc(cols,double);
+  double *buffer = R_Calloc((rows > cols ? rows : cols),double);   /* scratch for all the medians */
+  double *zt = R_Calloc(rows*cols,double);                          /* row major copy of the residuals */
 
   double *z = data; /* This is just to keep consistent with other code here. No actual copying of the data is done here */
 
   *t = 0.0;
 
+  /* cdelta is all zero here so this is just the transpose */
+  transpose_subtract_by_col(z,zt,cdelta,rows,cols);
+
   for (iter = 1; iter <= maxiter; iter++){
-    get_row_median(z,rdelta,rows,cols);
-    subtract_by_row(z,rdelta,rows,cols);
+    iterations = iter;
+    get_row_median(zt,rdelta,rows,cols,buffer);
+    transpose_subtract_by_row(zt,z,rdelta,rows,cols);
     rmod(r,rdelta,rows);
-    delta = median(c,cols);
+    delta = median_buffer(c,cols,buffer);
     for (j = 0; j < cols; j++){
       c[j] = c[j] - delta;
     }
     *t = *t + delta;
-    get_col_median(z,cdelta,rows,cols);
-    subtract_by_col(z,cdelta,rows,cols);
+    get_col_median(z,cdelta,rows,cols,buffer);
+    transpose_subtract_by_col(z,zt,cdelta,rows,cols);
+    if (check_convergence)
+      newsum = sum_abs(zt,rows*cols);
     cmod(c,cdelta,cols);
-    delta = median(r,rows);
+    delta = median_buffer(r,rows,buffer);
     for (i =0; i < rows; i ++){
       r[i] = r[i] - delta;
     }
     *t = *t+delta;
-    newsum = sum_abs(z,rows,cols);
-    if (newsum == 0.0 || fabs(1.0 - oldsum/newsum) < eps)
+    if (check_convergence && (newsum == 0.0 || fabs(1.0 - oldsum/newsum) < eps))
       break;
     oldsum = newsum;
   }
+
+  /* the last column step only went into zt, bring z (the residuals returned to the caller) up to date */
+  subtract_by_col(z,cdelta,rows,cols);
   
   R_Free(rdelta);
   R_Free(cdelta);
+  R_Free(buffer);
+  R_Free(zt);
 
+  return iterations;
 }
 
 
+void median_polish_fit_no_copy(double *data, size_t rows, size_t cols, double *r, double *c, double *t){
+  median_polish_fit_control(data, rows, cols, r, c, t, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1);
+}
 
 
-void median_polish_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
+
+
+/*************************************************************************************
+ **
+ ** int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE,
+ **                                   int maxiter, double eps, int check_convergence)
+ **
+ ** as median_polish_no_copy() (*data is overwritten by the residuals) but with the
+ ** convergence settings given (see median_polish_fit_control()). Returns the number
+ ** of iterations carried out.
+ **
+ *************************************************************************************/
+
+int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, int maxiter, double eps, int check_convergence){
 
   size_t j;
+  int iterations;
   
   double *r = R_Calloc(rows,double);
   double *c = R_Calloc(cols,double);
@@ -269,7 +382,7 @@ void median_polish_no_copy(double *data, size_t rows, size_t cols, double *resul
 
   double *z = data;  /* This is just to keep consistent with other code here. No actual copying of the data is done here */
   
-  median_polish_fit_no_copy(z, rows, cols, r, c, &t);
+  iterations = median_polish_fit_control(z, rows, cols, r, c, &t, maxiter, eps, check_convergence);
   
   for (j=0; j < cols; j++){
     results[j] =  t + c[j]; 
@@ -278,19 +391,18 @@ void median_polish_no_copy(double *data, size_t rows, size_t cols, double *resul
   
   R_Free(r);
   R_Free(c);
+  return iterations;
 }
 
 
-void median_polish_log2_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
+void median_polish_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
+  median_polish_no_copy_control(data, rows, cols, results, resultsSE, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1);
+}
 
-  
-  size_t i, j;
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < rows; i++){
-      data[j*rows + i] = log(data[j*rows + i])/log(2.0);  
-    }
-  } 
+void median_polish_log2_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE){
+
+  log2_transform_in_place(data, rows*cols);
 
   median_polish_no_copy(data,rows,cols,results,resultsSE);
 
@@ -299,19 +411,29 @@ void median_polish_log2_no_copy(double *data, size_t rows, size_t cols, double *
 
 void median_polish_log2(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals){
 
-  size_t i, j;
-
-  for (j = 0; j < cols; j++){
-    for (i =0; i < rows; i++){
-      residuals[j*rows + i] = log(data[j*rows + i])/log(2.0);  
-    }
-  } 
+  log2_transform(data, residuals, rows*cols);
   median_polish_no_copy(residuals,rows,cols,results,resultsSE);
 
 }
 
 
 void median_polish(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals){
+  median_polish_control(data, rows, cols, results, resultsSE, residuals, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1);
+}
+
+
+/*************************************************************************************
+ **
+ ** int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, 
+ **                           double *residuals, int maxiter, double eps, int check_convergence)
+ **
+ ** as median_polish() (*data is left untouched, the residuals go in *residuals) but with
+ ** the convergence settings given (see median_polish_fit_control()). Returns the number
+ ** of iterations carried out.
+ **
+ *************************************************************************************/
+
+int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals, int maxiter, double eps, int check_convergence){
 
   size_t i, j;
 
@@ -320,7 +442,7 @@ void median_polish(double *data, size_t rows, size_t cols, double *results, doub
       residuals[j*rows + i] = data[j*rows + i];  
     }
   } 
-  median_polish_no_copy(residuals,rows,cols,results,resultsSE);
+  return median_polish_no_copy_control(residuals,rows,cols,results,resultsSE,maxiter,eps,check_convergence);
 }
 
 
@@ -361,43 +483,47 @@ void median_polish(double *data, size_t rows, size_t cols, double *results, doub
  */
 
 void MedianPolish(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
+  MedianPolish_control(data, rows, cols, cur_rows, results, nprobes, resultsSE, 1, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1);
+}
 
-  size_t i,j;
-
-  double *z = R_Calloc(nprobes*cols,double);
-
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = log(data[j*rows + cur_rows[i]])/log(2.0);  
-    }
-  } 
-  
 
-  median_polish_no_copy(z,nprobes,cols,results,resultsSE);
-  
-  R_Free(z);
 
+void MedianPolish_no_log(double *data, size_t rows,size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
+  MedianPolish_control(data, rows, cols, cur_rows, results, nprobes, resultsSE, 0, MEDIANPOLISH_MAXITER, MEDIANPOLISH_EPS, 1);
 }
 
 
 
-void MedianPolish_no_log(double *data, size_t rows,size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE){
+/*************************************************************************************
+ **
+ ** int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, 
+ **                          double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence)
+ **
+ ** as MedianPolish() (log_transform non zero) or MedianPolish_no_log() (log_transform zero)
+ ** but with the convergence settings given (see median_polish_fit_control()). Returns the
+ ** number of iterations carried out.
+ **
+ *************************************************************************************/
+
+int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence){
 
   size_t i,j;
+  int iterations;
 
   double *z = R_Calloc(nprobes*cols,double);
 
-  for (j = 0; j < cols; j++){
-    for (i =0; i < nprobes; i++){
-      z[j*nprobes + i] = data[j*rows + cur_rows[i]];  
-    }
-  } 
-  
+  if (log_transform){
+    log2_gather(data, rows, cols, cur_rows, nprobes, z);
+  } else {
+    for (j = 0; j < cols; j++){
+      for (i =0; i < nprobes; i++){
+	z[j*nprobes + i] = data[j*rows + cur_rows[i]];  
+      }
+    } 
+  }
 
-  median_polish_no_copy(z,nprobes,cols,results,resultsSE);
+  iterations = median_polish_no_copy_control(z,nprobes,cols,results,resultsSE,maxiter,eps,check_convergence);
   
   R_Free(z);
-
+  return iterations;
 }
-
-
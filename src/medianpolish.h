@@ -1,6 +1,10 @@
 #ifndef MEDIANPOLISH_H
 #define MEDIANPOLISH_H 1
 
+/* default convergence settings */
+#define MEDIANPOLISH_MAXITER 10
+#define MEDIANPOLISH_EPS 0.01
+
 void median_polish_fit_no_copy(double *data, size_t rows, size_t cols, double *r, double *c, double *t);
 void median_polish_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE);
 void median_polish_log2_no_copy(double *data, size_t rows, size_t cols, double *results, double *resultsSE);
@@ -9,5 +13,10 @@ void median_polish(double *data, size_t rows, size_t cols, double *results, doub
 void MedianPolish(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE);
 void MedianPolish_no_log(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE);
 
+int median_polish_fit_control(double *data, size_t rows, size_t cols, double *r, double *c, double *t, int maxiter, double eps, int check_convergence);
+int median_polish_no_copy_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, int maxiter, double eps, int check_convergence);
+int median_polish_control(double *data, size_t rows, size_t cols, double *results, double *resultsSE, double *residuals, int maxiter, double eps, int check_convergence);
+int MedianPolish_control(double *data, size_t rows, size_t cols, int *cur_rows, double *results, size_t nprobes, double *resultsSE, int log_transform, int maxiter, double eps, int check_convergence);
+
 
 #endif
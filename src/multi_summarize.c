@@ -0,0 +1,135 @@
+/************************************************************************
+ **
+ ** multi_summarize.c
+ **
+ ** created on: Oct 18, 2026
+ **
+ ** License: LGPL V2 (same as the rest of the preprocessCore package)
+ **
+ ** General discussion
+ **
+ ** Compute several of the column summaries (avg.log, median.log, 
+ ** biweight.log, ...) of a probeset in one pass. Each column of the 
+ ** probeset is gathered out of the data matrix, and log2 transformed,
+ ** only once however many statistics are asked for. The results are
+ ** identical to those of AverageLog_noSE, MedianLog_noSE, 
+ ** TukeyBiweight_noSE etc.
+ **
+ ** Oct 18, 2026 - Initial version
+ ** Oct 18, 2026 - take log2 values from a precomputed matrix when there is one
+ **
+ ************************************************************************/
+
+#include <R.h> 
+#include <Rdefines.h>
+#include <Rmath.h>
+#include <Rinternals.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+
+#include "rma_common.h"
+#include "biweight.h"
+#include "multi_summarize.h"
+
+
+static double multi_mean(double *x, size_t length){
+  size_t i;
+  double sum = 0.0;
+
+  for (i=0; i < length; i++){
+    sum = sum + x[i];
+  }
+  
+  return sum/(double)length;
+}
+
+
+/***************************************************************************
+ **
+ ** void MultiSummarize_noSE(double *data, double *log_data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, 
+ **                          int *stats, int nstats, double *results, size_t results_stride)
+ **
+ ** aim: given a data matrix of probe intensities, and a list of rows in the matrix 
+ **      corresponding to a single probeset, compute several summaries of each column.
+ **
+ ** double *data - Probe intensity matrix
+ ** double *log_data - log2 of *data if already computed (eg a Log2MatrixCache), otherwise NULL
+ ** size_t rows - number of rows in matrix *data (probes)
+ ** size_t cols - number of cols in matrix *data (chips)
+ ** int *cur_rows - indicies of rows corresponding to current probeset
+ ** size_t nprobes - number of probes in current probeset.
+ ** int *stats - the statistics to compute (MULTI_SUMMARY_* codes, see multi_summarize.h)
+ ** int nstats - length of stats
+ ** double *results - already allocated location to store the summaries. Statistic s
+ **                   for column j goes in results[s*results_stride + j]
+ ** size_t results_stride - distance between the results of consecutive statistics (at least cols)
+ **
+ ***************************************************************************/
+
+void MultiSummarize_noSE(double *data, double *log_data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, int *stats, int nstats, double *results, size_t results_stride){
+
+  size_t i, j;
+  int s, need_log = 0;
+  double *z = R_Calloc(3*nprobes, double);
+  double *z_log = &z[nprobes];
+  double *scratch = &z[2*nprobes];
+  double *cur;
+
+  for (s = 0; s < nstats; s++){
+    if (stats[s] == MULTI_SUMMARY_AVG_LOG || stats[s] == MULTI_SUMMARY_BIWEIGHT_LOG || stats[s] == MULTI_SUMMARY_MEDIAN_LOG){
+      need_log = 1;
+    }
+  }
+
+  for (j = 0; j < cols; j++){
+    for (i =0; i < nprobes; i++){
+      z[i] = data[j*rows + cur_rows[i]];  
+    }
+    if (need_log && log_data != NULL){
+      for (i =0; i < nprobes; i++){
+	z_log[i] = log_data[j*rows + cur_rows[i]];  
+      }
+    } else if (need_log){
+      log2_transform(z, z_log, nprobes);
+    }
+
+    for (s = 0; s < nstats; s++){
+      cur = &results[s*results_stride + j];
+      switch (stats[s]){
+      case MULTI_SUMMARY_AVG_LOG:
+	*cur = multi_mean(z_log, nprobes);
+	break;
+      case MULTI_SUMMARY_LOG_AVG:
+	*cur = log2(multi_mean(z, nprobes));
+	break;
+      case MULTI_SUMMARY_AVG:
+	*cur = multi_mean(z, nprobes);
+	break;
+      case MULTI_SUMMARY_BIWEIGHT_LOG:
+	*cur = Tukey_Biweight_buffer(z_log, nprobes, scratch);
+	break;
+      case MULTI_SUMMARY_BIWEIGHT:
+	*cur = Tukey_Biweight_buffer(z, nprobes, scratch);
+	break;
+      /* the medians reorder their input, so work on a copy */
+      case MULTI_SUMMARY_MEDIAN_LOG:
+	memcpy(scratch, z_log, nprobes*sizeof(double));
+	*cur = median_nocopy(scratch, nprobes);
+	break;
+      case MULTI_SUMMARY_LOG_MEDIAN:
+	memcpy(scratch, z, nprobes*sizeof(double));
+	*cur = log2(median_nocopy(scratch, nprobes));
+	break;
+      case MULTI_SUMMARY_MEDIAN:
+	memcpy(scratch, z, nprobes*sizeof(double));
+	*cur = median_nocopy(scratch, nprobes);
+	break;
+      }
+    }
+  }
+  R_Free(z);
+}
@@ -0,0 +1,19 @@
+#ifndef MULTI_SUMMARIZE_H
+#define MULTI_SUMMARIZE_H 1
+
+/* statistic codes, in the same order as the stats argument of subColSummarizeMulti() */
+
+#define MULTI_SUMMARY_AVG_LOG 0
+#define MULTI_SUMMARY_LOG_AVG 1
+#define MULTI_SUMMARY_AVG 2
+#define MULTI_SUMMARY_BIWEIGHT_LOG 3
+#define MULTI_SUMMARY_BIWEIGHT 4
+#define MULTI_SUMMARY_MEDIAN_LOG 5
+#define MULTI_SUMMARY_LOG_MEDIAN 6
+#define MULTI_SUMMARY_MEDIAN 7
+
+#define MULTI_SUMMARY_N 8
+
+void MultiSummarize_noSE(double *data, double *log_data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, int *stats, int nstats, double *results, size_t results_stride);
+
+#endif
@@ -15,6 +15,8 @@
  ** Dec 3, 2007 - Initial version. 
  ** Jan 21, 2008 - improve detect_split_probe
  ** Jan 23-24, 2008 - improve design matrix code
+ ** Oct 18, 2026 - fit the split models with plmd_wls(), which solves the normal
+ **                equations blockwise, rather than by QR of the dense design matrix
  **                
  **
  **
@@ -218,6 +220,7 @@
 #include "rlm.h"
 #include "rlm_se.h"
 #include "rma_common.h"
+#include "lm.h"
 
 #include "plmd.h"
 
@@ -653,6 +656,338 @@ void R_test_get_design_matrix(int *yrows, int *ycols){
   
 
 
+/*********************************************************************
+ **
+ ** static int plmd_alpha_index(int y_rows, int ngroups, int *was_split, int *alpha_index)
+ **
+ ** int y_rows - number of probes
+ ** int ngroups - number of groups
+ ** int *was_split - a vector of 0,1 values length y_rows indicating whether or not a given probe was split
+ ** int *alpha_index - on output, alpha_index[i*ngroups + m] is the probe effect 
+ **                    (counting from 0 after the chip effects, in the same order as the
+ **                    columns of plmd_get_design_matrix()) of probe i on arrays in group m.
+ **                    -1 marks the probe effect that is minus the sum of all the others
+ **                    (the last probe, or its last group if it was split)
+ **
+ ** returns the number of probe effects estimated, y_rows - 1 + (ngroups -1)*num_splits
+ **
+ ** Every column of X_alpha is the indicator of one of these probe (and group) cells
+ ** less the indicator of the cells marked -1, and no two columns share a cell.
+ **
+ ********************************************************************/
+
+static int plmd_alpha_index(int y_rows, int ngroups, int *was_split, int *alpha_index){
+
+  int i, m;
+  int cur_col = 0;
+
+  for (i = 0; i < y_rows-1; i++){
+    for (m = 0; m < ngroups; m++){
+      alpha_index[i*ngroups + m] = (was_split[i] ? cur_col + m : cur_col);
+    }
+    cur_col += (was_split[i] ? ngroups : 1);
+  }
+
+  /* Last probe */
+  for (m = 0; m < ngroups; m++){
+    alpha_index[i*ngroups + m] = -1;
+  }
+  if (was_split[i]){
+    for (m = 0; m < ngroups - 1; m++){
+      alpha_index[i*ngroups + m] = cur_col + m;
+    }
+    cur_col += ngroups - 1;
+  }
+
+  return cur_col;
+}
+
+
+/* workspace needed by plmd_wls() for q probe effects */
+#define PLMD_WLS_WORK(y_cols, q) ((size_t)(q)*(q) + 5*(size_t)(q) + (y_cols))
+
+#define PLMD_WLS_BLOCK 4
+
+
+/*********************************************************************
+ **
+ ** static int plmd_wls(double *y, int y_rows, int y_cols, int *grouplabels, int ngroups, 
+ **                     int *alpha_index, int q, double *wts, double *out_beta, double *work)
+ **
+ ** double *y - matrix of observations (probes in rows, arrays in columns)
+ ** int *grouplabels, int ngroups - the group of each array
+ ** int *alpha_index, int q - as given by plmd_alpha_index()
+ ** double *wts - weights, same dimensions as y
+ ** double *out_beta - on output the weighted least squares estimates (chip effects 
+ **                    then the q probe effects)
+ ** double *work - workspace of length PLMD_WLS_WORK(y_cols, q)
+ **
+ ** RETURNS 0 on success, non zero if the system could not be solved this way 
+ **
+ ** One weighted least squares step for the PLM-d model without forming the design
+ ** matrix. As for the probes + chips model (see XTWX_solve() in rlm_anova.c), since 
+ ** no two probe effect columns share a cell, XTWX is
+ **
+ **       | P  R'|      P diagonal (chips),  R q by y_cols, 
+ **       | R  S |      S = diagonal + (weight of the -1 cells) * 11'
+ **
+ ** The probe effects solve (S - R P^{-1} R') b = xtwy_probes - R P^{-1} xtwy_chips
+ ** by Choleski, then the chip effects are P^{-1}(xtwy_chips - R' b). Column j of R
+ ** is the weight of each cell on chip j less the weight of the -1 cell on chip j 
+ ** (if it has one).
+ **
+ ********************************************************************/
+
+static int plmd_wls(double *y, int y_rows, int y_cols, int *grouplabels, int ngroups, int *alpha_index, int q, double *wts, double *out_beta, double *work){
+
+  int i, j, k, c, nb;
+  int *cur_index;
+  double *xtwy = work;
+  double *r = &xtwy[y_cols + q];
+  double *schur = &r[PLMD_WLS_BLOCK*q];
+  double *b = &out_beta[y_cols];
+  double *w, *yj;
+  double Pinv[PLMD_WLS_BLOCK], rk[PLMD_WLS_BLOCK];
+  double lastw, sumlast = 0.0, lastwy = 0.0, sum, sumb;
+
+  for (k = 0; k < q; k++){
+    for (i = 0; i <= k; i++){
+      schur[k*q + i] = 0.0;
+    }
+    xtwy[y_cols + k] = 0.0;
+  }
+
+  /* XTWY, and the diagonal of S */
+  for (j = 0; j < y_cols; j++){
+    w = &wts[j*y_rows];
+    yj = &y[j*y_rows];
+    cur_index = &alpha_index[grouplabels[j]];
+    xtwy[j] = 0.0;
+    for (i = 0; i < y_rows; i++){
+      xtwy[j] += w[i]*yj[i];
+      k = cur_index[i*ngroups];
+      if (k < 0){
+	lastwy += w[i]*yj[i];
+	sumlast += w[i];
+      } else {
+	xtwy[y_cols + k] += w[i]*yj[i];
+	schur[k*q + k] += w[i];
+      }
+    }
+  }
+  for (k = 0; k < q; k++){
+    xtwy[y_cols + k] -= lastwy;
+    b[k] = xtwy[y_cols + k];
+  }
+
+  /* subtract R P^{-1} R' from S a few chips at a time (only the upper triangle is needed) */
+  for (j = 0; j < y_cols; j+=PLMD_WLS_BLOCK){
+    nb = (y_cols - j < PLMD_WLS_BLOCK ? y_cols - j : PLMD_WLS_BLOCK);
+    for (c = 0; c < nb; c++){
+      w = &wts[(j+c)*y_rows];
+      cur_index = &alpha_index[grouplabels[j+c]];
+      lastw = 0.0;
+      sum = 0.0;
+      for (i = 0; i < y_rows; i++){
+	sum += w[i];
+	if (cur_index[i*ngroups] < 0)
+	  lastw += w[i];
+      }
+      Pinv[c] = 1.0/sum;
+      for (k = 0; k < q; k++){
+	r[c*q + k] = -lastw;
+      }
+      for (i = 0; i < y_rows; i++){
+	k = cur_index[i*ngroups];
+	if (k >= 0)
+	  r[c*q + k] += w[i];
+      }
+      for (k = 0; k < q; k++){
+	b[k] -= r[c*q + k]*xtwy[j+c]*Pinv[c];
+      }
+    }
+    if (nb == PLMD_WLS_BLOCK){
+      for (k = 0; k < q; k++){
+	rk[0] = r[k]*Pinv[0];
+	rk[1] = r[q + k]*Pinv[1];
+	rk[2] = r[2*q + k]*Pinv[2];
+	rk[3] = r[3*q + k]*Pinv[3];
+	for (i = 0; i <= k; i++){
+	  schur[k*q + i] -= r[i]*rk[0] + r[q + i]*rk[1] + r[2*q + i]*rk[2] + r[3*q + i]*rk[3];
+	}
+      }
+    } else {
+      for (c = 0; c < nb; c++){
+	for (k = 0; k < q; k++){
+	  rk[0] = r[c*q + k]*Pinv[c];
+	  for (i = 0; i <= k; i++){
+	    schur[k*q + i] -= r[c*q + i]*rk[0];
+	  }
+	}
+      }
+    }
+  }
+
+  for (k = 0; k < q; k++){
+    for (i = 0; i <= k; i++){
+      schur[k*q + i] += sumlast;
+    }
+  }
+
+  if (q > 0 && Choleski_solve(schur, b, q)){
+    return 1;
+  }
+
+  /* back substitute for the chip effects */
+  sumb = 0.0;
+  for (k = 0; k < q; k++){
+    sumb += b[k];
+  }
+  for (j = 0; j < y_cols; j++){
+    w = &wts[j*y_rows];
+    cur_index = &alpha_index[grouplabels[j]];
+    sum = 0.0;
+    out_beta[j] = xtwy[j];
+    for (i = 0; i < y_rows; i++){
+      sum += w[i];
+      k = cur_index[i*ngroups];
+      out_beta[j] -= (k < 0 ? -sumb : b[k])*w[i];
+    }
+    out_beta[j]/=sum;
+  }
+  return 0;
+}
+
+
+/*********************************************************************
+ **
+ ** static double plmd_resids(double *y, int y_rows, int y_cols, int *grouplabels, int ngroups,
+ **                           int *alpha_index, int q, double *beta, double *resids, 
+ **                           double *abs_resids, int first)
+ **
+ ** double *beta - chip effects then the q probe effects
+ ** double *resids - on output the residuals of beta (on input those of the previous 
+ **                  IRLS step, unless first is non zero)
+ ** double *abs_resids - on output the absolute values of the new residuals
+ **
+ ** RETURNS the IRLS convergence measure (see irls_delta()), 0 if first is non zero
+ **
+ ** As rlm_anova_resids() but for the PLM-d model.
+ **
+ ********************************************************************/
+
+static double plmd_resids(double *y, int y_rows, int y_cols, int *grouplabels, int ngroups, int *alpha_index, int q, double *beta, double *resids, double *abs_resids, int first){
+
+  int i, j, k;
+  int *cur_index;
+  double endprobe = 0.0;
+  double r, d;
+  double sum = 0.0, sum2 = 0.0;
+  double divisor = 1e-20;
+  double *yj, *rj;
+
+  for (k = 0; k < q; k++){
+    endprobe += beta[y_cols + k];
+  }
+
+  for (j = 0; j < y_cols; j++){
+    yj = &y[j*y_rows];
+    rj = &resids[j*y_rows];
+    cur_index = &alpha_index[grouplabels[j]];
+    for (i = 0; i < y_rows; i++){
+      k = cur_index[i*ngroups];
+      r = yj[i] - (beta[j] + (k < 0 ? -endprobe : beta[y_cols + k]));
+      if (!first){
+	d = rj[i] - r;
+	sum = sum + d*d;
+	sum2 = sum2 + rj[i]*rj[i];
+      }
+      rj[i] = r;
+      abs_resids[j*y_rows + i] = fabs(r);
+    }
+  }
+
+  if(sum2 >= divisor){
+    divisor = sum2;
+  }
+
+  return sqrt(sum/divisor);
+}
+
+
+/*********************************************************************
+ **
+ ** static void plmd_fit_split(double *y, int y_rows, int y_cols, int ngroups, int *grouplabels, 
+ **            int *was_split, double *out_beta, double *out_resids, double *out_weights,
+ **            double (* PsiFn)(double, double, int), double psi_k,int max_iter)
+ **
+ ** Fits the PLM-d model with the probes given by was_split split, by IRLS started
+ ** from the least squares fit. The same fit rlm_fit() gives with the design matrix from
+ ** plmd_get_design_matrix(), but each step is solved by plmd_wls() so it costs
+ ** about as much as one for the unsplit model. Should plmd_wls() fail the 
+ ** step is done with lm_wfit() on the design matrix instead.
+ **
+ ********************************************************************/
+
+static void plmd_fit_split(double *y, int y_rows, int y_cols, int ngroups, int *grouplabels, int *was_split,
+			   double *out_beta, double *out_resids, double *out_weights,
+			   double (* PsiFn)(double, double, int), double psi_k,int max_iter){
+
+  int i, iter, q;
+  int n = y_rows*y_cols;
+  double acc = 1e-4;
+  double scale;
+  double conv;
+
+  double *wts = out_weights;
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
+
+  int *alpha_index = R_Calloc(y_rows*ngroups, int);
+  double *abs_resids = R_Calloc(n, double);
+  double *work;
+  double *X;
+  int X_rows, X_cols;
+
+  q = plmd_alpha_index(y_rows, ngroups, was_split, alpha_index);
+  work = R_Calloc(PLMD_WLS_WORK(y_cols, q), double);
+
+  /* intially use equal weights */
+  for (i = 0; i < n; i++){
+    wts[i] = 1.0;
+  }
+
+  for (iter = 0; iter <= max_iter; iter++){
+    /* iteration 0 is the least squares fit */
+    if (iter > 0){
+      scale = median_nocopy(abs_resids, n)/0.6745;
+
+      if (fabs(scale) < 1e-10){
+	break;
+      }
+
+      PsiArray(PsiFn, out_resids, n, scale, psi_k, 0, wts);
+    }
+
+    if (plmd_wls(y, y_rows, y_cols, grouplabels, ngroups, alpha_index, q, wts, out_beta, work)){
+      X = plmd_get_design_matrix(y_rows, y_cols, ngroups, grouplabels, was_split, &X_rows, &X_cols);
+      lm_wfit(X, y, wts, X_rows, X_cols, 1e-7, out_beta, abs_resids);
+      R_Free(X);
+    }
+
+    conv = plmd_resids(y, y_rows, y_cols, grouplabels, ngroups, alpha_index, q, out_beta, out_resids, abs_resids, (iter == 0));
+
+    if (iter > 0 && conv < acc){
+      break;
+    }
+  }
+
+  R_Free(work);
+  R_Free(abs_resids);
+  R_Free(alpha_index);
+}
+
+
+
 /*********************************************************************
  **
  ** void plmd_fit(double *y, int y_rows, int y_cols, int ngroups, int *grouplabels, int *was_split,
@@ -696,12 +1031,6 @@ void plmd_fit(double *y, int y_rows, int y_cols, int ngroups, int *grouplabels,
   int split_probe = -1;
 
 
-  double *X;
-
-  int X_rows;
-  int X_cols;
-
-
   /* Initially nothing is split */
   memset(was_split, 0 , y_rows*sizeof(int));
 
@@ -721,13 +1050,9 @@ void plmd_fit(double *y, int y_rows, int y_cols, int ngroups, int *grouplabels,
     /*   Rprintf("Splitting %d\n",split_probe); */
     if (split_probe != -1){
       was_split[split_probe] = 1;
-      X = plmd_get_design_matrix(y_rows, y_cols, ngroups, grouplabels, was_split,&X_rows, &X_cols);
-      
 
-      rlm_fit(X,y, X_rows, X_cols, out_beta, out_resids, out_weights,
-                PsiFn, psi_k, max_iter, initialized);
-    
-      R_Free(X);
+      plmd_fit_split(y, y_rows, y_cols, ngroups, grouplabels, was_split, 
+		     out_beta, out_resids, out_weights, PsiFn, psi_k, max_iter);
     }
   } while (split_probe != -1);
   
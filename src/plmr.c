@@ -15,6 +15,12 @@
  ** History:
  ** Nov 22, 2007 - Initial version. (Based on rlm_anova.c which dates back several years and some notes about PLMR was to be implemented made about 18 months ago, actually early Sept 2006, which in turn was based about ideas in Bolstad (2004) Dissertation, UCB)
  ** Feb 14, 2008 - Add PLM-rr and PLM-rc (only row or column robustified but not both)               
+ ** Oct 18, 2026 - IRLS scale estimate uses med_abs_buffer (old_resids as scratch)
+ ** Oct 18, 2026 - weighted least squares steps use rlm_anova_wls (see rlm_anova.c)
+ ** Oct 18, 2026 - *_ws variants take a caller supplied workspace (PLMR_FIT_WORK in plmr.h),
+ **                the row/column weights no longer leak
+ ** Oct 18, 2026 - residuals, convergence measure and absolute residuals computed in one
+ **                pass (rlm_anova_resids), previous residuals are no longer copied
  **
  **
  **
@@ -441,13 +447,16 @@ void R_estimate_median_percentile(double *median, int *n){
  ** int y_cols - dimension of residuals matrix
  ** double *row_weights - on output will contain a weight (0-1) for row (pre-allocated. should be of length y_rows)
  **
+ ** determine_row_weights_buffer() does the same using a caller supplied
+ ** scratch buffer of length y_rows*y_cols
+ **
  **
  ****************************************************************************************/
 
 
-void determine_row_weights(double *resids, int y_rows, int y_cols, double *row_weights){
+static void determine_row_weights_buffer(double *resids, int y_rows, int y_cols, double *row_weights, double *buffer){
   
-  double *current_row = R_Calloc(y_cols,double);
+  double *current_row = buffer;
   double scale;
   int n = y_rows*y_cols;
   int i, j;
@@ -458,7 +467,7 @@ void determine_row_weights(double *resids, int y_rows, int y_cols, double *row_w
   
 
   /* First figure out what we need to standardize the residuals */
-  scale = med_abs(resids,n)/0.6745;
+  scale = med_abs_buffer(resids,n,buffer)/0.6745;
 
   for (i= 0; i < y_rows; i++){
     for (j=0; j < y_cols; j++){
@@ -485,7 +494,15 @@ void determine_row_weights(double *resids, int y_rows, int y_cols, double *row_w
 
   }
 
-  R_Free(current_row);
+}
+
+void determine_row_weights(double *resids, int y_rows, int y_cols, double *row_weights){
+
+  double *buffer = R_Calloc(y_rows*y_cols,double);
+
+  determine_row_weights_buffer(resids, y_rows, y_cols, row_weights, buffer);
+
+  R_Free(buffer);
 }
 
 /**********************************************************************************
@@ -497,12 +514,15 @@ void determine_row_weights(double *resids, int y_rows, int y_cols, double *row_w
  ** int y_cols - dimension of residuals matrix
  ** double *col_weights - on output will contain a weight (0-1) for each col (pre-allocated. should be of length y_cols)
  **
+ ** determine_col_weights_buffer() does the same using a caller supplied
+ ** scratch buffer of length y_rows*y_cols
+ **
  **
  ****************************************************************************************/
 
-void determine_col_weights(double *resids, int y_rows, int y_cols, double *col_weights){
+static void determine_col_weights_buffer(double *resids, int y_rows, int y_cols, double *col_weights, double *buffer){
       
-  double *current_col = R_Calloc(y_rows,double);
+  double *current_col = buffer;
   double scale;
   int n = y_rows*y_cols;
   int i, j;
@@ -513,7 +533,7 @@ void determine_col_weights(double *resids, int y_rows, int y_cols, double *col_w
   
 
   /* First figure out what we need to standardize the residuals */
-  scale = med_abs(resids,n)/0.6745;
+  scale = med_abs_buffer(resids,n,buffer)/0.6745;
 
   for (j=0; j < y_cols; j++){
     for (i= 0; i < y_rows; i++){
@@ -539,10 +559,15 @@ void determine_col_weights(double *resids, int y_rows, int y_cols, double *col_w
 
   }
 
-  R_Free(current_col);
-  
+}
+
+void determine_col_weights(double *resids, int y_rows, int y_cols, double *col_weights){
 
+  double *buffer = R_Calloc(y_rows*y_cols,double);
 
+  determine_col_weights_buffer(resids, y_rows, y_cols, col_weights, buffer);
+
+  R_Free(buffer);
 }
 
 
@@ -589,29 +614,34 @@ void R_determine_col_weights(double *resids, int *y_rows, int *y_cols, double *c
  **
  ** fits a row + columns model
  **
+ ** double *work - NULL, or scratch of length PLMR_FIT_WORK(y_rows, y_cols)
+ **
  **********************************************************************************/
 
-static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int rowrobust, int colrobust){
+static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int rowrobust, int colrobust, double *work){
 
   int i,j,iter;
   /* double tol = 1e-7; */
   double acc = 1e-4;
   double scale =0.0;
   double conv;
-  double endprobe;
 
   double *wts = out_weights; 
 
-  double *row_weights = R_Calloc(y_rows, double);
-  double *col_weights = R_Calloc(y_cols, double);
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
+
+  double *ws = (work == NULL) ? R_Calloc(PLMR_FIT_WORK(y_rows, y_cols),double) : work;
+
+  double *row_weights = ws;
+  double *col_weights = row_weights + y_rows;
 
   double *resids = out_resids; 
-  double *old_resids = R_Calloc(y_rows*y_cols,double);
+  double *abs_resids = col_weights + y_cols;   /* |resids| (in some order) for the scale estimate */
+  double *buffer = abs_resids + (size_t)y_rows*y_cols;
   
-  double *rowmeans = R_Calloc(y_rows,double);
+  double *rowmeans = buffer + (size_t)y_rows*y_cols;
 
-  double *xtwx = R_Calloc((y_rows+y_cols-1)*(y_rows+y_cols-1),double);
-  double *xtwy = R_Calloc((y_rows+y_cols),double);
+  double *wls_work = rowmeans + y_rows;
 
   double sumweights, rows;
   
@@ -680,31 +710,29 @@ static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, do
     }
   }
   
+  for (i=0; i < rows; i++){
+    abs_resids[i] = fabs(resids[i]);
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
     
     if (fabs(scale) < 1e-10){
       /*printf("Scale too small \n"); */
       break;
     }
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
     /* weights for individual measurements */
 
-    for (i=0; i < rows; i++){
-      wts[i] = PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
-    }
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
    
     /* now determine row and column weights */
     if (iter > 0){
       if (rowrobust){
-	determine_row_weights(resids, y_rows, y_cols, row_weights);
+	determine_row_weights_buffer(resids, y_rows, y_cols, row_weights, buffer);
       }
       if (colrobust){
-	determine_col_weights(resids, y_rows, y_cols, col_weights);
+	determine_col_weights_buffer(resids, y_rows, y_cols, col_weights, buffer);
       }
       for (j= 0; j < y_cols; j++){
 	for (i = 0; i < y_rows; i++){
@@ -716,40 +744,11 @@ static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, do
 
     /* weighted least squares */
     
-    memset(xtwx,0,(y_rows+y_cols-1)*(y_rows+y_cols-1)*sizeof(double));
-
-
-    XTWX(y_rows,y_cols,wts,xtwx);
-    XTWXinv(y_rows, y_cols,xtwx);
-    XTWY(y_rows, y_cols, wts,y, xtwy);
-
-    
-    for (i=0;i < y_rows+y_cols-1; i++){
-      out_beta[i] = 0.0;
-       for (j=0;j < y_rows+y_cols -1; j++){
-    	 out_beta[i] += xtwx[j*(y_rows+y_cols -1)+i]*xtwy[j];
-       }
-    }
-
-    /* residuals */
-    
-    for (i=0; i < y_rows-1; i++){
-      for (j=0; j < y_cols; j++){
-	resids[j*y_rows +i] = y[j*y_rows + i]- (out_beta[j] + out_beta[i + y_cols]); 
-      }
-    }
-
-    for (j=0; j < y_cols; j++){
-      endprobe=0.0;
-      for (i=0; i < y_rows-1; i++){
-	endprobe+= out_beta[i + y_cols];
-      }
-      resids[j*y_rows + y_rows-1] = y[j*y_rows + y_rows-1]- (out_beta[j] - endprobe);
-    }
+    rlm_anova_wls(y, y_rows, y_cols, wts, out_beta, wls_work);
 
-    /*check convergence  based on residuals */
+    /* residuals and convergence check (based on residuals) in one pass */
     
-    conv = irls_delta(old_resids,resids, rows);
+    conv = rlm_anova_resids(y, y_rows, y_cols, out_beta, resids, abs_resids);
     
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -776,10 +775,9 @@ static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, do
 
 
 
-  R_Free(xtwx);
-  R_Free(xtwy);
-  R_Free(old_resids);
-  R_Free(rowmeans);
+  if (work == NULL){
+    R_Free(ws);
+  }
 
 
 }
@@ -787,17 +785,32 @@ static void plmr_fit_core(double *y, int y_rows, int y_cols,double *out_beta, do
 
 void plmr_fit(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
 
-  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,1);
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,1,NULL);
+}
+
+void plmr_fit_ws(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,1,work);
 }
 
 void plmrr_fit(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
 
-  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,0);
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,0,NULL);
+}
+
+void plmrr_fit_ws(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,1,0,work);
 }
 
 void plmrc_fit(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
 
-  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,0,1);
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,0,1,NULL);
+}
+
+void plmrc_fit_ws(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+
+  plmr_fit_core(y, y_rows, y_cols, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized,0,1,work);
 }
 
 
@@ -835,27 +848,30 @@ matrix(.C("plmr_fit_R",as.double(log2(y)),as.integer(16),as.integer(4),double(20
 */
 
 
-static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int rowrobust, int colrobust){
+static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int rowrobust, int colrobust, double *work){
 
   int i,j,iter;
   /* double tol = 1e-7; */
   double acc = 1e-4;
   double scale =0.0;
   double conv;
-  double endprobe;
 
   double *wts = out_weights; 
+
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
  
-  double *row_weights = R_Calloc(y_rows, double);
-  double *col_weights = R_Calloc(y_cols, double);
+  double *ws = (work == NULL) ? R_Calloc(PLMR_FIT_WORK(y_rows, y_cols),double) : work;
+
+  double *row_weights = ws;
+  double *col_weights = row_weights + y_rows;
 
   double *resids = out_resids; 
-  double *old_resids = R_Calloc(y_rows*y_cols,double);
+  double *abs_resids = col_weights + y_cols;   /* |resids| (in some order) for the scale estimate */
+  double *buffer = abs_resids + (size_t)y_rows*y_cols;
   
-  double *rowmeans = R_Calloc(y_rows,double);
+  double *rowmeans = buffer + (size_t)y_rows*y_cols;
 
-  double *xtwx = R_Calloc((y_rows+y_cols-1)*(y_rows+y_cols-1),double);
-  double *xtwy = R_Calloc((y_rows+y_cols),double);
+  double *wls_work = rowmeans + y_rows;
 
   double sumweights, rows;
   
@@ -924,29 +940,30 @@ static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double
     }
   }
   
+  for (i=0; i < rows; i++){
+    abs_resids[i] = fabs(resids[i]);
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
     
     if (fabs(scale) < 1e-10){
       /*printf("Scale too small \n"); */
       break;
     }
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
     for (i=0; i < rows; i++){
-      wts[i] = w[i]*PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
+      wts[i] = w[i]*wts[i];
     }
     
     /* now determine row and column weights */
     if (iter > 0){
       if (rowrobust){
-	determine_row_weights(resids, y_rows, y_cols, row_weights);
+	determine_row_weights_buffer(resids, y_rows, y_cols, row_weights, buffer);
       }
       if (colrobust){
-	determine_col_weights(resids, y_rows, y_cols, col_weights);
+	determine_col_weights_buffer(resids, y_rows, y_cols, col_weights, buffer);
       }
  
       for (j= 0; j < y_cols; j++){
@@ -961,40 +978,11 @@ static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double
 
     /* weighted least squares */
     
-    memset(xtwx,0,(y_rows+y_cols-1)*(y_rows+y_cols-1)*sizeof(double));
-
-
-    XTWX(y_rows,y_cols,wts,xtwx);
-    XTWXinv(y_rows, y_cols,xtwx);
-    XTWY(y_rows, y_cols, wts,y, xtwy);
-
-    
-    for (i=0;i < y_rows+y_cols-1; i++){
-      out_beta[i] = 0.0;
-       for (j=0;j < y_rows+y_cols -1; j++){
-    	 out_beta[i] += xtwx[j*(y_rows+y_cols -1)+i]*xtwy[j];
-       }
-    }
-
-    /* residuals */
-    
-    for (i=0; i < y_rows-1; i++){
-      for (j=0; j < y_cols; j++){
-	resids[j*y_rows +i] = y[j*y_rows + i]- (out_beta[j] + out_beta[i + y_cols]); 
-      }
-    }
-
-    for (j=0; j < y_cols; j++){
-      endprobe=0.0;
-      for (i=0; i < y_rows-1; i++){
-	endprobe+= out_beta[i + y_cols];
-      }
-      resids[j*y_rows + y_rows-1] = y[j*y_rows + y_rows-1]- (out_beta[j] - endprobe);
-    }
+    rlm_anova_wls(y, y_rows, y_cols, wts, out_beta, wls_work);
 
-    /*check convergence  based on residuals */
+    /* residuals and convergence check (based on residuals) in one pass */
     
-    conv = irls_delta(old_resids,resids, rows);
+    conv = rlm_anova_resids(y, y_rows, y_cols, out_beta, resids, abs_resids);
     
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -1021,10 +1009,9 @@ static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double
 
 
 
-  R_Free(xtwx);
-  R_Free(xtwy);
-  R_Free(old_resids);
-  R_Free(rowmeans);
+  if (work == NULL){
+    R_Free(ws);
+  }
 
 
 }
@@ -1033,19 +1020,37 @@ static void plmr_wfit_core(double *y, int y_rows, int y_cols, double *w, double
 
 void plmr_wfit(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
-  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 1);
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 1, NULL);
+
+}
+
+void plmr_wfit_ws(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+  
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 1, work);
 
 }
 
 void plmrr_wfit(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
-  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 0);
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 0, NULL);
+
+}
+
+void plmrr_wfit_ws(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+  
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 1, 0, work);
 
 }
 
 void plmrc_wfit(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
-  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 0, 1);
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 0, 1, NULL);
+
+}
+
+void plmrc_wfit_ws(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+  
+  plmr_wfit_core(y, y_rows, y_cols, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, 0, 1, work);
 
 }
 
@@ -0,0 +1,394 @@
+/*********************************************************************
+ **
+ ** file: probe_group_index.c
+ **
+ ** Aim: a compiled index of probe groups (eg probesets) that can be
+ ** built once and then reused by the subColSummarize and subrcModel
+ ** code.
+ **
+ ** created on: Oct 18, 2026
+ **
+ ** History
+ ** Oct 18, 2026 - Initial version
+ ** Oct 18, 2026 - add probe_group_schedule for handing groups out to
+ **                worker threads largest first
+ ** Oct 18, 2026 - add probe_group_num_threads so callers can check R_THREADS
+ **                before they have allocated anything
+ **
+ ** The subColSummarize and subrcModel functions are given the probe
+ ** groups as a list (one integer vector of 0-based row indices per group)
+ ** made in R by convert.group.labels(). Making that list (as.factor and
+ ** split) for a 1 million plus probe layout takes far longer than needed
+ ** and then each group has to be looked up with VECTOR_ELT. Instead
+ ** the groups can be stored once in compressed sparse row (CSR) form,
+ ** an array of offsets and an array of row indices, and held in an R
+ ** external pointer (class "ProbeGroupIndex").
+ **
+ ** All the functions that take a rowIndexList accept either the list or
+ ** the external pointer. probe_group_index_get() converts a list to CSR
+ ** form on the fly, so the summarization code only deals with one layout.
+ **
+ *********************************************************************/
+
+#include <R.h>
+#include <Rdefines.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "probe_group_index.h"
+
+
+static struct probe_group_index *probe_group_index_alloc(int ngroups, int nentries){
+
+  struct probe_group_index *groups = R_Calloc(1, struct probe_group_index);
+
+  groups->ngroups = ngroups;
+  groups->nrows = 0;
+  groups->offsets = R_Calloc(ngroups + 1, int);
+  groups->rows = R_Calloc((nentries > 0 ? nentries : 1), int);
+
+  return groups;
+}
+
+
+void probe_group_index_free(struct probe_group_index *groups){
+
+  if (groups == NULL)
+    return;
+
+  R_Free(groups->offsets);
+  R_Free(groups->rows);
+  R_Free(groups);
+}
+
+
+static void probe_group_index_finalizer(SEXP R_groups){
+
+  struct probe_group_index *groups = (struct probe_group_index *) R_ExternalPtrAddr(R_groups);
+
+  probe_group_index_free(groups);
+  R_ClearExternalPtr(R_groups);
+}
+
+
+
+/*********************************************************************
+ **
+ ** SEXP R_probe_group_index(SEXP R_group_codes, SEXP R_group_names, SEXP R_sort_by_first_row)
+ **
+ ** SEXP R_group_codes - integer vector, for each row the (1 based) group
+ **                      it belongs to (ie the codes of a factor). NA rows
+ **                      are in no group.
+ ** SEXP R_group_names - character vector of group names (the factor levels)
+ ** SEXP R_sort_by_first_row - logical. If TRUE groups are ordered by the
+ **                      first row in each group rather than by the order of
+ **                      R_group_names. Groups are then visited in
+ **                      roughly the order the rows are stored, which helps
+ **                      memory locality.
+ **
+ ** returns an external pointer to a struct probe_group_index (class
+ ** "ProbeGroupIndex"), with the group names, in group order, as the
+ ** "group.names" attribute. Within each group rows are in increasing
+ ** order, the same as split() would give.
+ **
+ *********************************************************************/
+
+SEXP R_probe_group_index(SEXP R_group_codes, SEXP R_group_names, SEXP R_sort_by_first_row){
+
+  SEXP R_groups, R_names, R_class;
+
+  int *codes = INTEGER(R_group_codes);
+  int n = LENGTH(R_group_codes);
+  int ngroups = LENGTH(R_group_names);
+  int sort_by_first_row = asLogical(R_sort_by_first_row);
+
+  struct probe_group_index *groups;
+  int *counts, *fill, *order;
+  int i, j, g, nentries = 0;
+
+  for (i = 0; i < n; i++){
+    if (codes[i] != NA_INTEGER && (codes[i] < 1 || codes[i] > ngroups)){
+      error("group code %d for row %d is outside 1 to %d", codes[i], i+1, ngroups);
+    }
+  }
+
+  /* order[j] is the group (0 based code) that goes in position j */
+  order = R_Calloc(ngroups + 1, int);
+  if (sort_by_first_row == TRUE){
+    fill = R_Calloc(ngroups + 1, int);   /* used here to mark groups already seen */
+    j = 0;
+    for (i = 0; i < n; i++){
+      if (codes[i] != NA_INTEGER && !fill[codes[i]-1]){
+	fill[codes[i]-1] = 1;
+	order[j++] = codes[i]-1;
+      }
+    }
+    /* empty groups go at the end */
+    for (g = 0; g < ngroups; g++){
+      if (!fill[g]){
+	order[j++] = g;
+      }
+    }
+    R_Free(fill);
+  } else {
+    for (g = 0; g < ngroups; g++){
+      order[g] = g;
+    }
+  }
+
+  /* count rows in each group, then lay the groups out in the required order */
+  counts = R_Calloc(ngroups + 1, int);
+  for (i = 0; i < n; i++){
+    if (codes[i] != NA_INTEGER){
+      counts[codes[i]-1]++;
+      nentries++;
+    }
+  }
+
+  groups = probe_group_index_alloc(ngroups, nentries);
+  groups->nrows = n;
+
+  fill = R_Calloc(ngroups + 1, int);  /* fill[g] - next free slot for group g */
+  groups->offsets[0] = 0;
+  for (j = 0; j < ngroups; j++){
+    groups->offsets[j+1] = groups->offsets[j] + counts[order[j]];
+    fill[order[j]] = groups->offsets[j];
+  }
+  for (i = 0; i < n; i++){
+    if (codes[i] != NA_INTEGER){
+      groups->rows[fill[codes[i]-1]++] = i;
+    }
+  }
+  R_Free(fill);
+  R_Free(counts);
+
+  PROTECT(R_groups = R_MakeExternalPtr(groups, install("ProbeGroupIndex"), R_NilValue));
+  R_RegisterCFinalizerEx(R_groups, probe_group_index_finalizer, TRUE);
+
+  PROTECT(R_names = allocVector(STRSXP, ngroups));
+  for (j = 0; j < ngroups; j++){
+    SET_STRING_ELT(R_names, j, STRING_ELT(R_group_names, order[j]));
+  }
+  setAttrib(R_groups, install("group.names"), R_names);
+
+  PROTECT(R_class = mkString("ProbeGroupIndex"));
+  setAttrib(R_groups, R_ClassSymbol, R_class);
+
+  R_Free(order);
+
+  UNPROTECT(3);
+  return R_groups;
+}
+
+
+
+/*********************************************************************
+ **
+ ** struct probe_group_index *probe_group_index_get(SEXP R_rowIndexList, int *temporary)
+ **
+ ** SEXP R_rowIndexList - either an external pointer made by
+ **                       R_probe_group_index() or a list of integer
+ **                       vectors of (0 based) row indices
+ ** int *temporary - on output 1 if the index was built here from a list
+ **                  (the caller must then probe_group_index_free() it),
+ **                  0 if it belongs to the external pointer.
+ **
+ ** returns the probe groups in CSR form.
+ **
+ *********************************************************************/
+
+struct probe_group_index *probe_group_index_get(SEXP R_rowIndexList, int *temporary){
+
+  struct probe_group_index *groups;
+  SEXP R_cur;
+  int ngroups, nentries = 0, ncur_rows;
+  int i, j;
+  int *cur_rows;
+
+  if (TYPEOF(R_rowIndexList) == EXTPTRSXP){
+    if (R_ExternalPtrTag(R_rowIndexList) != install("ProbeGroupIndex")){
+      error("external pointer is not a ProbeGroupIndex");
+    }
+    groups = (struct probe_group_index *) R_ExternalPtrAddr(R_rowIndexList);
+    if (groups == NULL){
+      error("ProbeGroupIndex is no longer valid (it can not be saved and reloaded). Rebuild it with probeGroupIndex()");
+    }
+    *temporary = 0;
+    return groups;
+  }
+
+  if (TYPEOF(R_rowIndexList) != VECSXP){
+    error("row index list should be a list of integer vectors or a ProbeGroupIndex");
+  }
+
+  ngroups = LENGTH(R_rowIndexList);
+  for (j = 0; j < ngroups; j++){
+    R_cur = VECTOR_ELT(R_rowIndexList, j);
+    if (TYPEOF(R_cur) != INTSXP){
+      error("row index list should be a list of integer vectors or a ProbeGroupIndex");
+    }
+    nentries += LENGTH(R_cur);
+  }
+
+  groups = probe_group_index_alloc(ngroups, nentries);
+
+  groups->offsets[0] = 0;
+  for (j = 0; j < ngroups; j++){
+    R_cur = VECTOR_ELT(R_rowIndexList, j);
+    ncur_rows = LENGTH(R_cur);
+    cur_rows = INTEGER(R_cur);
+    memcpy(&(groups->rows[groups->offsets[j]]), cur_rows, ncur_rows*sizeof(int));
+    for (i = 0; i < ncur_rows; i++){
+      if (cur_rows[i] < 0 || cur_rows[i] == NA_INTEGER){
+	probe_group_index_free(groups);
+	error("row indices should be non-negative");
+      }
+      if (cur_rows[i] >= groups->nrows){
+	groups->nrows = cur_rows[i] + 1;
+      }
+    }
+    groups->offsets[j+1] = groups->offsets[j] + ncur_rows;
+  }
+
+  *temporary = 1;
+  return groups;
+}
+
+
+
+#ifdef USE_PTHREADS
+
+/*********************************************************************
+ **
+ ** int probe_group_num_threads(void)
+ **
+ ** returns the number of worker threads asked for by the R_THREADS
+ ** environment variable (1 if it is not set). A value that is not a
+ ** positive integer is an error, so call this before allocating any
+ ** probe groups or output buffers: error() does not return and anything
+ ** already R_Calloc'd would leak.
+ **
+ *********************************************************************/
+
+int probe_group_num_threads(void){
+
+  char *nthreads = getenv("R_THREADS");
+  int num_threads = 1;
+
+  if (nthreads != NULL){
+    num_threads = atoi(nthreads);
+    if (num_threads <= 0){
+      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", "R_THREADS", nthreads);
+    }
+  }
+  return num_threads;
+}
+
+
+/*********************************************************************
+ **
+ ** Scheduling groups over threads
+ **
+ ** Probeset sizes are very uneven (most have 11 or so probes, a few have
+ ** hundreds or thousands) so giving each thread an equal count of
+ ** consecutive groups leaves the threads that got the big groups running
+ ** long after the rest have finished. Instead the groups are cut into
+ ** blocks of consecutive groups and each thread repeatedly takes the
+ ** next block off a shared counter until none are left. Blocks are
+ ** handed out most expensive first, so the big groups are started early
+ ** and the small blocks at the end fill in the gaps.
+ **
+ ** The cost of a block is the sum over its groups of (number of
+ ** rows)^cost_power. Use 1 for summaries whose work is linear in the
+ ** group size and 2 for model fits (eg rlm) that grow faster.
+ **
+ ** Blocks stay consecutive so callers can still store results a block
+ ** at a time.
+ **
+ *********************************************************************/
+
+void probe_group_schedule_init(struct probe_group_schedule *schedule, struct probe_group_index *groups, int num_threads, int max_block_size, int cost_power){
+
+  int ngroups = groups->ngroups;
+  int block_size;
+  int b, j, start, end;
+  double n, *cost;
+
+  /* aim for several blocks per thread, so there is something left to even out the load at the end */
+  block_size = ngroups/(4*(num_threads > 0 ? num_threads : 1));
+  if (block_size > max_block_size){
+    block_size = max_block_size;
+  }
+  if (block_size < 1){
+    block_size = 1;
+  }
+
+  schedule->block_size = block_size;
+  schedule->nblocks = (ngroups + block_size - 1)/block_size;
+  schedule->order = R_Calloc((schedule->nblocks > 0 ? schedule->nblocks : 1), int);
+  schedule->next = 0;
+#ifndef __GNUC__
+  pthread_mutex_init(&schedule->lock, NULL);
+#endif
+
+  cost = R_Calloc((schedule->nblocks > 0 ? schedule->nblocks : 1), double);
+  for (b = 0; b < schedule->nblocks; b++){
+    start = b*block_size;
+    end = (start + block_size < ngroups ? start + block_size : ngroups);
+    for (j = start; j < end; j++){
+      n = (double)(groups->offsets[j+1] - groups->offsets[j]);
+      cost[b] += (cost_power == 2 ? n*n : n);
+    }
+    schedule->order[b] = b;
+  }
+  revsort(cost, schedule->order, schedule->nblocks);
+  R_Free(cost);
+}
+
+
+/*********************************************************************
+ **
+ ** int probe_group_schedule_next(struct probe_group_schedule *schedule, int ngroups, int *start_row, int *end_row)
+ **
+ ** takes the next block. On return groups *start_row to *end_row
+ ** (inclusive) belong to the calling thread. Returns 0 once all the
+ ** blocks have been handed out. Safe to call from several threads at once.
+ **
+ *********************************************************************/
+
+int probe_group_schedule_next(struct probe_group_schedule *schedule, int ngroups, int *start_row, int *end_row){
+
+  int pos;
+
+#ifdef __GNUC__
+  pos = __atomic_fetch_add(&schedule->next, 1, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&schedule->lock);
+  pos = schedule->next++;
+  pthread_mutex_unlock(&schedule->lock);
+#endif
+
+  if (pos >= schedule->nblocks){
+    return 0;
+  }
+
+  *start_row = schedule->order[pos]*schedule->block_size;
+  *end_row = *start_row + schedule->block_size - 1;
+  if (*end_row >= ngroups){
+    *end_row = ngroups - 1;
+  }
+  return 1;
+}
+
+
+void probe_group_schedule_free(struct probe_group_schedule *schedule){
+
+  R_Free(schedule->order);
+#ifndef __GNUC__
+  pthread_mutex_destroy(&schedule->lock);
+#endif
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PROBE_GROUP_INDEX_H
+#define PROBE_GROUP_INDEX_H 1
+
+#include <Rinternals.h>
+
+/*
+  probe groups (eg probesets) in compressed sparse row form. The rows of
+  group j are rows[offsets[j]] ... rows[offsets[j+1]-1]
+*/
+
+struct probe_group_index{
+  int ngroups;     /* number of groups */
+  int nrows;       /* largest row index + 1 */
+  int *offsets;    /* length ngroups + 1 */
+  int *rows;       /* length offsets[ngroups] */
+};
+
+SEXP R_probe_group_index(SEXP R_group_codes, SEXP R_group_names, SEXP R_sort_by_first_row);
+
+struct probe_group_index *probe_group_index_get(SEXP R_rowIndexList, int *temporary);
+void probe_group_index_free(struct probe_group_index *groups);
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+
+/*
+  hands out blocks of consecutive groups to worker threads, the most
+  expensive blocks (by number of rows) first
+*/
+
+struct probe_group_schedule{
+  int block_size;  /* groups per block (the last block may be shorter) */
+  int nblocks;     /* number of blocks */
+  int *order;      /* blocks in the order they are handed out */
+  int next;        /* position in order of the next block to hand out */
+#ifndef __GNUC__
+  pthread_mutex_t lock;
+#endif
+};
+
+int probe_group_num_threads(void);
+void probe_group_schedule_init(struct probe_group_schedule *schedule, struct probe_group_index *groups, int num_threads, int max_block_size, int cost_power);
+int probe_group_schedule_next(struct probe_group_schedule *schedule, int ngroups, int *start_row, int *end_row);
+void probe_group_schedule_free(struct probe_group_schedule *schedule);
+#endif
+
+#endif
@@ -16,6 +16,9 @@
  **                add fair, Cauchy, Geman-McClure, Welsch and Tukey
  ** Jun 03, 2003 - add Andrews and some NOTES/WARNINGS.
  ** Jun 04, 2003 - a mechanism for selecting a psi function
+ ** Oct 18, 2026 - add array versions of each psi function (selected once per fit
+ **                by PsiFuncArray) so the IRLS loops do not make an indirect call 
+ **                per residual
  **
  ********************************************************************/
 
@@ -50,6 +53,7 @@
  ********************************************************************/
 
 #include "psi_fns.h"
+#include <stddef.h>
 #include <math.h>
 #include <Rmath.h>
 
@@ -290,3 +294,245 @@ pt2psi PsiFunc(int code){
 
   return psifuncArr[code];
 }
+
+
+
+/*********************************************************************
+ **
+ ** array versions of the psi functions
+ **
+ ** void psi_xxx_array(pt2psi PsiFn, const double *r, size_t n, double scale, 
+ **                    double k, int deriv, double *out)
+ **
+ ** pt2psi PsiFn - the scalar psi function (only used by psi_generic_array)
+ ** const double *r - residuals
+ ** size_t n - length of r and out
+ ** double scale - scale estimate, the psi function is evaluated at r[i]/scale
+ ** double k - tuning constant
+ ** int deriv - as for the scalar functions
+ ** double *out - on output out[i] = psi_xxx(r[i]/scale, k, deriv)
+ **
+ ** Each gives exactly the same values as the scalar function, but the choice
+ ** of deriv is made once per call and the loops have no calls (other than
+ ** exp, sin and cos) so the compiler can vectorize them. As with log2_kernel
+ ** in rma_common.c an AVX2 clone is built where the toolchain supports it.
+ ** no-trapping-math lets the branches be turned into selects; it does not 
+ ** change any of the values computed.
+ **
+ *********************************************************************/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__GLIBC__)
+#define PSI_KERNEL_ATTRIBUTES __attribute__((target_clones("avx2","default"), optimize("tree-vectorize","no-trapping-math")))
+#else
+#define PSI_KERNEL_ATTRIBUTES
+#endif
+
+
+static void psi_generic_array(pt2psi PsiFn, const double *r, size_t n, double scale, double k, int deriv, double *out){
+  size_t i;
+  
+  for (i=0; i < n; i++){
+    out[i] = PsiFn(r[i]/scale, k, deriv);
+  }
+}
+
+
+PSI_KERNEL_ATTRIBUTES
+static void psi_huber_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u, a;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      a = k/fabs(r[i]/scale);
+      out[i] = (1 < a) ? 1.0 : a;
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      out[i] = (fabs(r[i]/scale) <= k) ? 1.0 : 0.0;
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (fabs(u) <= k) ? u : ((u < 0) ? -k : k);
+    }
+  }
+}
+
+
+PSI_KERNEL_ATTRIBUTES
+static void psi_fair_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = 1.0/(1.0+fabs(u)/k);
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (u >= 0) ? 1.0/(1.0+fabs(u)/k) - u/(k*(1.0+fabs(u)/k)*(1.0+fabs(u)/k)) : 1.0/(1.0+fabs(u)/k) + u/(k*(1.0+fabs(u)/k)*(1.0+fabs(u)/k));
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = u/(1.0+fabs(u)/k);
+    }
+  }
+}
+
+
+PSI_KERNEL_ATTRIBUTES
+static void psi_cauchy_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = 1.0/(1.0+(u/k)*(u/k));
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = k*k*(k*k - u*u)/((k*k+u*u)*(k*k+u*u));
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = u/(1.0+(u/k)*(u/k));
+    }
+  }
+}
+
+
+PSI_KERNEL_ATTRIBUTES
+static void psi_GemanMcClure_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = 1.0/((1.0 + u*u)*(1.0 + u*u));
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (1.0 - 3.0*u*u)/((1.0+u*u)*(1.0+u*u)*(1.0+u*u));
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = u/((1.0 + u*u)*(1.0 + u*u));
+    }
+  }
+}
+
+
+static void psi_Welsch_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = exp(-(u/k)*(u/k));
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = exp(-(u/k)*(u/k))*(1 - 2.0*(u*u)/(k*k));
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = u*exp(-(u/k)*(u/k));
+    }
+  }
+}
+
+
+PSI_KERNEL_ATTRIBUTES
+static void psi_Tukey_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u, v;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      v = 1.0 - (u/k)*(u/k);   /* computed outside the condition so the loop vectorizes */
+      out[i] = (fabs(u) <= k) ? pow(v,2.0) : 0.0;
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      v = (1.0 - (u/k)*(u/k))*(1.0-5.0*(u/k)*(u/k));
+      out[i] = (fabs(u) <= k) ? v : 0.0;
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      v = u*(1.0 - (u/k)*(u/k))* (1.0 - (u/k)*(u/k));
+      out[i] = (fabs(u) <= k) ? v : 0.0;
+    }
+  }
+}
+
+
+static void psi_Andrews_array(pt2psi PsiFn, const double * restrict r, size_t n, double scale, double k, int deriv, double * restrict out){
+  size_t i;
+  double u;
+  
+  if (deriv == 0){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (fabs(u) <= k*M_PI) ? sin(u/k)/(u/k) : 0.0;
+    }
+  } else if (deriv == 1){
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (fabs(u) <= k*M_PI) ? cos(u/k) : 0.0;
+    }
+  } else {
+    for (i=0; i < n; i++){
+      u = r[i]/scale;
+      out[i] = (fabs(u) <= k*M_PI) ? k*sin(u/k) : 0.0;
+    }
+  }
+}
+
+
+/*********************************************************************
+ **
+ ** pt2psi_array PsiFuncArray(pt2psi PsiFn)
+ **
+ ** returns the array version of PsiFn. Psi functions other than those
+ ** above (eg supplied by another package) get a loop calling PsiFn. 
+ ** Meant to be called once per fit, then used as
+ **
+ **    PsiArray(PsiFn, resids, n, scale, psi_k, 0, weights);
+ **
+ *********************************************************************/
+
+pt2psi_array PsiFuncArray(pt2psi PsiFn){
+
+  if (PsiFn == &psi_huber){
+    return &psi_huber_array;
+  } else if (PsiFn == &psi_fair){
+    return &psi_fair_array;
+  } else if (PsiFn == &psi_cauchy){
+    return &psi_cauchy_array;
+  } else if (PsiFn == &psi_GemanMcClure){
+    return &psi_GemanMcClure_array;
+  } else if (PsiFn == &psi_Welsch){
+    return &psi_Welsch_array;
+  } else if (PsiFn == &psi_Tukey){
+    return &psi_Tukey_array;
+  } else if (PsiFn == &psi_Andrews){
+    return &psi_Andrews_array;
+  }
+  return &psi_generic_array;
+}
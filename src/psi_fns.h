@@ -1,6 +1,8 @@
 #ifndef PSI_FNS_H
 #define PSI_FNS_H
 
+#include <stddef.h>
+
 double psi_huber(double u, double k,int deriv);
 double psi_fair(double u, double k,int deriv);
 double psi_cauchy(double u, double k,int deriv);
@@ -12,6 +14,11 @@ double psi_Andrews(double u, double k,int deriv);
 typedef double (*pt2psi)(double , double , int);
 
 pt2psi PsiFunc(int code);
+
+/* out[i] = PsiFn(r[i]/scale, k, deriv) for i < n, see PsiFuncArray() in psi_fns.c */
+typedef void (*pt2psi_array)(pt2psi PsiFn, const double *r, size_t n, double scale, double k, int deriv, double *out);
+
+pt2psi_array PsiFuncArray(pt2psi PsiFn);
 int psi_code(char *Name);
 
 
@@ -66,6 +66,7 @@
  ** Jan 15, 2009 - fix VECTOR_ELT/STRING_ELT issues
  ** Dec 1, 2010 - change how  PTHREAD_STACK_MIN is used
  ** Jan 5, 2011 - use_target issue when target distribution length != nrow(x) fixed
+ ** Oct 18, 2026 - med_abs in qnorm_robust_c reuses one scratch buffer rather than allocating on each call
  **
  ***********************************************************/
 
@@ -363,27 +364,23 @@ static double weights_huber(double u, double k){
 
 /**************************************************************************
  **
- ** static double med_abs(double *x, int length)
+ ** static double med_abs(double *x, int length, double *buffer)
  **
  ** double *x - a data vector
  ** int length - length of x
+ ** double *buffer - scratch space of length at least length
  **
  ** Compute the median absolute value of a data vector
  **
  *************************************************************************/
 
-static double med_abs(double *x, int length){
+static double med_abs(double *x, int length, double *buffer){
   int i;
-  double med_abs;
-  double *buffer = R_Calloc(length,double);
 
   for (i = 0; i < length; i++)
     buffer[i] = fabs(x[i]);
 
-  med_abs = median_nocopy(buffer,length);
-
-  R_Free(buffer);
-  return(med_abs);
+  return median_nocopy(buffer,length);
 }
 
 
@@ -737,6 +734,7 @@ int qnorm_robust_c(double *data,double *weights, int *rows, int *cols, int *use_
   dataitem **dimat;
   double *row_mean = (double *)R_Calloc((*rows),double);
   double *datvec=0; /* = (double *)R_Calloc(*cols,double); */
+  double *absbuf=0; /* scratch for med_abs */
   double *ranks = (double *)R_Calloc((*rows),double);
   
   double sum_weights = 0.0;
@@ -795,6 +793,7 @@ int qnorm_robust_c(double *data,double *weights, int *rows, int *cols, int *use_
     dimat = get_di_matrix(data, *rows, *cols);
    
     datvec = R_Calloc(*cols,double);
+    absbuf = R_Calloc(*cols,double);
     
     for (j=0; j < *cols; j++){
       qsort(dimat[j],*rows,sizeof(dataitem),sort_fn);
@@ -816,7 +815,7 @@ int qnorm_robust_c(double *data,double *weights, int *rows, int *cols, int *use_
 	  for (j=0; j < *cols; j++){
 	    datvec[j] = datvec[j] - mean;
 	  }
-	  scale = med_abs(datvec,*cols)/0.6745;
+	  scale = med_abs(datvec,*cols,absbuf)/0.6745;
 	  if (scale == 0.0){
 	    break;
 	  }
@@ -853,7 +852,7 @@ int qnorm_robust_c(double *data,double *weights, int *rows, int *cols, int *use_
 	  for (j=0; j < *cols; j++){
 	    datvec[j] = datvec[j] - mean;
 	  }
-	  scale = med_abs(datvec,*cols)/0.6745;
+	  scale = med_abs(datvec,*cols,absbuf)/0.6745;
 	  if (scale == 0.0){
 	    break;
 	  }
@@ -881,6 +880,7 @@ int qnorm_robust_c(double *data,double *weights, int *rows, int *cols, int *use_
     }
     
     R_Free(dimat);
+    R_Free(absbuf);
 
 
 
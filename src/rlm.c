@@ -42,6 +42,14 @@
  ** July 26, 2004 - rlm_wfit added
  ** Mar 1, 2006 - change all comments to ansi style
  ** May 27, 2007 - clean up code for inclusion in preprocessCore
+ ** Oct 18, 2026 - add med_abs_buffer, IRLS loops compute the scale using 
+ **                old_resids as scratch (it is refilled straight afterwards)
+ ** Oct 18, 2026 - rlm_fit and rlm_wfit allocate the least squares scratch once per 
+ **                fit (lm_wfit_ws) rather than in every iteration
+ ** Oct 18, 2026 - add irls_delta_abs. rlm_fit and rlm_wfit swap the residual buffers
+ **                rather than copying, the scale comes straight from the absolute
+ **                residuals left by the convergence check
+ ** Oct 18, 2026 - med_abs copies short vectors onto the stack rather than allocating
  **
  ********************************************************************/
 
@@ -99,6 +107,41 @@ double irls_delta(double *old, double *new, int length){
 } 
 
 
+/***************************************************************
+ **
+ ** double irls_delta_abs(double *old, double *new, int length)
+ **
+ ** double *old - previous value of a vector, on output the absolute values of new
+ ** double *new - new value of a vector
+ ** int length - length of vector
+ **
+ ** as irls_delta(), but in the same pass old is overwritten by the 
+ ** absolute values of new, ready for the next scale estimate 
+ ** (median_nocopy(old,length)/0.6745). Used so that the IRLS loops
+ ** can swap residual buffers rather than copy them.
+ **
+ **************************************************************/
+
+double irls_delta_abs(double *old, double *new, int length){
+  int i=0;
+  double sum = 0.0;
+  double sum2 =0.0;
+  double divisor=1e-20;
+
+  for (i=0; i < length; i++){
+    sum = sum + (old[i] - new[i])*(old[i]-new[i]);
+    sum2 = sum2 + old[i]*old[i];
+    old[i] = fabs(new[i]);
+  }
+  
+  if(sum2 >= divisor){
+    divisor = sum2;
+  }
+
+  return sqrt(sum/divisor); 
+} 
+
+
 /****************************************************************
  **
  ** This function is another method for computing convergence in the
@@ -172,25 +215,52 @@ double irls_delta(double *old, double *new, int length){
  ** 
  ** returns the median of the absolute values.
  **
- ** computes the median of the absolute values of a given vector.
+ ** computes the median of the absolute values of a given vector. Short
+ ** vectors (MED_ABS_STACK or fewer values) are copied onto the stack.
  **
  **********************************************************************************/
 
+#define MED_ABS_STACK 64
+
 double med_abs(double *x, int length){
-  int i;
   double med_abs;
-  double *buffer = R_Calloc(length,double);
+  double small[MED_ABS_STACK];
+  double *buffer = small;
 
-  for (i = 0; i < length; i++)
-    buffer[i] = fabs(x[i]);
+  if (length > MED_ABS_STACK)
+    buffer = R_Calloc(length,double);
   
-  med_abs = median(buffer,length);
+  med_abs = med_abs_buffer(x, length, buffer);
     
-  R_Free(buffer);
+  if (buffer != small)
+    R_Free(buffer);
   return(med_abs);
 }
 
 
+/**********************************************************************************
+ **
+ ** double med_abs_buffer(double *x, int length, double *buffer)
+ **
+ ** double *x - a vector of data
+ ** int length - length of the vector.
+ ** double *buffer - scratch space of at least length doubles. Overwritten.
+ ** 
+ ** returns the median of the absolute values. Same as med_abs() but without 
+ ** allocating, for use inside iterative fitting loops.
+ **
+ **********************************************************************************/
+
+double med_abs_buffer(double *x, int length, double *buffer){
+  int i;
+
+  for (i = 0; i < length; i++)
+    buffer[i] = fabs(x[i]);
+  
+  return median_nocopy(buffer,length);
+}
+
+
 /**********************************************************************************
  **
  ** void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double *out_resids, double *out_weights)
@@ -224,9 +294,14 @@ void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double
 
 
   double *wts = out_weights; 
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
   double *beta = out_beta; 
   double *resids = out_resids; 
-  double *old_resids = R_Calloc(rows,double);
+  double *abs_resids = R_Calloc(rows,double);   /* |resids| for the scale estimate, then the next residuals */
+  double *scratch = abs_resids;
+  double *swap;
+  double *lm_work = R_Calloc(LM_WFIT_WORK(rows, cols),double);   /* scratch for each weighted least squares step */
+  int *lm_jpvt = R_Calloc(cols,int);
   
 
 
@@ -241,7 +316,7 @@ void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double
     /* get our intial beta estimates by standard linear regression */
     
     
-    lm_wfit(x, y, wts, rows, cols, tol, beta, resids);
+    lm_wfit_ws(x, y, wts, rows, cols, tol, beta, resids, lm_work, lm_jpvt);
   }
   /* printf("%f %f %f\n",beta[0],beta[1],beta[2]); */
 
@@ -255,29 +330,30 @@ void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double
     gamma <- theta + k2^2 * (1 - theta) - 2 * k2 * dnorm(k2)
   */
 
+  for (i=0; i < rows; i++){
+    abs_resids[i] = fabs(resids[i]);
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
 
     if (fabs(scale) < 1e-10){
       /*printf("Scale too small \n"); */
       break;
     }
     
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
-    for (i=0; i < rows; i++){
-      wts[i] = PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
-    }
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
    
-    lm_wfit(x, y, wts, rows, cols, tol, beta, resids);
+    lm_wfit_ws(x, y, wts, rows, cols, tol, beta, abs_resids, lm_work, lm_jpvt);
 
 
-    /*check convergence  based on residuals */
+    /*check convergence  based on residuals, the old residuals become the absolute values of the new ones */
     
-    conv = irls_delta(old_resids,resids, rows);
+    conv = irls_delta_abs(resids, abs_resids, rows);
+    swap = resids;
+    resids = abs_resids;
+    abs_resids = swap;
 
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -298,7 +374,15 @@ void rlm_fit(double *x, double *y, int rows, int cols, double *out_beta, double
 
 
 
-  R_Free(old_resids);
+  if (resids != out_resids){
+    for (i=0; i < rows; i++){
+      out_resids[i] = resids[i];
+    }
+  }
+
+  R_Free(scratch);
+  R_Free(lm_work);
+  R_Free(lm_jpvt);
 }
 
 
@@ -367,9 +451,14 @@ void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_b
 
 
   double *wts = out_weights;
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
   double *beta = out_beta; 
   double *resids = out_resids; 
-  double *old_resids = R_Calloc(rows,double);
+  double *abs_resids = R_Calloc(rows,double);   /* |resids| for the scale estimate, then the next residuals */
+  double *scratch = abs_resids;
+  double *swap;
+  double *lm_work = R_Calloc(LM_WFIT_WORK(rows, cols),double);   /* scratch for each weighted least squares step */
+  int *lm_jpvt = R_Calloc(cols,int);
   
 
 
@@ -384,7 +473,7 @@ void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_b
     /* get our intial beta estimates by standard linear regression */
     
     
-    lm_wfit(x, y, wts, rows, cols, tol, beta, resids);
+    lm_wfit_ws(x, y, wts, rows, cols, tol, beta, resids, lm_work, lm_jpvt);
   }
   /* printf("%f %f %f\n",beta[0],beta[1],beta[2]); */
 
@@ -398,29 +487,33 @@ void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_b
     gamma <- theta + k2^2 * (1 - theta) - 2 * k2 * dnorm(k2)
   */
 
+  for (i=0; i < rows; i++){
+    abs_resids[i] = fabs(resids[i]);
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
 
     if (fabs(scale) < 1e-10){
       /*printf("Scale too small \n"); */
       break;
     }
     
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
     for (i=0; i < rows; i++){
-      wts[i] = w[i]*PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
+      wts[i] = w[i]*wts[i];
     }
    
-    lm_wfit(x, y, wts, rows, cols, tol, beta, resids);
+    lm_wfit_ws(x, y, wts, rows, cols, tol, beta, abs_resids, lm_work, lm_jpvt);
 
 
-    /*check convergence  based on residuals */
+    /*check convergence  based on residuals, the old residuals become the absolute values of the new ones */
     
-    conv = irls_delta(old_resids,resids, rows);
+    conv = irls_delta_abs(resids, abs_resids, rows);
+    swap = resids;
+    resids = abs_resids;
+    abs_resids = swap;
 
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -441,7 +534,15 @@ void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_b
 
 
 
-  R_Free(old_resids);
+  if (resids != out_resids){
+    for (i=0; i < rows; i++){
+      out_resids[i] = resids[i];
+    }
+  }
+
+  R_Free(scratch);
+  R_Free(lm_work);
+  R_Free(lm_jpvt);
 }
 
 
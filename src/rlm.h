@@ -8,7 +8,18 @@ void rlm_wfit(double *x, double *y, double *w, int rows, int cols, double *out_b
 
 
 double med_abs(double *x, int length);
+double med_abs_buffer(double *x, int length, double *buffer);
 double irls_delta(double *old, double *new, int length);
+double irls_delta_abs(double *old, double *new, int length);
+
+/* workspace needed by rlm_anova_wls() */
+#define RLM_ANOVA_WLS_WORK(y_rows, y_cols) ((size_t)(y_rows)*(y_rows) + 5*(size_t)(y_rows) + (y_cols))
+
+void rlm_anova_wls(double *y, int y_rows, int y_cols, double *wts, double *out_beta, double *work);
+double rlm_anova_resids(double *y, int y_rows, int y_cols, double *beta, double *resids, double *abs_resids);
+
+/* workspace needed by rlm_fit_anova_scale_ws() and rlm_wfit_anova_scale_ws() */
+#define RLM_FIT_ANOVA_WORK(y_rows, y_cols) ((size_t)(y_rows)*(y_cols) + (y_rows) + RLM_ANOVA_WLS_WORK(y_rows, y_cols))
 
 void rlm_fit_anova(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
 
@@ -18,6 +29,12 @@ void rlm_wfit_anova(double *y, int y_rows, int y_cols, double *w, double *out_be
 
 void rlm_wfit_anova_scale(double *y, int y_rows, int y_cols,  double *scale,double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
 
+void rlm_fit_anova_scale_ws(double *y, int y_rows, int y_cols, double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work);
+
+int rlm_fit_anova_control(double *y, int y_rows, int y_cols, double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work);
+
+void rlm_wfit_anova_scale_ws(double *y, int y_rows, int y_cols,  double *scale,double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work);
+
 void rlm_fit_anova_given_probe_effects(double *y, int y_rows, int y_cols, double *probe_effects, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
 
 void rlm_wfit_anova_given_probe_effects(double *y, int y_rows, int y_cols, double *probe_effects, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized);
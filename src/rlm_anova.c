@@ -25,6 +25,20 @@
  ** Apr 23, 2009 - Allow scale estimate to be specified or returned in rlm_fit_anova
  ** Apr 24, 2009 - Allow scale estimate to be specified or returned in rlm_wfit_anova, rlm_fit_anova_given_probe_effects
  ** Apr 29, 2009 - Ensure that compute scale corresponds to final computed scale estimate
+ ** Oct 18, 2026 - scale estimates use med_abs_buffer with scratch allocated once per fit
+ ** Oct 18, 2026 - the IRLS steps solve through the probe Schur complement by Choleski
+ **                (rlm_anova_wls) rather than inverting all of XTWX. The inverse is
+ **                now only formed when computing standard errors
+ ** Oct 18, 2026 - add rlm_fit_anova_scale_ws, rlm_wfit_anova_scale_ws and
+ **                rlm_compute_se_anova_ws which take their scratch space from
+ **                the caller
+ ** Oct 18, 2026 - add rlm_fit_anova_control which can start the IRLS from a median polish
+ **                fit and returns the number of iterations
+ ** Oct 18, 2026 - the IRLS loops compute the residuals, convergence measure and absolute
+ **                residuals in one pass (rlm_anova_resids), the scale estimate selects
+ **                directly from those, so the previous residuals are no longer copied
+ ** Oct 18, 2026 - psi functions are applied to whole vectors (PsiFuncArray) in the IRLS
+ **                loops and in rlm_compute_se_anova_ws
  **
  *********************************************************************/
 
@@ -33,6 +47,7 @@
 #include "matrix_functions.h"
 #include "rlm.h"
 #include "rlm_se.h"
+#include "rma_common.h"
 
 #include <R_ext/Rdynload.h>
 #include <R.h>
@@ -44,6 +59,8 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "medianpolish.h"
+
 
 
 static void XTWY(int y_rows, int y_cols, double *wts,double *y, double *xtwy){
@@ -169,14 +186,26 @@ This is R test code
 
 *************/
 
-static void XTWXinv(int y_rows, int y_cols,double *xtwx){
+/*************************************************************************************
+ **
+ ** static void XTWXinv_ws(int y_rows, int y_cols, double *xtwx, double *ws)
+ **
+ ** inverts xtwx (as computed by XTWX()) in place using its block structure. 
+ ** double *ws is scratch space of length XTWXINV_WORK(y_rows, y_cols)
+ **
+ *************************************************************************************/
+
+static void XTWXinv_ws(int y_rows, int y_cols,double *xtwx, double *ws){
   int i,j,k;
   int Msize = y_cols +y_rows-1;
-  double *P= R_Calloc(y_cols,double);
-  double *RP = R_Calloc(y_cols*(y_rows-1),double);
-  double *RPQ = R_Calloc((y_rows-1)*(y_rows-1),double);
-  double *S = R_Calloc((y_rows-1)*(y_rows-1),double);
-  double *work = R_Calloc((y_rows-1)*(y_rows-1),double);
+  double *P= ws;
+  double *RP = &P[y_cols];
+  double *RPQ = &RP[y_cols*(y_rows-1)];
+  double *S = &RPQ[(y_rows-1)*(y_rows-1)];
+  double *work = &S[(y_rows-1)*(y_rows-1)];
+
+  memset(RPQ, 0, (y_rows-1)*(y_rows-1)*sizeof(double));
+  memset(S, 0, (y_rows-1)*(y_rows-1)*sizeof(double));
   
   for (j=0;j < y_cols;j++){
     for (i=0; i < y_rows -1; i++){
@@ -265,13 +294,16 @@ static void XTWXinv(int y_rows, int y_cols,double *xtwx){
     }
   }
 
+}
 
-  R_Free(P);
-  R_Free(work);
-  R_Free(RP);
-  R_Free(RPQ);
-  R_Free(S);
 
+static void XTWXinv(int y_rows, int y_cols,double *xtwx){
+
+  double *ws = R_Calloc(XTWXINV_WORK(y_rows, y_cols),double);
+
+  XTWXinv_ws(y_rows, y_cols, xtwx, ws);
+
+  R_Free(ws);
 }
 
 
@@ -333,29 +365,256 @@ R%*%solve(P)
 
 
 
-static void rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *input_scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
+/*************************************************************************************
+ **
+ ** static int XTWX_solve(int y_rows, int y_cols, double *wts, double *xtwy, double *beta, 
+ **                       double *schur, double *r)
+ **
+ ** int y_rows, y_cols - dimensions of the data matrix (probes by chips)
+ ** double *wts - weights, same dimensions as data matrix
+ ** double *xtwy - as computed by XTWY()
+ ** double *beta - on output the solution of XTWX beta = xtwy (chip effects then probe effects)
+ ** double *schur - workspace of length (y_rows-1)*(y_rows-1)
+ ** double *r - workspace of length XTWX_SOLVE_BLOCK*y_rows
+ **
+ ** RETURNS 0 on success, non zero if the system could not be solved this way 
+ **
+ ** Partition XTWX (see XTWX() above) as
+ **
+ **       | P  R'|      P diagonal (chips),  R (y_rows-1) by y_cols, 
+ **       | R  S |      S (y_rows-1) by (y_rows-1)
+ **
+ ** The probe effects solve (S - R P^{-1} R') b = xtwy_probes - R P^{-1} xtwy_chips, which
+ ** is done by Choleski, then the chip effects are P^{-1}(xtwy_chips - R' b). Unlike
+ ** XTWXinv() neither XTWX nor its inverse is formed, only the small probe by probe
+ ** Schur complement. R is never stored, each column is just the difference between
+ ** the weights of a chip and the weight of its last probe.
+ **
+ *************************************************************************************/
+
+#define XTWX_SOLVE_BLOCK 4
+
+static int XTWX_solve(int y_rows, int y_cols, double *wts, double *xtwy, double *beta, double *schur, double *r){
+
+  int i,j,k,c,nb;
+  int p = y_rows - 1;
+  double *w, *b = &beta[y_cols];
+  double Pinv[XTWX_SOLVE_BLOCK], rk[XTWX_SOLVE_BLOCK];
+  double lastw, sumlast = 0.0, sum;
+  
+  for (k=0; k < p; k++){
+    for (i=0; i <= k; i++){
+      schur[k*p + i] = 0.0;
+    }
+    b[k] = xtwy[y_cols + k];
+  }
+
+  /* subtract R P^{-1} R' from S a few chips at a time (only the upper triangle is needed) */
+  for (j=0; j < y_cols; j+=XTWX_SOLVE_BLOCK){
+    nb = (y_cols - j < XTWX_SOLVE_BLOCK ? y_cols - j : XTWX_SOLVE_BLOCK);
+    for (c=0; c < nb; c++){
+      w = &wts[(j+c)*y_rows];
+      lastw = w[p];
+      sumlast += lastw;
+      sum = 0.0;
+      for (i=0; i < y_rows; i++){
+	sum += w[i];
+      }
+      Pinv[c] = 1.0/sum;
+      for (i=0; i < p; i++){
+	r[c*p + i] = w[i] - lastw;
+	schur[i*p + i] += w[i];
+	b[i] -= r[c*p + i]*xtwy[j+c]*Pinv[c];
+      }
+    }
+    if (nb == XTWX_SOLVE_BLOCK){
+      for (k=0; k < p; k++){
+	rk[0] = r[k]*Pinv[0];
+	rk[1] = r[p + k]*Pinv[1];
+	rk[2] = r[2*p + k]*Pinv[2];
+	rk[3] = r[3*p + k]*Pinv[3];
+	for (i=0; i <= k; i++){
+	  schur[k*p + i] -= r[i]*rk[0] + r[p + i]*rk[1] + r[2*p + i]*rk[2] + r[3*p + i]*rk[3];
+	}
+      }
+    } else {
+      for (c=0; c < nb; c++){
+	for (k=0; k < p; k++){
+	  rk[0] = r[c*p + k]*Pinv[c];
+	  for (i=0; i <= k; i++){
+	    schur[k*p + i] -= r[c*p + i]*rk[0];
+	  }
+	}
+      }
+    }
+  }
+
+  for (k=0; k < p; k++){
+    for (i=0; i <= k; i++){
+      schur[k*p + i] += sumlast;
+    }
+  }
+
+  if (p > 0 && Choleski_solve(schur, b, p)){
+    return 1;
+  }
+
+  /* back substitute for the chip effects */
+  for (j=0; j < y_cols; j++){
+    w = &wts[j*y_rows];
+    lastw = w[p];
+    sum = w[p];
+    beta[j] = xtwy[j];
+    for (i=0; i < p; i++){
+      sum += w[i];
+      beta[j] -= (w[i] - lastw)*b[i];
+    }
+    beta[j]/=sum;
+  }
+  return 0;
+}
+
+
+/*************************************************************************************
+ **
+ ** void rlm_anova_wls(double *y, int y_rows, int y_cols, double *wts, double *out_beta, double *work)
+ **
+ ** double *y - matrix of response variables (stored by column, with rows probes, columns chips)
+ ** int y_rows, y_cols - dimensions of y
+ ** double *wts - weights, same dimensions as y
+ ** double *out_beta - on output the weighted least squares estimates of the probes + chips 
+ **                    model (chip effects then the first y_rows-1 probe effects)
+ ** double *work - workspace of length RLM_ANOVA_WLS_WORK(y_rows, y_cols)
+ **
+ ** One weighted least squares step of the IRLS for the probes + chips model. Solved with
+ ** XTWX_solve(), falling back on the full inverse (as before) when the Schur 
+ ** complement is not numerically positive definite.
+ **
+ *************************************************************************************/
+
+void rlm_anova_wls(double *y, int y_rows, int y_cols, double *wts, double *out_beta, double *work){
+
+  int i,j;
+  double *xtwy = work;
+  double *r = &work[y_rows + y_cols];
+  double *schur = &r[XTWX_SOLVE_BLOCK*y_rows];
+  double *xtwx;
+
+  XTWY(y_rows, y_cols, wts, y, xtwy);
+
+  if (XTWX_solve(y_rows, y_cols, wts, xtwy, out_beta, schur, r)){
+    xtwx = R_Calloc((y_rows+y_cols-1)*(y_rows+y_cols-1),double);
+    XTWX(y_rows,y_cols,wts,xtwx);
+    XTWXinv(y_rows, y_cols,xtwx);
+    for (i=0;i < y_rows+y_cols-1; i++){
+      out_beta[i] = 0.0;
+      for (j=0;j < y_rows+y_cols -1; j++){
+	out_beta[i] += xtwx[j*(y_rows+y_cols -1)+i]*xtwy[j];
+      }
+    }
+    R_Free(xtwx);
+  }
+}
+
+
+
+/*************************************************************************************
+ **
+ ** double rlm_anova_resids(double *y, int y_rows, int y_cols, double *beta, double *resids,
+ **                         double *abs_resids)
+ **
+ ** double *y - matrix of response variables (stored by column, with rows probes, columns chips)
+ ** int y_rows, y_cols - dimensions of y
+ ** double *beta - chip effects then the first y_rows-1 probe effects
+ ** double *resids - on input the residuals of the previous IRLS step, on output those of beta
+ ** double *abs_resids - if not NULL, on output the absolute values of the new residuals
+ **
+ ** RETURNS the IRLS convergence measure, the same value irls_delta() gives for the 
+ **         previous and new residuals
+ **
+ ** The residual, convergence and (for the next scale estimate) absolute residual passes
+ ** of an IRLS step for the probes + chips model, fused into one pass in storage order so
+ ** that no copy of the previous residuals is needed. The scale can then be taken as
+ ** median_nocopy(abs_resids)/0.6745 without another pass.
+ **
+ *************************************************************************************/
+
+double rlm_anova_resids(double *y, int y_rows, int y_cols, double *beta, double *resids, double *abs_resids){
+
+  int i,j;
+  double endprobe = 0.0;
+  double r, d;
+  double sum = 0.0, sum2 = 0.0;
+  double divisor = 1e-20;
+  double *yj, *rj;
+
+  for (i=0; i < y_rows-1; i++){
+    endprobe+= beta[i + y_cols];
+  }
+
+  for (j=0; j < y_cols; j++){
+    yj = &y[j*y_rows];
+    rj = &resids[j*y_rows];
+    for (i=0; i < y_rows-1; i++){
+      r = yj[i] - (beta[j] + beta[i + y_cols]);
+      d = rj[i] - r;
+      sum = sum + d*d;
+      sum2 = sum2 + rj[i]*rj[i];
+      rj[i] = r;
+    }
+    /* the last probe effect is minus the sum of the others */
+    r = yj[y_rows-1] - (beta[j] - endprobe);
+    d = rj[y_rows-1] - r;
+    sum = sum + d*d;
+    sum2 = sum2 + rj[y_rows-1]*rj[y_rows-1];
+    rj[y_rows-1] = r;
+    if (abs_resids != NULL){
+      for (i=0; i < y_rows; i++){
+	abs_resids[j*y_rows + i] = fabs(rj[i]);
+      }
+    }
+  }
+
+  if(sum2 >= divisor){
+    divisor = sum2;
+  }
+
+  return sqrt(sum/divisor);
+}
+
+
+
+static int rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *input_scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work){
 
 
   int i,j,iter;
+  int iterations = 0;
+  double intercept, meanrow;
   /* double tol = 1e-7; */
   double acc = 1e-4;
   double scale =0.0;
   double conv;
-  double endprobe;
 
   double *wts = out_weights; 
 
-  double *resids = out_resids; 
-  double *old_resids = R_Calloc(y_rows*y_cols,double);
-  
-  double *rowmeans = R_Calloc(y_rows,double);
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
 
-  double *xtwx = R_Calloc((y_rows+y_cols-1)*(y_rows+y_cols-1),double);
-  double *xtwy = R_Calloc((y_rows+y_cols),double);
+  double *resids = out_resids; 
+  double *abs_resids;   /* |resids| (in some order) for the scale estimate */
+  double *rowmeans;
+  double *wls_work;
+  int own_work = (work == NULL);
 
   double sumweights, rows;
   
   rows = y_rows*y_cols;
+
+  if (own_work){
+    work = R_Calloc(RLM_FIT_ANOVA_WORK(y_rows, y_cols),double);
+  }
+  abs_resids = work;
+  rowmeans = &abs_resids[y_rows*y_cols];
+  wls_work = &rowmeans[y_rows];
   
   if (!initialized){
     
@@ -372,46 +631,79 @@ static void rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *inpu
       resids[j*y_rows + i] = y[j*y_rows + i];
     }
   }
-  
-  /* sweep columns (ie chip effects) */
 
-  for (j=0; j < y_cols; j++){
-    out_beta[j] = 0.0;
-    sumweights = 0.0;
+  if (warm_start){
+    /* start from a median polish fit, y = t + r_i + c_j + e, put into the 
+       chips + probes (sum probes = 0) form. Residuals are those of the 
+       median polish and the first IRLS step computes the weights from them */
+
     for (i=0; i < y_rows; i++){
-      out_beta[j] += wts[j*y_rows + i]* resids[j*y_rows + i];
-      sumweights +=  wts[j*y_rows + i];
+      rowmeans[i] = 0.0;
     }
-    out_beta[j]/=sumweights;
+    for (j=0; j < y_cols; j++){
+      out_beta[j] = 0.0;
+    }
+    median_polish_fit_no_copy(resids, y_rows, y_cols, rowmeans, out_beta, &intercept);
+
+    meanrow = 0.0;
     for (i=0; i < y_rows; i++){
-      resids[j*y_rows + i] = resids[j*y_rows + i] -  out_beta[j];
+      meanrow += rowmeans[i];
     }
-  }
+    meanrow/=y_rows;
+    for (j=0; j < y_cols; j++){
+      out_beta[j] += intercept + meanrow;
+    }
+    for (i=0; i < y_rows-1; i++){
+      out_beta[i+y_cols] = rowmeans[i] - meanrow;
+    }
+  } else {
 
+    /* sweep columns (ie chip effects) */
 
- /* sweep rows  (ie probe effects) */
-  
-  for (i=0; i < y_rows; i++){
-    rowmeans[i] = 0.0;
-    sumweights = 0.0;
     for (j=0; j < y_cols; j++){
-      rowmeans[i] += wts[j*y_rows + i]* resids[j*y_rows + i]; 
-      sumweights +=  wts[j*y_rows + i];
+      out_beta[j] = 0.0;
+      sumweights = 0.0;
+      for (i=0; i < y_rows; i++){
+        out_beta[j] += wts[j*y_rows + i]* resids[j*y_rows + i];
+        sumweights +=  wts[j*y_rows + i];
+      }
+      out_beta[j]/=sumweights;
+      for (i=0; i < y_rows; i++){
+        resids[j*y_rows + i] = resids[j*y_rows + i] -  out_beta[j];
+      }
     }
-    rowmeans[i]/=sumweights;
-    for (j=0; j < y_cols; j++){
-       resids[j*y_rows + i] =  resids[j*y_rows + i] - rowmeans[i];
+
+
+   /* sweep rows  (ie probe effects) */
+
+    for (i=0; i < y_rows; i++){
+      rowmeans[i] = 0.0;
+      sumweights = 0.0;
+      for (j=0; j < y_cols; j++){
+        rowmeans[i] += wts[j*y_rows + i]* resids[j*y_rows + i]; 
+        sumweights +=  wts[j*y_rows + i];
+      }
+      rowmeans[i]/=sumweights;
+      for (j=0; j < y_cols; j++){
+         resids[j*y_rows + i] =  resids[j*y_rows + i] - rowmeans[i];
+      }
+    }
+    for (i=0; i < y_rows-1; i++){
+      out_beta[i+y_cols] = rowmeans[i];
     }
-  }
-  for (i=0; i < y_rows-1; i++){
-    out_beta[i+y_cols] = rowmeans[i];
   }
 
 
 
+  if (*input_scale < 0){
+    for (i=0; i < rows; i++){
+      abs_resids[i] = fabs(resids[i]);
+    }
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     if (*input_scale < 0){
-      scale = med_abs(resids,rows)/0.6745;
+      scale = median_nocopy(abs_resids,rows)/0.6745;
     } else {
       scale = *input_scale;
     }
@@ -421,53 +713,19 @@ static void rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *inpu
       /*printf("Scale too small \n"); */
       break;
     }
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
-    for (i=0; i < rows; i++){
-      wts[i] = PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
-    }
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
    
     /* printf("%f\n",scale); */
 
 
     /* weighted least squares */
-    
-    memset(xtwx,0,(y_rows+y_cols-1)*(y_rows+y_cols-1)*sizeof(double));
 
+    rlm_anova_wls(y, y_rows, y_cols, wts, out_beta, wls_work);
+    iterations++;
 
-    XTWX(y_rows,y_cols,wts,xtwx);
-    XTWXinv(y_rows, y_cols,xtwx);
-    XTWY(y_rows, y_cols, wts,y, xtwy);
-
+    /* residuals and convergence check (based on residuals) in one pass */
     
-    for (i=0;i < y_rows+y_cols-1; i++){
-      out_beta[i] = 0.0;
-       for (j=0;j < y_rows+y_cols -1; j++){
-    	 out_beta[i] += xtwx[j*(y_rows+y_cols -1)+i]*xtwy[j];
-       }
-    }
-
-    /* residuals */
-    
-    for (i=0; i < y_rows-1; i++){
-      for (j=0; j < y_cols; j++){
-	resids[j*y_rows +i] = y[j*y_rows + i]- (out_beta[j] + out_beta[i + y_cols]); 
-      }
-    }
-
-    for (j=0; j < y_cols; j++){
-      endprobe=0.0;
-      for (i=0; i < y_rows-1; i++){
-	endprobe+= out_beta[i + y_cols];
-      }
-      resids[j*y_rows + y_rows-1] = y[j*y_rows + y_rows-1]- (out_beta[j] - endprobe);
-    }
-
-    /*check convergence  based on residuals */
-    
-    conv = irls_delta(old_resids,resids, rows);
+    conv = rlm_anova_resids(y, y_rows, y_cols, out_beta, resids, (*input_scale < 0) ? abs_resids : NULL);
     
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -477,16 +735,16 @@ static void rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *inpu
   }
     
   if (*input_scale < 0){
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
   } else {
     scale = *input_scale;
   }
 
-  R_Free(xtwx);
-  R_Free(xtwy);
-  R_Free(old_resids);
-  R_Free(rowmeans);
+  if (own_work){
+    R_Free(work);
+  }
   input_scale[0] = scale;
+  return iterations;
 
 }
 
@@ -494,7 +752,50 @@ static void rlm_fit_anova_engine(double *y, int y_rows, int y_cols, double *inpu
 
 void rlm_fit_anova_scale(double *y, int y_rows, int y_cols,double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
-  rlm_fit_anova_engine(y, y_rows, y_cols, scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized);
+  rlm_fit_anova_engine(y, y_rows, y_cols, scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, 0, NULL);
+}
+
+
+/**********************************************************************************
+ **
+ ** void rlm_fit_anova_scale_ws(double *y, int y_rows, int y_cols, double *scale, double *out_beta, 
+ **                double *out_resids, double *out_weights,
+ **                double (* PsiFn)(double, double, int), double psi_k,int max_iter, 
+ **                int initialized, double *work)
+ **
+ ** as rlm_fit_anova_scale() but all scratch space comes from double *work, which should
+ ** be of length RLM_FIT_ANOVA_WORK(y_rows, y_cols). A buffer sized for the largest
+ ** probeset can be reused across fits so that no allocation is done per probeset.
+ **
+ **********************************************************************************/
+
+void rlm_fit_anova_scale_ws(double *y, int y_rows, int y_cols,double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+  
+  rlm_fit_anova_engine(y, y_rows, y_cols, scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, 0, work);
+}
+
+
+
+/**********************************************************************************
+ **
+ ** int rlm_fit_anova_control(double *y, int y_rows, int y_cols, double *scale, double *out_beta, 
+ **                double *out_resids, double *out_weights,
+ **                double (* PsiFn)(double, double, int), double psi_k,int max_iter, 
+ **                int initialized, int warm_start, double *work)
+ **
+ ** as rlm_fit_anova_scale_ws() (work may be NULL, in which case scratch space is 
+ ** allocated) but when warm_start is non zero the IRLS is started from a median polish
+ ** fit rather than from the (weighted) row and column means. The median polish 
+ ** residuals are much closer to the final M-estimate residuals, so fewer iterations are
+ ** usually needed. out_weights is not used as input when warm starting.
+ **
+ ** Returns the number of IRLS iterations (weighted least squares fits) carried out.
+ **
+ **********************************************************************************/
+
+int rlm_fit_anova_control(double *y, int y_rows, int y_cols,double *scale, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, int warm_start, double *work){
+  
+  return rlm_fit_anova_engine(y, y_rows, y_cols, scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, warm_start, work);
 }
 
 
@@ -521,7 +822,7 @@ void rlm_fit_anova_scale(double *y, int y_rows, int y_cols,double *scale, double
 void rlm_fit_anova(double *y, int y_rows, int y_cols,double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
   double scale = -1.0;
-  rlm_fit_anova_engine(y, y_rows, y_cols, &scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized);
+  rlm_fit_anova_engine(y, y_rows, y_cols, &scale, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, 0, NULL);
 }
 
 
@@ -563,28 +864,34 @@ abs(resid(rlm(as.vector(log2(y)) ~ -1 + as.factor(samples) + C(as.factor(probes)
 */
 
 
-void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scale, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
+void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scale, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
 
   int i,j,iter;
   /* double tol = 1e-7; */
   double acc = 1e-4;
   double scale =0.0;
   double conv;
-  double endprobe;
 
   double *wts = out_weights; 
 
-  double *resids = out_resids; 
-  double *old_resids = R_Calloc(y_rows*y_cols,double);
-  
-  double *rowmeans = R_Calloc(y_rows,double);
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
 
-  double *xtwx = R_Calloc((y_rows+y_cols-1)*(y_rows+y_cols-1),double);
-  double *xtwy = R_Calloc((y_rows+y_cols),double);
+  double *resids = out_resids; 
+  double *abs_resids;   /* |resids| (in some order) for the scale estimate */
+  double *rowmeans;
+  double *wls_work;
+  int own_work = (work == NULL);
 
   double sumweights, rows;
   
   rows = y_rows*y_cols;
+
+  if (own_work){
+    work = R_Calloc(RLM_FIT_ANOVA_WORK(y_rows, y_cols),double);
+  }
+  abs_resids = work;
+  rowmeans = &abs_resids[y_rows*y_cols];
+  wls_work = &rowmeans[y_rows];
   
   if (!initialized){
     
@@ -638,9 +945,15 @@ void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scal
 
 
 
+  if (*input_scale < 0){
+    for (i=0; i < rows; i++){
+      abs_resids[i] = fabs(resids[i]);
+    }
+  }
+
   for (iter = 0; iter < max_iter; iter++){
     if (*input_scale < 0){
-      scale = med_abs(resids,rows)/0.6745;
+      scale = median_nocopy(abs_resids,rows)/0.6745;
     } else {
       scale = *input_scale;
     }
@@ -649,53 +962,21 @@ void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scal
       /*printf("Scale too small \n"); */
       break;
     }
-    for (i =0; i < rows; i++){
-      old_resids[i] = resids[i];
-    }
-
+    PsiArray(PsiFn, resids, rows, scale, psi_k, 0, wts);
     for (i=0; i < rows; i++){
-      wts[i] = w[i]*PsiFn(resids[i]/scale,psi_k,0);  /*           psi_huber(resids[i]/scale,k,0); */
+      wts[i] = w[i]*wts[i];
     }
    
     /* printf("%f\n",scale); */
 
 
     /* weighted least squares */
-    
-    memset(xtwx,0,(y_rows+y_cols-1)*(y_rows+y_cols-1)*sizeof(double));
 
+    rlm_anova_wls(y, y_rows, y_cols, wts, out_beta, wls_work);
 
-    XTWX(y_rows,y_cols,wts,xtwx);
-    XTWXinv(y_rows, y_cols,xtwx);
-    XTWY(y_rows, y_cols, wts,y, xtwy);
-
+    /* residuals and convergence check (based on residuals) in one pass */
     
-    for (i=0;i < y_rows+y_cols-1; i++){
-      out_beta[i] = 0.0;
-       for (j=0;j < y_rows+y_cols -1; j++){
-    	 out_beta[i] += xtwx[j*(y_rows+y_cols -1)+i]*xtwy[j];
-       }
-    }
-
-    /* residuals */
-    
-    for (i=0; i < y_rows-1; i++){
-      for (j=0; j < y_cols; j++){
-	resids[j*y_rows +i] = y[j*y_rows + i]- (out_beta[j] + out_beta[i + y_cols]); 
-      }
-    }
-
-    for (j=0; j < y_cols; j++){
-      endprobe=0.0;
-      for (i=0; i < y_rows-1; i++){
-	endprobe+= out_beta[i + y_cols];
-      }
-      resids[j*y_rows + y_rows-1] = y[j*y_rows + y_rows-1]- (out_beta[j] - endprobe);
-    }
-
-    /*check convergence  based on residuals */
-    
-    conv = irls_delta(old_resids,resids, rows);
+    conv = rlm_anova_resids(y, y_rows, y_cols, out_beta, resids, (*input_scale < 0) ? abs_resids : NULL);
     
     if (conv < acc){
       /*    printf("Converged \n");*/
@@ -708,15 +989,14 @@ void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scal
   }
         
   if (*input_scale < 0){
-    scale = med_abs(resids,rows)/0.6745;
+    scale = median_nocopy(abs_resids,rows)/0.6745;
   } else {
     scale = *input_scale;
   }
 
-  R_Free(xtwx);
-  R_Free(xtwy);
-  R_Free(old_resids);
-  R_Free(rowmeans);
+  if (own_work){
+    R_Free(work);
+  }
   input_scale[0] = scale;
 
 }
@@ -728,7 +1008,7 @@ void rlm_wfit_anova_engine(double *y, int y_rows, int y_cols, double *input_scal
 void rlm_wfit_anova(double *y, int y_rows, int y_cols, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
 
   double scale = -1.0;
-  rlm_wfit_anova_engine(y, y_rows, y_cols, &scale, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized);
+  rlm_wfit_anova_engine(y, y_rows, y_cols, &scale, w, out_beta, out_resids, out_weights, PsiFn , psi_k, max_iter, initialized, NULL);
 
 }
 
@@ -738,7 +1018,15 @@ void rlm_wfit_anova(double *y, int y_rows, int y_cols, double *w, double *out_be
 
 void rlm_wfit_anova_scale(double *y, int y_rows, int y_cols,double *scale, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized){
   
-  rlm_wfit_anova_engine(y, y_rows, y_cols, scale, w, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized);
+  rlm_wfit_anova_engine(y, y_rows, y_cols, scale, w, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, NULL);
+}
+
+
+/* as rlm_wfit_anova_scale() with scratch space from work, see rlm_fit_anova_scale_ws() */
+
+void rlm_wfit_anova_scale_ws(double *y, int y_rows, int y_cols,double *scale, double *w, double *out_beta, double *out_resids, double *out_weights,double (* PsiFn)(double, double, int), double psi_k,int max_iter, int initialized, double *work){
+  
+  rlm_wfit_anova_engine(y, y_rows, y_cols, scale, w, out_beta, out_resids, out_weights,PsiFn, psi_k, max_iter, initialized, work);
 }
 
 
@@ -765,11 +1053,11 @@ void rlm_wfit_anova_scale(double *y, int y_rows, int y_cols,double *scale, doubl
  ************************************************************************/
 
 
-static void RLM_SE_Method_1_anova(double residvar, double *XTX, int y_rows,int y_cols, double *se_estimates,double *varcov){
+static void RLM_SE_Method_1_anova(double residvar, double *XTX, int y_rows,int y_cols, double *se_estimates,double *varcov, double *inv_work){
   int i,j;
   int p = y_rows + y_cols -1;
   
-  XTWXinv(y_rows, y_cols,XTX);
+  XTWXinv_ws(y_rows, y_cols,XTX,inv_work);
 
 
   for (i =0; i < p; i++){
@@ -1019,7 +1307,7 @@ static int RLM_SE_Method_3_anova(double residvar, double *XTX, double *W,  int y
  **
  *********************************************************************/
 
-void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k){
+void rlm_compute_se_anova_ws(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k, double *ws){
   
   int i,j; /* counter/indexing variables */
   double k1 = psi_k;   /*  was 1.345; */
@@ -1030,12 +1318,15 @@ void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double
   double scale=0.0;
   int n = y_rows*y_cols;
   int p = y_rows + y_cols -1;
-  double *XTX = R_Calloc(p*p,double);
-  double *W = R_Calloc(p*p,double);
-  double *work = R_Calloc(p*p,double);
+  double *XTX = ws;
+  double *inv_work = &XTX[p*p];
+  double *W = &inv_work[XTWXINV_WORK(y_rows, y_cols)];   /* W and W_tmp are only needed for methods 1-3 */
+  double *W_tmp = &W[p*p];
   double RMSEw = 0.0;
   double vs=0.0,m,varderivpsi=0.0; 
-  double *W_tmp=R_Calloc(n,double);
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
+
+  memset(XTX, 0, p*p*sizeof(double));
 
 
   if (method == 4){
@@ -1050,7 +1341,7 @@ void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double
 
     XTWX(y_rows,y_cols,weights,XTX);
     if (y_rows > 1){
-      XTWXinv(y_rows, y_cols,XTX);
+      XTWXinv_ws(y_rows, y_cols,XTX,inv_work);
     } else {
       for (i=0; i < p; i++){
 	XTX[i*p + i] = 1.0/XTX[i*p + i];
@@ -1102,21 +1393,34 @@ void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double
 
 
   } else {
-    scale = med_abs(resids,n)/0.6745;
+    scale = med_abs_buffer(resids,n,W_tmp)/0.6745;
     
     residSE[0] =  scale;
+
+    /* prepare XtX */
+
+    memset(W, 0, p*p*sizeof(double));
+
+    for (i=0; i < n; i++){
+      W_tmp[i] = 1.0;
+    }
+    XTWX(y_rows,y_cols,W_tmp,XTX);
     
-    /* compute most of what we will need to do each of the different standard error methods */
+    /* compute most of what we will need to do each of the different standard error methods,
+       psi at each residual and then psi' (which W_tmp keeps for W) */
+    PsiArray(PsiFn, resids, n, scale, k1, 2, W_tmp);
     for (i =0; i < n; i++){
-      sumpsi2+= PsiFn(resids[i]/scale,k1,2)*PsiFn(resids[i]/scale,k1,2); 
-      /* sumpsi += psi_huber(resids[i]/scale,k1,2); */
-      sumderivpsi+= PsiFn(resids[i]/scale,k1,1);
+      sumpsi2+= W_tmp[i]*W_tmp[i]; 
+    }
+    PsiArray(PsiFn, resids, n, scale, k1, 1, W_tmp);
+    for (i =0; i < n; i++){
+      sumderivpsi+= W_tmp[i];
     }
     
     m = (sumderivpsi/(double) n);
 
     for (i = 0; i < n; i++){
-      varderivpsi+=(PsiFn(resids[i]/scale,k1,1) - m)*(PsiFn(resids[i]/scale,k1,1) - m);
+      varderivpsi+=(W_tmp[i] - m)*(W_tmp[i] - m);
     }
     varderivpsi/=(double)(n);
 
@@ -1126,23 +1430,15 @@ void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double
     Kappa = 1.0 + ((double)p/(double)n) *varderivpsi/(m*m);
 
     
-    /* prepare XtX and W matrices */
+    /* prepare W matrix */
 
-    for (i=0; i < n; i++){
-      W_tmp[i] = 1.0;
-    }
-    XTWX(y_rows,y_cols,W_tmp,XTX);
-    
-     for (i=0; i < n; i++){
-       W_tmp[i] = PsiFn(resids[i]/scale,k1,1);
-    }
     XTWX(y_rows,y_cols,W_tmp,W);
 
     if (method==1) {
       Kappa = Kappa*Kappa;
       vs = scale*scale*sumpsi2/(double)(n-p);
       Kappa = Kappa*vs/(m*m);
-      RLM_SE_Method_1_anova(Kappa, XTX, y_rows,y_cols, se_estimates,varcov);
+      RLM_SE_Method_1_anova(Kappa, XTX, y_rows,y_cols, se_estimates,varcov,inv_work);
     } else if (method==2){
       vs = scale*scale*sumpsi2/(double)(n-p);
       Kappa = Kappa*vs/m;
@@ -1161,11 +1457,17 @@ void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double
       }
     } 
   }
-  R_Free(W_tmp);
-  R_Free(work);
-  R_Free(XTX);
-  R_Free(W);
+}
+
+
+
+void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k){
+
+  double *ws = R_Calloc(RLM_COMPUTE_SE_ANOVA_WORK(y_rows, y_cols, method),double);
+
+  rlm_compute_se_anova_ws(Y, y_rows, y_cols, beta, resids, weights, se_estimates, varcov, residSE, method, PsiFn, psi_k, ws);
 
+  R_Free(ws);
 }
 
 
@@ -1236,10 +1538,12 @@ void rlm_fit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols,
 
   double *wts = out_weights; 
 
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
+
   double *resids = out_resids; 
   double *old_resids = R_Calloc(y_rows*y_cols,double);
   
-  double *rowmeans = R_Calloc(y_rows,double);
+  double *scale_buffer = R_Calloc(y_rows,double);
 
   double *xtwx = R_Calloc((y_cols)*(y_cols),double);
   double *xtwy = R_Calloc((y_cols),double);
@@ -1290,16 +1594,14 @@ void rlm_fit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols,
 
     for (j = 0; j < y_cols; j++){
       if (input_scale[j] < 0.0){
-	scale[j] = med_abs(&resids[j*y_rows],y_rows)/0.6745;
+	scale[j] = med_abs_buffer(&resids[j*y_rows],y_rows,scale_buffer)/0.6745;
       } else {
 	scale[j] = input_scale[j];
       }
-      for (i=0; i < y_rows; i++){ 
-	if (fabs(scale[j]) < 1e-10){
-	  break;
-	}
-	wts[j*y_rows + i] = PsiFn(resids[j*y_rows + i]/scale[j],psi_k,0);
+      if (fabs(scale[j]) < 1e-10){
+	continue;
       }
+      PsiArray(PsiFn, &resids[j*y_rows], y_rows, scale[j], psi_k, 0, &wts[j*y_rows]);
     }
 
 
@@ -1344,7 +1646,7 @@ void rlm_fit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols,
 
   for (j = 0; j < y_cols; j++){
     if (input_scale[j] < 0.0){
-      scale[j] = med_abs(&resids[j*y_rows],y_rows)/0.6745;
+      scale[j] = med_abs_buffer(&resids[j*y_rows],y_rows,scale_buffer)/0.6745;
     } else {
       scale[j] = input_scale[j];
     }
@@ -1353,7 +1655,7 @@ void rlm_fit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols,
   R_Free(xtwx);
   R_Free(xtwy);
   R_Free(old_resids);
-  R_Free(rowmeans);
+  R_Free(scale_buffer);
 
   for (j = 0; j < y_cols; j++){
     input_scale[j] = scale[j];
@@ -1506,10 +1808,12 @@ void rlm_wfit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols
 
   double *wts = out_weights; 
 
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
+
   double *resids = out_resids; 
   double *old_resids = R_Calloc(y_rows*y_cols,double);
   
-  double *rowmeans = R_Calloc(y_rows,double);
+  double *scale_buffer = R_Calloc(y_rows,double);
 
   double *xtwx = R_Calloc((y_cols)*(y_cols),double);
   double *xtwy = R_Calloc((y_cols),double);
@@ -1560,16 +1864,17 @@ void rlm_wfit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols
 
     for (j = 0; j < y_cols; j++){ 
       if (input_scale[j] < 0.0){
-	scale[j] = med_abs(&resids[j*y_rows],y_rows)/0.6745;
+	scale[j] = med_abs_buffer(&resids[j*y_rows],y_rows,scale_buffer)/0.6745;
       } else {
 	scale[j] = input_scale[j];
       }
    
+      if (fabs(scale[j]) < 1e-10){
+	continue;
+      }
+      PsiArray(PsiFn, &resids[j*y_rows], y_rows, scale[j], psi_k, 0, &wts[j*y_rows]);
       for (i=0; i < y_rows; i++){ 
-	if (fabs(scale[j]) < 1e-10){
-	  break;
-	}
-	wts[j*y_rows + i] = w[j*y_rows + i]*PsiFn(resids[j*y_rows + i]/scale[j],psi_k,0);
+	wts[j*y_rows + i] = w[j*y_rows + i]*wts[j*y_rows + i];
       }
     }
 
@@ -1615,7 +1920,7 @@ void rlm_wfit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols
   
   for (j = 0; j < y_cols; j++){
     if (input_scale[j] < 0.0){
-      scale[j] = med_abs(&resids[j*y_rows],y_rows)/0.6745;
+      scale[j] = med_abs_buffer(&resids[j*y_rows],y_rows,scale_buffer)/0.6745;
     } else {
       scale[j] = input_scale[j];
     }
@@ -1623,7 +1928,7 @@ void rlm_wfit_anova_given_probe_effects_engine(double *y, int y_rows, int y_cols
   R_Free(xtwx);
   R_Free(xtwy);
   R_Free(old_resids);
-  R_Free(rowmeans);
+  R_Free(scale_buffer);
 
   for (j = 0; j < y_cols; j++){
     input_scale[j] = scale[j];
@@ -69,6 +69,8 @@
  **                in with non - huber psis
  ** June 22, 2004 - moved some functions to matrix_functions.c
  ** March 1, 2006 - change all comments to ansi style
+ ** Oct 18, 2026 - rlm_compute_se evaluates psi and psi' once per residual (PsiFuncArray)
+ **                rather than inside the loops over the entries of W
  **                
  ********************************************************************/
 
@@ -324,6 +326,9 @@ void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *res
   double *work = R_Calloc(p*p,double);
   double RMSEw = 0.0;
   double vs=0.0,m,varderivpsi=0.0; 
+  double *psi_values = NULL;  /* psi(r_i) */
+  double *psi_deriv = NULL;   /* psi'(r_i) */
+  pt2psi_array PsiArray = PsiFuncArray(PsiFn);
 
   /* Initialize Lapack library */
   /* if(!Lapack_initialized) Lapack_Init(); */
@@ -367,16 +372,21 @@ void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *res
     residSE[0] =  scale;
     
     /* compute most of what we will need to do each of the different standard error methods */
+    psi_values = R_Calloc(n,double);
+    PsiArray(PsiFn, resids, n, scale, k1, 2, psi_values);
     for (i =0; i < n; i++){
-      sumpsi2+= PsiFn(resids[i]/scale,k1,2)*PsiFn(resids[i]/scale,k1,2); 
-      /* sumpsi += psi_huber(resids[i]/scale,k1,2); */
-      sumderivpsi+= PsiFn(resids[i]/scale,k1,1);
+      sumpsi2+= psi_values[i]*psi_values[i]; 
+    }
+    psi_deriv = R_Calloc(n,double);
+    PsiArray(PsiFn, resids, n, scale, k1, 1, psi_deriv);
+    for (i =0; i < n; i++){
+      sumderivpsi+= psi_deriv[i];
     }
     
     m = (sumderivpsi/(double) n);
 
     for (i = 0; i < n; i++){
-      varderivpsi+=(PsiFn(resids[i]/scale,k1,1) - m)*(PsiFn(resids[i]/scale,k1,1) - m);
+      varderivpsi+=(psi_deriv[i] - m)*(psi_deriv[i] - m);
     }
     varderivpsi/=(double)(n);
 
@@ -392,7 +402,7 @@ void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *res
       for (k=0; k < p; k++){
 	for (i = 0; i < n; i++){
 	  XTX[k*p+j]+=  X[j*n +i]*X[k*n + i];
-	  W[k*p + j]+=  PsiFn(resids[i]/scale,k1,1)*X[j*n +i]*X[k*n + i];	
+	  W[k*p + j]+=  psi_deriv[i]*X[j*n +i]*X[k*n + i];	
 	}
       }
     }
@@ -414,12 +424,18 @@ void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *res
       i = RLM_SE_Method_3(Kappa, XTX, W, p, se_estimates,varcov);
       if (i){
 	for (i=0; i <n; i++){
-	  Rprintf("%2.1f ", PsiFn(resids[i]/scale,k1,1));
+	  Rprintf("%2.1f ", psi_deriv[i]);
 	} 
 	Rprintf("\n");
       }
     } 
   }
+  if (psi_values != NULL){
+    R_Free(psi_values);
+  }
+  if (psi_deriv != NULL){
+    R_Free(psi_deriv);
+  }
   R_Free(work);
   R_Free(XTX);
   R_Free(W);
@@ -1,9 +1,18 @@
 #ifndef RLM_SE_H
 #define RLM_SE_H 1
 
+/* scratch used when inverting XTWX for the probes + chips model */
+#define XTWXINV_WORK(y_rows, y_cols) ((size_t)(y_cols)*(y_rows) + 3*(size_t)((y_rows)-1)*((y_rows)-1))
+
+/* workspace needed by rlm_compute_se_anova_ws(), method 4 needs only the first part */
+#define RLM_COMPUTE_SE_ANOVA_WORK(y_rows, y_cols, method) \
+  ((size_t)((y_rows)+(y_cols)-1)*((y_rows)+(y_cols)-1) + XTWXINV_WORK(y_rows, y_cols) + \
+   ((method) == 4 ? 0 : (size_t)((y_rows)+(y_cols)-1)*((y_rows)+(y_cols)-1) + (size_t)(y_rows)*(y_cols)))
+
 
 void rlm_compute_se(double *X,double *Y, int n, int p, double *beta, double *resids,double *weights,double *se_estimates,double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k);
 void rlm_compute_se_anova(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k);
+void rlm_compute_se_anova_ws(double *Y, int y_rows,int y_cols, double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k, double *ws);
 void rlm_compute_se_anova_given_probe_effects(double *Y, int y_rows,int y_cols, double *probe_effects,double *beta, double *resids,double *weights,double *se_estimates, double *varcov, double *residSE, int method,double (* PsiFn)(double, double, int), double psi_k);
 
 #endif
@@ -15,12 +15,26 @@
  **                the R package build.
  ** Jan 2, 2003 - Clean up code comments
  ** Nov 13, 2006 - moved median function into this file from rma2.c
+ ** Oct 18, 2026 - medians now computed with a shared Floyd-Rivest selection
+ **                routine. Even lengths find the upper middle value with a
+ **                single scan rather than a second partial sort. Added
+ **                median_buffer() for callers that supply their own scratch.
+ **                Short vectors (24 or fewer values, ie most probesets) use
+ **                sorting networks instead.
+ ** Oct 18, 2026 - median() copies short vectors onto the stack rather than
+ **                allocating
+ ** Oct 18, 2026 - add a shared (vectorized) log2 transform, log2_transform(),
+ **                log2_transform_in_place() and log2_gather()
  **
  ***********************************************************************/
 
 #include "rma_common.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <float.h>
+
+#include <math.h>
 
 #include <R.h> 
 #include <Rdefines.h>
@@ -45,6 +59,380 @@ int sort_double(const double *a1,const double *a2){
 
 
 
+/**************************************************************************
+ **
+ ** Selection
+ **
+ ** The routines below partially reorder a vector so that the k'th smallest
+ ** value ends up in position k, with smaller values before it and larger
+ ** values after it. NaN/NA values are treated as larger than everything
+ ** else, which matches the ordering rPsort() used to give here, so the
+ ** medians computed are unchanged.
+ **
+ ** Large ranges are narrowed by Floyd-Rivest sampling: the selection is
+ ** first run recursively on a small sample bracketing the target, so that
+ ** the pivot used on the full range is almost always very close to the
+ ** answer and only a little more than one pass over the data is needed.
+ **
+ *************************************************************************/
+
+#define SELECT_SAMPLE_MIN 600
+
+#define SELECT_SWAP(a,b) { double tmp_ = (a); (a) = (b); (b) = tmp_; }
+
+/**************************************************************************
+ **
+ ** static size_t select_nan_last(double *x, size_t length)
+ **
+ ** double *x - vector
+ ** size_t length - length of *x
+ **
+ ** moves any NaN values to the end of *x. returns the number of non NaN values
+ ** (which are then in x[0 .. returned value - 1])
+ **
+ *************************************************************************/
+
+static size_t select_nan_last(double *x, size_t length){
+
+  size_t i = 0, n = length;
+
+  while (i < n){
+    if (ISNAN(x[i])){
+      n--;
+      SELECT_SWAP(x[i], x[n]);
+    } else {
+      i++;
+    }
+  }
+  return n;
+}
+
+/**************************************************************************
+ **
+ ** static void floyd_rivest_select(double *x, R_xlen_t left, R_xlen_t right, R_xlen_t k)
+ **
+ ** double *x - vector (must not contain NaN)
+ ** R_xlen_t left, right - range of *x to work on (inclusive)
+ ** R_xlen_t k - position to select (left <= k <= right)
+ **
+ ** reorders x[left .. right] so that x[k] holds the value it would have if 
+ ** that range were sorted, everything before it is <= x[k] and everything
+ ** after it is >= x[k].
+ **
+ *************************************************************************/
+
+static void floyd_rivest_select(double *x, R_xlen_t left, R_xlen_t right, R_xlen_t k){
+
+  R_xlen_t i, j;
+  R_xlen_t newleft, newright;
+  double n, m, z, s, sd;
+  double t;
+
+  while (right > left){
+    if (right - left > SELECT_SAMPLE_MIN){
+      n = (double)(right - left + 1);
+      m = (double)(k - left + 1);
+      z = log(n);
+      s = 0.5*exp(2.0*z/3.0);
+      sd = 0.5*sqrt(z*s*(n - s)/n);
+      if (m < n/2.0){
+	sd = -sd;
+      }
+      newleft = (R_xlen_t)((double)k - m*s/n + sd);
+      newright = (R_xlen_t)((double)k + (n - m)*s/n + sd);
+      if (newleft < left)
+	newleft = left;
+      if (newright > right)
+	newright = right;
+      floyd_rivest_select(x, newleft, newright, k);
+    }
+    
+    t = x[k];
+    i = left;
+    j = right;
+    SELECT_SWAP(x[left], x[k]);
+    if (x[right] > t){
+      SELECT_SWAP(x[right], x[left]);
+    }
+    while (i < j){
+      SELECT_SWAP(x[i], x[j]);
+      i++;
+      j--;
+      while (x[i] < t)
+	i++;
+      while (x[j] > t)
+	j--;
+    }
+    if (x[left] == t){
+      SELECT_SWAP(x[left], x[j]);
+    } else {
+      j++;
+      SELECT_SWAP(x[j], x[right]);
+    }
+    if (j <= k)
+      left = j + 1;
+    if (k <= j)
+      right = j - 1;
+  }
+}
+
+
+/**************************************************************************
+ **
+ ** Small vectors
+ **
+ ** Most probesets have somewhere between 4 and 25 probes, so the medians
+ ** used in summarization are mostly of short vectors. For these it is 
+ ** quicker to just sort the values. Up to 16 values this is done with a 
+ ** fixed sorting network (Batcher's odd-even merge network, trimmed to the
+ ** required length): a fixed sequence of compare-exchange steps which 
+ ** compile to min/max instructions rather than unpredictable branches.
+ ** For 17 to 24 values median_small() sorts each half with a network and
+ ** then merges just far enough to reach the middle. Beyond that (timed at 
+ ** each length up to 32) the selection routine below is as quick or quicker.
+ **
+ *************************************************************************/
+
+#define SORT_NETWORK_MAX 16
+#define MEDIAN_SMALL_MAX 24
+
+#define SORT_CSWAP(i,j) { double a_ = v[i], b_ = v[j]; v[i] = (b_ < a_) ? b_ : a_; v[j] = (b_ < a_) ? a_ : b_; }
+
+static void sort_network_2(double *v){
+  SORT_CSWAP(0,1);
+}
+
+static void sort_network_3(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(0,2); SORT_CSWAP(1,2);
+}
+
+static void sort_network_4(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(1,2);
+}
+
+static void sort_network_5(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(1,2); SORT_CSWAP(0,4);
+  SORT_CSWAP(2,4); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+}
+
+static void sort_network_6(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(1,2);
+  SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+}
+
+static void sort_network_7(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6);
+  SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6); SORT_CSWAP(2,4);
+  SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6);
+}
+
+static void sort_network_8(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(0,2); SORT_CSWAP(1,3);
+  SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(0,4); SORT_CSWAP(1,5);
+  SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+  SORT_CSWAP(5,6);
+}
+
+static void sort_network_9(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(0,2); SORT_CSWAP(1,3);
+  SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(0,4); SORT_CSWAP(1,5);
+  SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+  SORT_CSWAP(5,6); SORT_CSWAP(0,8); SORT_CSWAP(4,8); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(6,8);
+  SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(7,8);
+}
+
+static void sort_network_10(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(0,2);
+  SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(0,4);
+  SORT_CSWAP(1,5); SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(1,2);
+  SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(0,8); SORT_CSWAP(1,9); SORT_CSWAP(4,8); SORT_CSWAP(5,9);
+  SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(6,8); SORT_CSWAP(7,9); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+  SORT_CSWAP(5,6); SORT_CSWAP(7,8);
+}
+
+static void sort_network_11(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(0,2);
+  SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(8,10); SORT_CSWAP(1,2); SORT_CSWAP(5,6);
+  SORT_CSWAP(9,10); SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(2,4);
+  SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(0,8);
+  SORT_CSWAP(1,9); SORT_CSWAP(2,10); SORT_CSWAP(4,8); SORT_CSWAP(5,9); SORT_CSWAP(6,10); SORT_CSWAP(2,4);
+  SORT_CSWAP(3,5); SORT_CSWAP(6,8); SORT_CSWAP(7,9); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6);
+  SORT_CSWAP(7,8); SORT_CSWAP(9,10);
+}
+
+static void sort_network_12(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(10,11);
+  SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(8,10); SORT_CSWAP(9,11);
+  SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6);
+  SORT_CSWAP(3,7); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6);
+  SORT_CSWAP(9,10); SORT_CSWAP(0,8); SORT_CSWAP(1,9); SORT_CSWAP(2,10); SORT_CSWAP(3,11); SORT_CSWAP(4,8);
+  SORT_CSWAP(5,9); SORT_CSWAP(6,10); SORT_CSWAP(7,11); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(6,8);
+  SORT_CSWAP(7,9); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(7,8); SORT_CSWAP(9,10);
+}
+
+static void sort_network_13(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(10,11);
+  SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(8,10); SORT_CSWAP(9,11);
+  SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6);
+  SORT_CSWAP(3,7); SORT_CSWAP(8,12); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(10,12); SORT_CSWAP(1,2);
+  SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(11,12); SORT_CSWAP(0,8); SORT_CSWAP(1,9);
+  SORT_CSWAP(2,10); SORT_CSWAP(3,11); SORT_CSWAP(4,12); SORT_CSWAP(4,8); SORT_CSWAP(5,9); SORT_CSWAP(6,10);
+  SORT_CSWAP(7,11); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(6,8); SORT_CSWAP(7,9); SORT_CSWAP(10,12);
+  SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(7,8); SORT_CSWAP(9,10); SORT_CSWAP(11,12);
+}
+
+static void sort_network_14(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(10,11);
+  SORT_CSWAP(12,13); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(8,10);
+  SORT_CSWAP(9,11); SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(0,4); SORT_CSWAP(1,5);
+  SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(8,12); SORT_CSWAP(9,13); SORT_CSWAP(2,4); SORT_CSWAP(3,5);
+  SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(9,10);
+  SORT_CSWAP(11,12); SORT_CSWAP(0,8); SORT_CSWAP(1,9); SORT_CSWAP(2,10); SORT_CSWAP(3,11); SORT_CSWAP(4,12);
+  SORT_CSWAP(5,13); SORT_CSWAP(4,8); SORT_CSWAP(5,9); SORT_CSWAP(6,10); SORT_CSWAP(7,11); SORT_CSWAP(2,4);
+  SORT_CSWAP(3,5); SORT_CSWAP(6,8); SORT_CSWAP(7,9); SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2);
+  SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(7,8); SORT_CSWAP(9,10); SORT_CSWAP(11,12);
+}
+
+static void sort_network_15(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(10,11);
+  SORT_CSWAP(12,13); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7); SORT_CSWAP(8,10);
+  SORT_CSWAP(9,11); SORT_CSWAP(12,14); SORT_CSWAP(1,2); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(13,14);
+  SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6); SORT_CSWAP(3,7); SORT_CSWAP(8,12); SORT_CSWAP(9,13);
+  SORT_CSWAP(10,14); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2);
+  SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(9,10); SORT_CSWAP(11,12); SORT_CSWAP(13,14); SORT_CSWAP(0,8);
+  SORT_CSWAP(1,9); SORT_CSWAP(2,10); SORT_CSWAP(3,11); SORT_CSWAP(4,12); SORT_CSWAP(5,13); SORT_CSWAP(6,14);
+  SORT_CSWAP(4,8); SORT_CSWAP(5,9); SORT_CSWAP(6,10); SORT_CSWAP(7,11); SORT_CSWAP(2,4); SORT_CSWAP(3,5);
+  SORT_CSWAP(6,8); SORT_CSWAP(7,9); SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2); SORT_CSWAP(3,4);
+  SORT_CSWAP(5,6); SORT_CSWAP(7,8); SORT_CSWAP(9,10); SORT_CSWAP(11,12); SORT_CSWAP(13,14);
+}
+
+static void sort_network_16(double *v){
+  SORT_CSWAP(0,1); SORT_CSWAP(2,3); SORT_CSWAP(4,5); SORT_CSWAP(6,7); SORT_CSWAP(8,9); SORT_CSWAP(10,11);
+  SORT_CSWAP(12,13); SORT_CSWAP(14,15); SORT_CSWAP(0,2); SORT_CSWAP(1,3); SORT_CSWAP(4,6); SORT_CSWAP(5,7);
+  SORT_CSWAP(8,10); SORT_CSWAP(9,11); SORT_CSWAP(12,14); SORT_CSWAP(13,15); SORT_CSWAP(1,2); SORT_CSWAP(5,6);
+  SORT_CSWAP(9,10); SORT_CSWAP(13,14); SORT_CSWAP(0,4); SORT_CSWAP(1,5); SORT_CSWAP(2,6); SORT_CSWAP(3,7);
+  SORT_CSWAP(8,12); SORT_CSWAP(9,13); SORT_CSWAP(10,14); SORT_CSWAP(11,15); SORT_CSWAP(2,4); SORT_CSWAP(3,5);
+  SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(9,10);
+  SORT_CSWAP(11,12); SORT_CSWAP(13,14); SORT_CSWAP(0,8); SORT_CSWAP(1,9); SORT_CSWAP(2,10); SORT_CSWAP(3,11);
+  SORT_CSWAP(4,12); SORT_CSWAP(5,13); SORT_CSWAP(6,14); SORT_CSWAP(7,15); SORT_CSWAP(4,8); SORT_CSWAP(5,9);
+  SORT_CSWAP(6,10); SORT_CSWAP(7,11); SORT_CSWAP(2,4); SORT_CSWAP(3,5); SORT_CSWAP(6,8); SORT_CSWAP(7,9);
+  SORT_CSWAP(10,12); SORT_CSWAP(11,13); SORT_CSWAP(1,2); SORT_CSWAP(3,4); SORT_CSWAP(5,6); SORT_CSWAP(7,8);
+  SORT_CSWAP(9,10); SORT_CSWAP(11,12); SORT_CSWAP(13,14);
+}
+
+/**************************************************************************
+ **
+ ** static void sort_small(double *x, size_t length)
+ **
+ ** double *x - vector (must not contain NaN)
+ ** size_t length - length of *x, at most SORT_NETWORK_MAX
+ **
+ ** sorts *x into increasing order using the network for that length.
+ **
+ *************************************************************************/
+
+static void sort_small(double *x, size_t length){
+
+  switch (length){
+  case 0:
+  case 1: break;
+  case 2: sort_network_2(x); break;
+  case 3: sort_network_3(x); break;
+  case 4: sort_network_4(x); break;
+  case 5: sort_network_5(x); break;
+  case 6: sort_network_6(x); break;
+  case 7: sort_network_7(x); break;
+  case 8: sort_network_8(x); break;
+  case 9: sort_network_9(x); break;
+  case 10: sort_network_10(x); break;
+  case 11: sort_network_11(x); break;
+  case 12: sort_network_12(x); break;
+  case 13: sort_network_13(x); break;
+  case 14: sort_network_14(x); break;
+  case 15: sort_network_15(x); break;
+  case 16: sort_network_16(x); break;
+  default: break;
+  }
+}
+
+
+/**************************************************************************
+ **
+ ** double select_nocopy(double *x, size_t length, size_t k)
+ **
+ ** double *x - vector
+ ** size_t length - length of *x
+ ** size_t k - which order statistic to find (0 is the smallest)
+ **
+ ** returns the k'th smallest value of *x. On output x[k] holds this value
+ ** and *x is partially ordered around it (NaN values last), short vectors
+ ** are completely sorted. note x is not order preserved when this function 
+ ** is called.
+ **
+ *************************************************************************/
+
+double select_nocopy(double *x, size_t length, size_t k){
+
+  size_t n = select_nan_last(x, length);
+
+  if (n <= SORT_NETWORK_MAX){
+    sort_small(x, n);
+  } else if (k < n){
+    floyd_rivest_select(x, 0, (R_xlen_t)n - 1, (R_xlen_t)k);
+  }
+  return x[k];
+}
+
+
+/**************************************************************************
+ **
+ ** static double median_small(double *x, int length)
+ **
+ ** double *x - vector
+ ** int length - length of *x, at most MEDIAN_SMALL_MAX
+ **
+ ** returns the median of *x. note x is not order preserved when this function
+ ** is called.
+ **
+ *************************************************************************/
+
+static double median_small(double *x, int length){
+  size_t n = select_nan_last(x, length);
+  size_t half = (length + 1)/2;
+  size_t a, i, j, c;
+  double lower, upper, cur;
+
+  if (n <= SORT_NETWORK_MAX){
+    sort_small(x, n);
+    lower = x[half-1];
+    upper = (length % 2 == 0) ? x[half] : lower;
+  } else {
+    /* sort each half, then merge up to the middle (the NaN values past n are never reached) */
+    a = n/2;
+    sort_small(x, a);
+    sort_small(x + a, n - a);
+    lower = upper = 0.0;
+    i = 0;
+    j = a;
+    for (c = 0; c <= half; c++){
+      if (j >= n || (i < a && x[i] <= x[j])){
+	cur = x[i++];
+      } else {
+	cur = x[j++];
+      }
+      if (c == half - 1)
+	lower = cur;
+      upper = cur;
+    }
+  }
+  
+  if (length % 2 == 1){
+    return lower;
+  }
+  return (lower + upper)/2.0;
+}
+
+
 /**************************************************************************
  **
  ** double median(double *x, int length)
@@ -52,38 +440,47 @@ int sort_double(const double *a1,const double *a2){
  ** double *x - vector
  ** int length - length of *x
  **
- ** returns the median of *x
+ ** returns the median of *x. The copy it works on is on the stack unless
+ ** length is more than MEDIAN_STACK
  **
  *************************************************************************/
 
+#define MEDIAN_STACK 64
+
 double  median(double *x, int length){
-  /*  int i; */
-  int half;
   double med;
-  double *buffer = R_Calloc(length,double);
+  double small[MEDIAN_STACK];
+  double *buffer = small;
+
+  if (length > MEDIAN_STACK)
+    buffer = R_Calloc(length,double);
   
-  memcpy(buffer,x,length*sizeof(double));
+  med = median_buffer(x, length, buffer);
+  
+  if (buffer != small)
+    R_Free(buffer);
+  return med;
+}
 
-  half = (length + 1)/2;
-  /*  
-      qsort(buffer,length,sizeof(double), (int(*)(const void*, const void*))sort_double);  
-      
-      if (length % 2 == 1){
-      med = buffer[half - 1];
-      } else {
-      med = (buffer[half] + buffer[half-1])/2.0;
-      }
-  */
 
-  rPsort(buffer, length, half-1);
-  med = buffer[half-1];
-  if (length % 2 == 0){
-    rPsort(buffer, length, half);
-    med = (med + buffer[half])/2.0;
-  }
+/**************************************************************************
+ **
+ ** double median_buffer(double *x, int length, double *buffer)
+ **
+ ** double *x - vector
+ ** int length - length of *x
+ ** double *buffer - scratch space of at least length doubles
+ **
+ ** returns the median of *x. *x is left untouched, the caller supplied
+ ** buffer is used instead of allocating a copy on each call.
+ **
+ *************************************************************************/
+
+double  median_buffer(double *x, int length, double *buffer){
   
-  R_Free(buffer);
-  return med;
+  memcpy(buffer,x,length*sizeof(double));
+  
+  return median_nocopy(buffer,length);
 }
 
 
@@ -100,29 +497,180 @@ double  median(double *x, int length){
  *************************************************************************/
 
 double  median_nocopy(double *x, int length){
-  /* int i; */
-  int half;
-  double med;
-  double *buffer = x;  //R_Calloc(length,double);
+  int i, half;
+  double med, upper;
   
+  if (length <= MEDIAN_SMALL_MAX){
+    return median_small(x, length);
+  }
+
   half = (length + 1)/2;
-  /*  
-      qsort(buffer,length,sizeof(double), (int(*)(const void*, const void*))sort_double);  
-      
-      if (length % 2 == 1){
-      med = buffer[half - 1];
-      } else {
-      med = (buffer[half] + buffer[half-1])/2.0;
-      }
-  */
+  med = select_nocopy(x, length, half-1);
 
-  rPsort(buffer, length, half-1);
-  med = buffer[half-1];
   if (length % 2 == 0){
-    rPsort(buffer, length, half);
-    med = (med + buffer[half])/2.0;
+    /* 
+       after selecting the lower middle value everything in x[half ..] is at 
+       least as large, so the upper middle value is just the smallest of 
+       those (NaN values have been moved to the end, so if x[half] is NaN 
+       all that follows is too)
+    */
+    upper = x[half];
+    for (i = half + 1; i < length; i++){
+      if (x[i] < upper)
+	upper = x[i];
+    }
+    med = (med + upper)/2.0;
   }
-  
  
   return med;
 }
+
+
+
+/**************************************************************************
+ **
+ ** log2 transformation
+ **
+ ** All the *_log summaries (and the medianpolish/rlm code in log scale) 
+ ** transform a block of intensities with log(x)/log(2.0), one libm call
+ ** and a division per value. log2_kernel() below is the FreeBSD/fdlibm 
+ ** e_log2.c algorithm written without branches so that the compiler can
+ ** vectorize it. With GCC on x86-64 (glibc) it is built for both AVX2 and
+ ** baseline SSE2 and the version used is chosen when the package is loaded.
+ ** Results are within 1 ulp of libm log2() and are the same whichever
+ ** version runs.
+ **
+ ** The kernel only handles positive normal numbers. Anything else (0,
+ ** negatives, subnormals, Inf, NaN/NA) is passed to libm log2() afterwards,
+ ** so NA in gives NA out as before.
+ **
+ *************************************************************************/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__GLIBC__)
+#define LOG2_KERNEL_ATTRIBUTES __attribute__((target_clones("avx2","default"), optimize("tree-vectorize")))
+#else
+#define LOG2_KERNEL_ATTRIBUTES
+#endif
+
+#define LOG2_CHUNK 256
+
+static const double
+ivln2hi =  1.44269504072144627571e+00, /* 0x3ff71547, 0x65200000 */
+ivln2lo =  1.67517131648865118353e-10, /* 0x3de705fc, 0x2eefa200 */
+Lg1 = 6.666666666666735130e-01,  /* 3FE55555 55555593 */
+Lg2 = 3.999999999940941908e-01,  /* 3FD99999 9997FA04 */
+Lg3 = 2.857142874366239149e-01,  /* 3FD24924 94229359 */
+Lg4 = 2.222219843214978396e-01,  /* 3FCC71C5 1D8E78AF */
+Lg5 = 1.818357216161805012e-01,  /* 3FC74664 96CB03DE */
+Lg6 = 1.531383769920937332e-01,  /* 3FC39A09 D078C69F */
+Lg7 = 1.479819860511658591e-01;  /* 3FC2F112 DF3E5244 */
+
+LOG2_KERNEL_ATTRIBUTES
+static void log2_kernel(const double * restrict x, double * restrict y, size_t length){
+  size_t i;
+  uint64_t bits, mbits;
+  int64_t hx, k, mid;
+  double f, s, z, w, t1, t2, R, hfsq, hi, lo, val_hi, val_lo, kd, sum;
+
+  for (i = 0; i < length; i++){
+    /* x = 2^k * (1 + f) with 1 + f in [sqrt(2)/2, sqrt(2)) */
+    memcpy(&bits, &x[i], sizeof(double));
+    hx = (int64_t)(bits >> 32);
+    k = (hx >> 20) - 1023;
+    hx &= 0x000fffff;
+    mid = (hx + 0x95f64) & 0x100000;
+    mbits = ((uint64_t)(hx | (mid ^ 0x3ff00000)) << 32) | (bits & 0xffffffffULL);
+    k += (mid >> 20);
+    memcpy(&f, &mbits, sizeof(double));
+    f = f - 1.0;
+
+    /* log(1 + f) = f - hfsq + s*(hfsq + R) */
+    hfsq = 0.5*f*f;
+    s = f/(2.0+f);
+    z = s*s;
+    w = z*z;
+    t1 = w*(Lg2+w*(Lg4+w*Lg6));
+    t2 = z*(Lg1+w*(Lg3+w*(Lg5+w*Lg7)));
+    R = t2+t1;
+
+    /* split into hi and lo parts so multiplying by 1/log(2) stays accurate */
+    hi = f - hfsq;
+    memcpy(&mbits, &hi, sizeof(double));
+    mbits &= 0xffffffff00000000ULL;
+    memcpy(&hi, &mbits, sizeof(double));
+    lo = (f - hi) - hfsq + s*(hfsq+R);
+
+    val_hi = hi*ivln2hi;
+    val_lo = (lo+hi)*ivln2lo + lo*ivln2hi;
+
+    kd = (double)(int)k;
+    sum = kd + val_hi;
+    val_lo += (kd - sum) + val_hi;
+    y[i] = val_lo + sum;
+  }
+}
+
+
+/**************************************************************************
+ **
+ ** void log2_transform(const double *x, double *y, size_t length)
+ **
+ ** const double *x - vector
+ ** double *y - output, log2 of each element of x (may be the same as x)
+ ** size_t length - length of *x and *y
+ **
+ *************************************************************************/
+
+void log2_transform(const double *x, double *y, size_t length){
+  double buffer[LOG2_CHUNK];
+  size_t i, j, n;
+
+  for (i = 0; i < length; i+=LOG2_CHUNK){
+    n = (length - i < LOG2_CHUNK ? length - i : LOG2_CHUNK);
+    log2_kernel(&x[i], buffer, n);
+    for (j = 0; j < n; j++){
+      if (!(x[i+j] >= DBL_MIN && x[i+j] <= DBL_MAX)){
+	buffer[j] = log2(x[i+j]);
+      }
+    }
+    memcpy(&y[i], buffer, n*sizeof(double));
+  }
+}
+
+
+/**************************************************************************
+ **
+ ** void log2_transform_in_place(double *x, size_t length)
+ **
+ ** double *x - vector, replaced by log2 of its elements
+ ** size_t length - length of *x
+ **
+ *************************************************************************/
+
+void log2_transform_in_place(double *x, size_t length){
+  log2_transform(x, x, length);
+}
+
+
+/**************************************************************************
+ **
+ ** void log2_gather(double *data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, double *z)
+ **
+ ** double *data - matrix (rows by cols, column major)
+ ** size_t rows, cols - dimensions of *data
+ ** int *cur_rows - the rows to take
+ ** size_t nprobes - length of cur_rows
+ ** double *z - output, nprobes by cols. log2 of data[cur_rows, ]
+ **
+ *************************************************************************/
+
+void log2_gather(double *data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, double *z){
+  size_t i, j;
+
+  for (j = 0; j < cols; j++){
+    for (i =0; i < nprobes; i++){
+      z[j*nprobes + i] = data[j*rows + cur_rows[i]];  
+    }
+  } 
+  log2_transform_in_place(z, nprobes*cols);
+}
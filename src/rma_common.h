@@ -1,10 +1,18 @@
 #ifndef RMA_COMMON
 #define RMA_COMMON 1
 
+#include <stddef.h>
+
 int sort_double(const double *a1,const double *a2);
+double  select_nocopy(double *x, size_t length, size_t k);
 double  median(double *x, int length);
+double  median_buffer(double *x, int length, double *buffer);
 double  median_nocopy(double *x, int length);
 
+void log2_transform(const double *x, double *y, size_t length);
+void log2_transform_in_place(double *x, size_t length);
+void log2_gather(double *data, size_t rows, size_t cols, int *cur_rows, size_t nprobes, double *z);
+
 
 
 #endif
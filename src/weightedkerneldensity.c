@@ -27,9 +27,19 @@
  ** Mar 15, 2008 - add KernelDensity_lowmem. weightedkerneldensity.c is ported from affyPLM to preprocessCore
  ** Oct 31, 2011 - Add additional kernels. Allow non-power of 2 nout in KernelDensity. Fix error in bandwidth calculation
  ** Sept, 2014 - Change function definition/declarations so size inputs are not pointers (and are actually size_t rather than int)
+ ** Oct 18, 2026 - fft_density_convolve now uses a real input FFT (half length complex transform
+ **                with radix-4 butterflies and a precomputed twiddle table)
+ ** Oct 18, 2026 - Add KernelDensity_matrix for computing the density of every column of a matrix 
+ **                (multi-threaded). Factor the common steps of KernelDensity and KernelDensity_lowmem
+ **                into kernel_density_range() and kernel_density_grid()
+ ** Oct 18, 2026 - kernel_density_range() no longer sorts x. The range and standard deviation come 
+ **                from one pass and the quartiles used by IQR() are found by selection
+ ** Oct 18, 2026 - weighted_massdist/unweighted_massdist share a blocked binning loop (massdist_bin). 
+ **                KernelDensity bins very large inputs on multiple threads with private bins
  **
  ****************************************************************************/
 
+#include <R.h>
 #include <R_ext/Arith.h>
 #include <R_ext/Applic.h>
 #include <Rmath.h>
@@ -42,11 +52,185 @@
 
 #include "weightedkerneldensity.h"
 
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+#define THREADS_ENV_VAR "R_THREADS"
+#endif
 
 
 /*****************************************************************************
  **
- ** void weighted_massdist(double *x, size_t nx, double *w, double xlow, double xhigh, double *y, size_t ny)
+ ** static void massdist_bin(double *x, double *w, size_t nx, double xlow, double xdelta, double *y, size_t ny)
+ **
+ ** double *x - the data
+ ** double *w - weight for each one of x (length nx) or NULL for unit weights
+ ** size_t nx - length of x
+ ** double xlow - minimum value in x dimension
+ ** double xdelta - width of each bin
+ ** double *y - binned mass is added to this (not zeroed or normalized here)
+ ** size_t ny - length of y
+ **
+ ** linear binning step shared by weighted_massdist and unweighted_massdist. 
+ ** The bin positions are computed a block at a time in a branch free loop 
+ ** (which the compiler can vectorize), then scattered into y.
+ **
+ ****************************************************************************/
+
+#define MASSDIST_BLOCK 256
+
+static void massdist_bin(double *x, double *w, size_t nx, double xlow, double xdelta, double *y, size_t ny){
+
+  double xpos[MASSDIST_BLOCK];
+  double xfloor[MASSDIST_BLOCK];
+  double fx, wi;
+  size_t i, k, len;
+  ptrdiff_t ix, ixmax = (ptrdiff_t)ny - 2;
+
+  for (i=0; i < nx; i+=MASSDIST_BLOCK){
+    len = (nx - i < MASSDIST_BLOCK ? nx - i : MASSDIST_BLOCK);
+
+    for (k=0; k < len; k++){
+      xpos[k] = (x[i+k] - xlow) / xdelta;
+      xfloor[k] = floor(xpos[k]);
+    }
+
+    for (k=0; k < len; k++){
+      if(R_FINITE(x[i+k])) {
+	wi = (w != NULL ? w[i+k] : 1.0);
+	ix = (ptrdiff_t)xfloor[k];
+	fx = xpos[k] - xfloor[k];
+	if(0 <= ix && ix <= ixmax) {
+	  y[ix] += wi*(1 - fx);
+	  y[ix + 1] +=  wi*fx;
+	}
+	else if(ix == -1) {
+	  y[0] += wi*fx;
+	}
+	else if(ix == ixmax + 1) {
+	  y[ix] += wi*(1 - fx);
+	}
+      }
+    }
+  }
+}
+
+
+#ifdef USE_PTHREADS
+/* below this many observations the data is binned on a single thread */
+#define MASSDIST_PARALLEL_MIN 1000000
+
+struct massdist_loop_data{
+  double *x;
+  double *w;
+  double xlow;
+  double xdelta;
+  double *y;
+  size_t ny;
+  size_t start;
+  size_t end;
+  double wsum;
+};
+
+static void *massdist_bin_group(void *data){
+
+  struct massdist_loop_data *args = (struct massdist_loop_data *) data;
+  size_t i;
+
+  args->wsum = 0.0;
+  if (args->w != NULL){
+    for (i=args->start; i < args->end; i++){
+      args->wsum += args->w[i];
+    }
+    massdist_bin(&args->x[args->start], &args->w[args->start], args->end - args->start, args->xlow, args->xdelta, args->y, args->ny);
+  } else {
+    massdist_bin(&args->x[args->start], NULL, args->end - args->start, args->xlow, args->xdelta, args->y, args->ny);
+  }
+  return NULL;
+}
+
+
+/*****************************************************************************
+ **
+ ** static double massdist_bin_threaded(double *x, double *w, size_t nx, double xlow, double xdelta, double *y, size_t ny, int num_threads)
+ **
+ ** bin x over num_threads threads. Each thread gets a contiguous part of x and 
+ ** its own private bins, which are then summed into y. Returns the sum of
+ ** the weights (when w is not NULL).
+ **
+ ****************************************************************************/
+
+static double massdist_bin_threaded(double *x, double *w, size_t nx, double xlow, double xdelta, double *y, size_t ny, int num_threads){
+
+  int i, returnCode;
+  size_t j, chunk_size;
+  double wsum = 0.0;
+  pthread_attr_t attr;
+  pthread_t *threads;
+  struct massdist_loop_data *args;
+  void *status;
+#ifdef PTHREAD_STACK_MIN
+  size_t stacksize = PTHREAD_STACK_MIN + sysconf(_SC_PAGE_SIZE);
+#else
+  size_t stacksize = 0x8000;
+#endif
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setstacksize (&attr, stacksize);
+
+  threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
+  args = (struct massdist_loop_data *) R_Calloc(num_threads, struct massdist_loop_data);
+
+  chunk_size = nx/num_threads;
+  for (i=0; i < num_threads; i++){
+    args[i].x = x;
+    args[i].w = w;
+    args[i].xlow = xlow;
+    args[i].xdelta = xdelta;
+    args[i].y = R_Calloc(ny,double);
+    args[i].ny = ny;
+    args[i].start = i*chunk_size;
+    args[i].end = (i == num_threads - 1 ? nx : (i+1)*chunk_size);
+  }
+
+  for (i =0; i < num_threads; i++){
+     returnCode = pthread_create(&threads[i], &attr, massdist_bin_group, (void *) &(args[i]));
+     if (returnCode){
+         error("ERROR; return code from pthread_create() is %d\n", returnCode);
+     }
+  }
+  /* Wait for the other threads */
+  for(i = 0; i < num_threads; i++){
+      returnCode = pthread_join(threads[i], &status);
+      if (returnCode){
+         error("ERROR; return code from pthread_join(thread #%d) is %d, exit status for thread was %d\n", 
+               i, returnCode, *((int *) status));
+      }
+  }
+
+  /* reduce the private bins */
+  for (i=0; i < num_threads; i++){
+    for (j=0; j < ny; j++){
+      y[j] += args[i].y[j];
+    }
+    wsum += args[i].wsum;
+    R_Free(args[i].y);
+  }
+
+  pthread_attr_destroy(&attr);  
+  R_Free(threads);
+  R_Free(args);  
+
+  return wsum;
+}
+#endif
+
+
+/*****************************************************************************
+ **
+ ** void weighted_massdist(double *x, size_t nx, double *w, double xlow, double xhigh, double *y, size_t ny, int num_threads)
  **
  ** see AS R50 and AS 176  (AS = Applied Statistics)
  **
@@ -59,16 +243,15 @@
  ** double xhigh - maximum value in x dimension
  ** double *y - on output will contain discretation scheme of data
  ** size_t ny - length of y
+ ** int num_threads - number of threads to use for binning large inputs
  **
  ****************************************************************************/
 
-static void weighted_massdist(double *x, size_t nx, double *w, double xlow, double xhigh, double *y, size_t ny){
+static void weighted_massdist(double *x, size_t nx, double *w, double xlow, double xhigh, double *y, size_t ny, int num_threads){
   
-  double fx, xdelta, xmass, xpos;
-  size_t i, ix, ixmax, ixmin;
+  double xdelta, xmass;
+  size_t i;
   
-  ixmin = 0;
-  ixmax = ny - 2;
   xmass = 0.0;
   xdelta = (xhigh - xlow) / (ny - 1);
   
@@ -76,31 +259,22 @@ static void weighted_massdist(double *x, size_t nx, double *w, double xlow, doub
     y[i] = 0.0;
   }
 
-  for (i=0; i < nx; i++){
-    xmass += w[i];
+#ifdef USE_PTHREADS
+  if (num_threads > 1 && nx >= MASSDIST_PARALLEL_MIN){
+    xmass = massdist_bin_threaded(x, w, nx, xlow, xdelta, y, ny, num_threads);
+  } else {
+#endif
+    for (i=0; i < nx; i++){
+      xmass += w[i];
+    }
+    massdist_bin(x, w, nx, xlow, xdelta, y, ny);
+#ifdef USE_PTHREADS
   }
+#endif
   
   xmass = 1.0/xmass;
   /* Rprintf("%f\n",xmass);*/
 
-  for(i=0; i < nx ; i++) {
-    if(R_FINITE(x[i])) {
-      xpos = (x[i] - xlow) / xdelta;
-      ix = floor(xpos);
-      fx = xpos - ix;
-      if(ixmin <= ix && ix <= ixmax) {
-	y[ix] += w[i]*(1 - fx);
-	y[ix + 1] +=  w[i]*fx;
-      }
-      else if(ix == -1) {
-	y[0] += w[i]*fx;
-      }
-      else if(ix == ixmax + 1) {
-	y[ix] += w[i]*(1 - fx);
-      }
-    }
-  }
-  
   for(i=0; i < ny; i++)
     y[i] *= xmass;
   
@@ -108,7 +282,7 @@ static void weighted_massdist(double *x, size_t nx, double *w, double xlow, doub
 
 /*****************************************************************************
  **
- ** void unweighted_massdist(double *x, size_t nx, double xlow, double xhigh, double *y, size_t ny)
+ ** void unweighted_massdist(double *x, size_t nx, double xlow, double xhigh, double *y, size_t ny, int num_threads)
  **
  ** see AS R50 and AS 176  (AS = Applied Statistics)
  **
@@ -116,44 +290,35 @@ static void weighted_massdist(double *x, size_t nx, double *w, double xlow, doub
  **
  ** double *x - the data
  ** size_t nx - length of x
- ** double *w - weight for each one of x, vector should also be of length nx
  ** double xlow - minimum value in x dimension
  ** double xhigh - maximum value in x dimension
  ** double *y - on output will contain discretation scheme of data
  ** size_t ny - length of y
+ ** int num_threads - number of threads to use for binning large inputs
  **
  ****************************************************************************/
 
-static void unweighted_massdist(double *x, size_t nx, double xlow, double xhigh, double *y, size_t ny){
+static void unweighted_massdist(double *x, size_t nx, double xlow, double xhigh, double *y, size_t ny, int num_threads){
   
-  double fx, xdelta, xpos;
-  size_t i, ix, ixmax, ixmin;
+  double xdelta;
+  size_t i;
   
-  ixmin = 0;
-  ixmax = ny - 2;
   xdelta = (xhigh - xlow) / (ny - 1);
   
   for(i=0; i < ny ; i++){
     y[i] = 0.0;
   }
 
-  for(i=0; i < nx ; i++) {
-    if(R_FINITE(x[i])) {
-      xpos = (x[i] - xlow) / xdelta;
-      ix = (int)floor(xpos);
-      fx = xpos - ix;
-      if(ixmin <= ix && ix <= ixmax) {
-        y[ix] += (1 - fx);
-        y[ix + 1] +=  fx;
-      }
-      else if(ix == -1) {
-        y[0] += fx;
-      }
-      else if(ix == ixmax + 1) {
-        y[ix] += (1 - fx);
-      }
-    }
+#ifdef USE_PTHREADS
+  if (num_threads > 1 && nx >= MASSDIST_PARALLEL_MIN){
+    massdist_bin_threaded(x, NULL, nx, xlow, xdelta, y, ny, num_threads);
+  } else {
+#endif
+    massdist_bin(x, NULL, nx, xlow, xdelta, y, ny);
+#ifdef USE_PTHREADS
   }
+#endif
+
   for(i=0; i < ny; i++)
     y[i] *= (1.0/(double)(nx));
 }
@@ -162,191 +327,333 @@ static void unweighted_massdist(double *x, size_t nx, double xlow, double xhigh,
 
 /*********************************************************************
  ** 
- ** void twiddle(int N, int i, double *tf_real, double *tf_imag)
+ ** void fft_twiddle_table(double *tf_real, double *tf_imag, size_t N)
  **
- ** int N - length of data series
- ** int i - 
- ** double *tf_real - on output contains real part of twiddle factor 
- ** double *tf_imag - on output contains imaginary part of twiddle factor  
+ ** double *tf_real - on output contains real part of twiddle factors
+ ** double *tf_imag - on output contains imaginary part of twiddle factors
+ ** size_t N - length of data series (and of the tables)
  **
- ** twiddle factor in FFT 
+ ** precompute the twiddle factors exp(-2*pi*i*k/N) for k=0,...,N-1 so that 
+ ** the butterflies do not need to call cos() and sin().
  **
  ********************************************************************/
 
-static  void twiddle(int N, int i,double *tf_real, double *tf_imag){
+static void fft_twiddle_table(double *tf_real, double *tf_imag, size_t N){
   double pi = 3.14159265358979323846; 
-  if (i ==0){
-    *tf_real = 1;
-    *tf_imag = 0;
-   } else {
-    *tf_real = cos(2*pi*(double)i/(double)N);  
-    *tf_imag = -sin(2*pi*(double)i/(double)N); 
+  size_t k;
+
+  tf_real[0] = 1.0;
+  tf_imag[0] = 0.0;
+  for (k=1; k < N; k++){
+    tf_real[k] = cos(2*pi*(double)k/(double)N);  
+    tf_imag[k] = -sin(2*pi*(double)k/(double)N); 
   }
 } 
 
+
 /*********************************************************************
- ** 
- ** void twiddle2(int N, int i, double *tf_real, double *tf_imag)
  **
- ** int N - length of data series
- ** int i - 
- ** double *tf_real - on output contains real part of twiddle factor 
- ** double *tf_imag - on output contains imaginary part of twiddle factor  
+ ** void fft_radix4(double *f_real, double *f_imag, size_t n, double *tf_real, double *tf_imag, size_t tf_stride, int inverse)
  **
- ** twiddle factor in FFT when computing inverse FFT
+ ** double *f_real - real component of data series
+ ** double *f_imag - imaginary component of data series
+ ** size_t n -  length of data series (a power of 2)
+ ** double *tf_real, *tf_imag - twiddle table (see fft_twiddle_table)
+ ** size_t tf_stride - the table holds factors for a series of length n*tf_stride
+ ** int inverse - if non zero compute the (unnormalized) inverse FFT
+ ** 
+ ** computes the FFT in place using a bit reversal followed by decimation 
+ ** in time radix-4 butterflies (with a single radix-2 pass when n is 
+ ** not a power of 4). Output is in normal order.
  **
  ********************************************************************/
 
-static void twiddle2(int N, int i,double *tf_real, double *tf_imag){
-  double pi = 3.14159265358979323846; 
-  if (i ==0){
-    *tf_real = 1;
-    *tf_imag = 0;
-   } else {
-    *tf_real = cos(2*pi*(double)i/(double)N);  
-    *tf_imag = sin(2*pi*(double)i/(double)N); 
+static void fft_radix4(double *f_real, double *f_imag, size_t n, double *tf_real, double *tf_imag, size_t tf_stride, int inverse){
+
+  size_t i, j, k, m, base, step;
+  double sign = (inverse ? -1.0 : 1.0);
+  double temp;
+  double w1_real, w1_imag, w2_real, w2_imag, w3_real, w3_imag;
+  double t0_real, t0_imag, t1_real, t1_imag, t2_real, t2_imag, t3_real, t3_imag;
+  double s0_real, s0_imag, s1_real, s1_imag, d0_real, d0_imag, d1_real, d1_imag;
+
+  /* bit reversal permutation */
+  j = 0;
+  for (i=0; i < n - 1; i++){
+    if (i < j){
+      temp = f_real[i]; f_real[i] = f_real[j]; f_real[j] = temp;
+      temp = f_imag[i]; f_imag[i] = f_imag[j]; f_imag[j] = temp;
+    }
+    k = n >> 1;
+    while (k <= j){
+      j -= k;
+      k >>= 1;
+    }
+    j += k;
+  }
+
+  /* when n is not a power of 4 start with one radix-2 pass with unit twiddles */
+  m = 1;
+  for (k = n; k > 2; k >>= 2);
+  if (k == 2){
+    for (i=0; i < n; i+=2){
+      t0_real = f_real[i];
+      t0_imag = f_imag[i];
+      f_real[i] = t0_real + f_real[i+1];
+      f_imag[i] = t0_imag + f_imag[i+1];
+      f_real[i+1] = t0_real - f_real[i+1];
+      f_imag[i+1] = t0_imag - f_imag[i+1];
+    }
+    m = 2;
+  }
+
+  /* after the bit reversal the four length m sub transforms at offsets 0, m, 2m, 3m 
+     of each length 4m block come from inputs 4k, 4k+2, 4k+1, 4k+3 respectively */
+  for (; 4*m <= n; m <<= 2){
+    step = (n/(4*m))*tf_stride;
+    for (base = 0; base < n; base += 4*m){
+      for (j=0; j < m; j++){
+	w1_real = tf_real[j*step];
+	w1_imag = sign*tf_imag[j*step];
+	w2_real = tf_real[2*j*step];
+	w2_imag = sign*tf_imag[2*j*step];
+	w3_real = tf_real[3*j*step];
+	w3_imag = sign*tf_imag[3*j*step];
+	
+	i = base + j;
+	t0_real = f_real[i];
+	t0_imag = f_imag[i];
+	t1_real = f_real[i+2*m]*w1_real - f_imag[i+2*m]*w1_imag;
+	t1_imag = f_real[i+2*m]*w1_imag + f_imag[i+2*m]*w1_real;
+	t2_real = f_real[i+m]*w2_real - f_imag[i+m]*w2_imag;
+	t2_imag = f_real[i+m]*w2_imag + f_imag[i+m]*w2_real;
+	t3_real = f_real[i+3*m]*w3_real - f_imag[i+3*m]*w3_imag;
+	t3_imag = f_real[i+3*m]*w3_imag + f_imag[i+3*m]*w3_real;
+
+	s0_real = t0_real + t2_real;
+	s0_imag = t0_imag + t2_imag;
+	d0_real = t0_real - t2_real;
+	d0_imag = t0_imag - t2_imag;
+	s1_real = t1_real + t3_real;
+	s1_imag = t1_imag + t3_imag;
+	/* d1 = -i*(t1 - t3) for the forward transform, +i*(t1 - t3) for the inverse */
+	d1_real = sign*(t1_imag - t3_imag);
+	d1_imag = -sign*(t1_real - t3_real);
+
+	f_real[i] = s0_real + s1_real;
+	f_imag[i] = s0_imag + s1_imag;
+	f_real[i+m] = d0_real + d1_real;
+	f_imag[i+m] = d0_imag + d1_imag;
+	f_real[i+2*m] = s0_real - s1_real;
+	f_imag[i+2*m] = s0_imag - s1_imag;
+	f_real[i+3*m] = d0_real - d1_real;
+	f_imag[i+3*m] = d0_imag - d1_imag;
+      }
+    }
   }
 } 
 
 
 /*********************************************************************
  **
- ** void fft_dif(double *f_real, double *f_imag, int p){
+ ** void fft_real(double *x, size_t N, double *f_real, double *f_imag, double *tf_real, double *tf_imag)
  **
- ** compute the FFT using Decimation In Frequency of a data sequence of length 2^p
+ ** double *x - real data series of length N (a power of 2, at least 4)
+ ** size_t N - length of x
+ ** double *f_real, *f_imag - on output the first N/2 + 1 FFT coefficients of x 
+ **                           (the remainder follow by conjugate symmetry)
+ ** double *tf_real, *tf_imag - twiddle table for length N
  **
- ** double *f_real - real component of data series
- ** double *f_imag - imaginary component of data series
- ** int p -  where 2^p is length of data series
- ** 
- ** computes the FFT in place, result is in reverse bit order.
+ ** compute the FFT of a real sequence by packing the even and odd elements into
+ ** a complex sequence of length N/2, transforming that and then untangling the result.
  **
  ********************************************************************/
 
-static void fft_dif(double *f_real, double *f_imag, int p){
-  
-  int BaseE, BaseO, i, j, k, Blocks, Points, Points2;
-  double even_real, even_imag, odd_real, odd_imag;
-  double tf_real, tf_imag;
-
-  Blocks = 1;
-  Points = 1 << p;
-  
-
-  for (i=0; i < p; i++){
-    Points2 = Points >> 1;
-    BaseE = 0;
-    for (j=0; j < Blocks; j++){
-      BaseO = BaseE + Points2;
-      for (k =0; k < Points2; k++){
-	even_real = f_real[BaseE + k] + f_real[BaseO + k]; 
-	even_imag = f_imag[BaseE + k] + f_imag[BaseO + k];  
-	twiddle(Points,k,&tf_real, &tf_imag); 
-	odd_real = (f_real[BaseE+k]-f_real[BaseO+k])*tf_real - (f_imag[BaseE+k]-f_imag[BaseO+k])*tf_imag;
-	odd_imag = (f_real[BaseE+k]-f_real[BaseO+k])*tf_imag + (f_imag[BaseE+k]-f_imag[BaseO+k])*tf_real; 
-	f_real[BaseE+k] = even_real;
-	f_imag[BaseE+k] = even_imag;
-	f_real[BaseO+k] = odd_real;
-	f_imag[BaseO+k] = odd_imag;
-	
-      } 
-      BaseE = BaseE + Points;
-    }                     
-    Blocks = Blocks << 1; 
-    Points = Points >> 1;
+static void fft_real(double *x, size_t N, double *f_real, double *f_imag, double *tf_real, double *tf_imag){
+
+  size_t k, H = N/2;
+  double a_real, a_imag, b_real, b_imag;
+  double e_real, e_imag, o_real, o_imag, wo_real, wo_imag;
+
+  for (k=0; k < H; k++){
+    f_real[k] = x[2*k];
+    f_imag[k] = x[2*k+1];
   }
-} 
+  
+  fft_radix4(f_real, f_imag, H, tf_real, tf_imag, 2, 0);
+
+  f_real[H] = f_real[0] - f_imag[0];
+  f_imag[H] = 0.0;
+  f_real[0] = f_real[0] + f_imag[0];
+  f_imag[0] = 0.0;
+
+  for (k=1; k <= H/2; k++){
+    a_real = f_real[k];
+    a_imag = f_imag[k];
+    b_real = f_real[H-k];
+    b_imag = f_imag[H-k];
+
+    /* E = (Z[k] + conj(Z[H-k]))/2, O = (Z[k] - conj(Z[H-k]))/(2i) */
+    e_real = 0.5*(a_real + b_real);
+    e_imag = 0.5*(a_imag - b_imag);
+    o_real = 0.5*(a_imag + b_imag);
+    o_imag = -0.5*(a_real - b_real);
+
+    wo_real = tf_real[k]*o_real - tf_imag[k]*o_imag;
+    wo_imag = tf_real[k]*o_imag + tf_imag[k]*o_real;
+
+    /* X[k] = E + W^k O,  X[H-k] = conj(E - W^k O) */
+    f_real[k] = e_real + wo_real;
+    f_imag[k] = e_imag + wo_imag;
+    f_real[H-k] = e_real - wo_real;
+    f_imag[H-k] = -(e_imag - wo_imag);
+  }
+}
+
 
 /*********************************************************************
  **
- ** void fft_ditI(double *f_real, double *f_imag, int p){
+ ** void fft_realI(double *f_real, double *f_imag, size_t N, double *x, double *tf_real, double *tf_imag)
  **
- ** compute the IFFT using Decimation In time of a data sequence of length 2^p
+ ** double *f_real, *f_imag - first N/2 + 1 FFT coefficients of a real sequence 
+ **                           (overwritten)
+ ** size_t N - length of the output sequence
+ ** double *x - on output the unnormalized inverse FFT (length N)
+ ** double *tf_real, *tf_imag - twiddle table for length N
  **
- ** double *f_real - real component of data series
- ** double *f_imag - imaginary component of data series
- ** int p -  where 2^p is length of data series
- ** 
- ** computes the IFFT in place, where input is in reverse bit order.
- ** output is in normal order.
+ ** inverse of fft_real(), except that like fft_ditI the result is not divided by N.
  **
  ********************************************************************/
 
-static void fft_ditI(double *f_real, double *f_imag, int p){
-  int i,j,k, Blocks, Points, Points2, BaseB, BaseT;
-  double top_real, top_imag, bot_real, bot_imag, tf_real, tf_imag;
-
-  Blocks = 1 << (p-1);
-  Points = 2;  
-  for (i=0; i < p; i++){
-    Points2 = Points >> 1;
-    BaseT = 0;
-    for (j=0; j < Blocks; j++){
-      BaseB = BaseT+Points2;
-      for (k=0; k < Points2; k++){
-	top_real = f_real[BaseT+k];
-	top_imag = f_imag[BaseT+k];	
-	twiddle2(Points,k,&tf_real, &tf_imag);
-	bot_real = f_real[BaseB+k]*tf_real - f_imag[BaseB+k]*tf_imag;
-	bot_imag = f_real[BaseB+k]*tf_imag + f_imag[BaseB+k]*tf_real;
-	f_real[BaseT+k] = top_real + bot_real;
-	f_imag[BaseT+k] = top_imag + bot_imag;
-	f_real[BaseB+k] = top_real - bot_real;   
-	f_imag[BaseB+k] = top_imag - bot_imag; 
-      }     
-      BaseT= BaseT + Points; 
-    }
-    Blocks = Blocks >> 1;
-    Points = Points << 1;
+static void fft_realI(double *f_real, double *f_imag, size_t N, double *x, double *tf_real, double *tf_imag){
+
+  size_t k, H = N/2;
+  double a_real, a_imag, b_real, b_imag;
+  double s_real, s_imag, d_real, d_imag, v_real, v_imag;
+
+  a_real = f_real[0];
+  b_real = f_real[H];
+  f_real[0] = a_real + b_real;
+  f_imag[0] = a_real - b_real;
+
+  for (k=1; k <= H/2; k++){
+    a_real = f_real[k];
+    a_imag = f_imag[k];
+    b_real = f_real[H-k];
+    b_imag = f_imag[H-k];
+
+    /* S = C[k] + conj(C[H-k]), V = W^-k (C[k] - conj(C[H-k])) */
+    s_real = a_real + b_real;
+    s_imag = a_imag - b_imag;
+    d_real = a_real - b_real;
+    d_imag = a_imag + b_imag;
+    v_real = tf_real[k]*d_real + tf_imag[k]*d_imag;
+    v_imag = tf_real[k]*d_imag - tf_imag[k]*d_real;
+    
+    /* Z[k] = S + iV, Z[H-k] = conj(S - iV) */
+    f_real[k] = s_real - v_imag;
+    f_imag[k] = s_imag + v_real;
+    f_real[H-k] = s_real + v_imag;
+    f_imag[H-k] = -(s_imag - v_real);
   }
-  
-} 
+
+  fft_radix4(f_real, f_imag, H, tf_real, tf_imag, 2, 1);
+
+  for (k=0; k < H; k++){
+    x[2*k] = f_real[k];
+    x[2*k+1] = f_imag[k];
+  }
+}
+
 
 /*******************************************************************
  **
- ** static void fft_density_convolve(double *y, double *kords, int n)
- **
- ** double *y - ve
- ** double *kords - 
- ** int n - 
+ ** struct density_workspace
  **
+ ** scratch space used when computing a density on a grid of n points.
+ ** Allocated once and then reused when computing many densities 
+ ** (see KernelDensity_matrix)
  **
  ******************************************************************/
 
-static void fft_density_convolve(double *y, double *kords, int n){
-  int i;
-  int nlog2 = (int)(log((double)n)/log(2.0) + 0.5); /* ugly hack to stop rounding problems */
-  double *y_imag = R_Calloc(n,double);
-  double *kords_imag = R_Calloc(n,double);
-  double *conv_real = R_Calloc(n,double);
-  double *conv_imag = R_Calloc(n,double);
- 
+struct density_workspace{
+  size_t n;          /* number of grid points, a power of 2 */
+  double *kords;     /* length 2n */
+  double *y;         /* length 2n */
+  double *xords;     /* length n */
+  double *tf_real;   /* twiddle table, length 2n */
+  double *tf_imag;
+  double *y_real;    /* FFT coefficients, length n + 1 */
+  double *y_imag;
+  double *kords_real;
+  double *kords_imag;
+};
+
+
+static void density_workspace_alloc(struct density_workspace *ws, size_t n){
+
+  ws->n = n;
+  ws->kords = R_Calloc(2*n,double);
+  ws->y = R_Calloc(2*n,double);
+  ws->xords = R_Calloc(n,double);
+  ws->tf_real = R_Calloc(2*n,double);
+  ws->tf_imag = R_Calloc(2*n,double);
+  ws->y_real = R_Calloc(n + 1,double);
+  ws->y_imag = R_Calloc(n + 1,double);
+  ws->kords_real = R_Calloc(n + 1,double);
+  ws->kords_imag = R_Calloc(n + 1,double);
+
+  fft_twiddle_table(ws->tf_real, ws->tf_imag, 2*n);
+}
 
-  
-  
-  /* printf("nlog2: %.30lf  %d\n", log((double)n)/log(2.0),nlog2); */
 
-  fft_dif(y, y_imag, nlog2);
-  fft_dif(kords,kords_imag,nlog2);
-  
-  for (i=0; i < n; i++){
-    conv_real[i] = y[i]*kords[i] + y_imag[i]*kords_imag[i];
-    conv_imag[i] = y[i]*(-1*kords_imag[i]) + y_imag[i]*kords[i];
-  }
-  
-  fft_ditI(conv_real, conv_imag, nlog2);
+static void density_workspace_free(struct density_workspace *ws){
 
-  for (i=0; i < n; i++){
-    kords[i] = conv_real[i];
-  }
+  R_Free(ws->kords_imag);
+  R_Free(ws->kords_real);
+  R_Free(ws->y_imag);
+  R_Free(ws->y_real);
+  R_Free(ws->tf_imag);
+  R_Free(ws->tf_real);
+  R_Free(ws->xords);
+  R_Free(ws->y);
+  R_Free(ws->kords);
+}
 
 
-  R_Free(conv_real);
-  R_Free(conv_imag);
-  R_Free(kords_imag);
-  R_Free(y_imag);
-  
+/*******************************************************************
+ **
+ ** static void fft_density_convolve(struct density_workspace *ws)
+ **
+ ** struct density_workspace *ws - ws->y holds the discretized data and ws->kords 
+ **                                the kernel evaluated at the grid points (each of 
+ **                                length 2n). On output ws->kords contains the 
+ **                                convolution of the two (multiplied by 2n)
+ **
+ ** both inputs are real so only the half length complex transforms are computed.
+ **
+ ******************************************************************/
 
+static void fft_density_convolve(struct density_workspace *ws){
+  size_t i;
+  size_t n = 2*ws->n;
+  double *y_real = ws->y_real;
+  double *y_imag = ws->y_imag;
+  double *kords_real = ws->kords_real;
+  double *kords_imag = ws->kords_imag;
+  double conv_real, conv_imag;
+ 
+  fft_real(ws->y, n, y_real, y_imag, ws->tf_real, ws->tf_imag);
+  fft_real(ws->kords, n, kords_real, kords_imag, ws->tf_real, ws->tf_imag);
+  
+  for (i=0; i <= n/2; i++){
+    conv_real = y_real[i]*kords_real[i] + y_imag[i]*kords_imag[i];
+    conv_imag = y_real[i]*(-1*kords_imag[i]) + y_imag[i]*kords_real[i];
+    y_real[i] = conv_real;
+    y_imag[i] = conv_imag;
+  }
+  
+  fft_realI(y_real, y_imag, n, ws->kords, ws->tf_real, ws->tf_imag);
 }
 
 /**************************************************************
@@ -433,50 +740,61 @@ static void kernelize(double *data, int n, double bw, int kernel){
 
 /*****************************************************************
  **
- ** static double compute_sd(double *x, int length)
+ ** static void compute_summary(double *x, size_t length, double *min, double *max, double *sd)
  **
  ** double *x - data vector
- ** int length - length of x
+ ** size_t length - length of x
+ ** double *min - on output the minimum of x
+ ** double *max - on output the maximum of x
+ ** double *sd - on output the standard deviation of x
  **
- ** compute the standard deviation of a data vector
+ ** compute the range and standard deviation of a data vector in a single
+ ** pass. The running mean update avoids the loss of precision of summing 
+ ** squares directly.
  **
  *****************************************************************/
 
-static double compute_sd(double *x, int length){
+static void compute_summary(double *x, size_t length, double *min, double *max, double *sd){
   
-  int i;
-  double sum=0.0,sum2=0.0;
+  size_t i;
+  double mean=0.0,sum2=0.0,delta;
+  double cur_min = x[0], cur_max = x[0];
 
   for (i = 0; i < length; i++){
-    sum+=x[i];
-  }
-  
-  sum = sum/(double)length;
-  for (i=0; i < length; i++){
-    sum2+=(x[i]-sum)*(x[i] - sum);
+    if (x[i] < cur_min){
+      cur_min = x[i];
+    } else if (x[i] > cur_max){
+      cur_max = x[i];
+    }
+    delta = x[i] - mean;
+    mean += delta/(double)(i+1);
+    sum2 += delta*(x[i] - mean);
   }
   
-  return(sqrt(sum2/(double)(length-1)));
+  *min = cur_min;
+  *max = cur_max;
+  *sd = sqrt(sum2/(double)(length-1));
 }
 
 /*****************************************************************
  **
- ** static double bandwidth_nrd0(double *x, int length, double iqr)
+ ** static double bandwidth_nrd0(double *x, int length, double iqr, double sd)
  **
  ** double *x - data vector
  ** int length - length of x
  ** double iqr - IQR of *x
+ ** double sd - standard deviation of *x
  **
  ** compute the kernel bandwidth using nrd0
  **
  *****************************************************************/
 
-static double bandwidth_nrd0(double *x, int length, double iqr){
+static double bandwidth_nrd0(double *x, int length, double iqr, double sd){
 
   double hi;
   double lo;
   
-  hi = compute_sd(x, length);
+  hi = sd;
   
   if (hi > iqr/1.34){
     lo = iqr/1.34;
@@ -501,24 +819,22 @@ static double bandwidth_nrd0(double *x, int length, double iqr){
 
 /*****************************************************************
  **
- ** static double bandwidth_nrd(double *x, int length, double iqr)
+ ** static double bandwidth_nrd(double *x, int length, double iqr, double sd)
  **
  ** double *x - data vector
  ** int length - length of x
  ** double iqr - IQR of *x
+ ** double sd - standard deviation of *x
  **
  ** compute the kernel bandwidth using nrd
  **
  *****************************************************************/
 
-static double bandwidth_nrd(double *x, int length, double iqr){
+static double bandwidth_nrd(double *x, int length, double iqr, double sd){
 
-   double sd;
    double hi = iqr/1.34;             
    double lo;
 
-   sd = compute_sd(x, length);
-
    if (sd > hi){
      lo = hi;
    } else {
@@ -532,32 +848,31 @@ static double bandwidth_nrd(double *x, int length, double iqr){
 
 /*****************************************************************
  **
- ** static double bandwidth(double *x, int length, double iqr, int bw_fn)
+ ** static double bandwidth(double *x, int length, double iqr, double sd, int bw_fn)
  **
  ** double *x - data vector
  ** int length - length of x
  ** double iqr - IQR of *x
+ ** double sd - standard deviation of *x
  ** int bw_fn - 0 for nrd0, 1 for nrd  
  **
  ** compute the kernel bandwidth using nrd
  **
  *****************************************************************/
 
-static double bandwidth(double *x, int length, double iqr, int bw_fn){
+static double bandwidth(double *x, int length, double iqr, double sd, int bw_fn){
 
     if (bw_fn == 0){
-        return(bandwidth_nrd0(x, length, iqr));
+        return(bandwidth_nrd0(x, length, iqr, sd));
     } else if (bw_fn == 1){
-	return(bandwidth_nrd(x, length, iqr));
+	return(bandwidth_nrd(x, length, iqr, sd));
     }
-    return(bandwidth_nrd0(x, length, iqr)); /* default */
+    return(bandwidth_nrd0(x, length, iqr, sd)); /* default */
 }
 
 
 
 
-
-
 /******************************************************************
  **
  ** double linear_interpolate_helper(double v, double *x, double *y, int n)
@@ -629,6 +944,95 @@ static void linear_interpolate(double *x, double *y, double *xout, double *yout,
 
 static double IQR(double *x, int length);
 
+/**********************************************************************
+ **
+ ** static void kernel_density_range(double *x, size_t nx, double *buffer, int bandwidth_fn, double bandwidth_adj,
+ **                                  double *low, double *high, double *bw)
+ **
+ ** double *x - data vector
+ ** size_t nx - length of x
+ ** double *buffer - space for a copy of x (length nx) used to find the quartiles. 
+ **                  May be x itself in which case the order of x is changed
+ ** int bandwidth_fn - which bandwidth function to use 
+ ** double bandwidth_adj - adjustment factor for bandwidth
+ ** double *low - on output the minimum of x
+ ** double *high - on output the maximum of x
+ ** double *bw - on output the bandwidth 
+ **
+ **********************************************************************/
+
+static void kernel_density_range(double *x, size_t nx, double *buffer, int bandwidth_fn, double bandwidth_adj, double *low, double *high, double *bw){
+
+  double iqr, sd;
+
+  compute_summary(x, nx, low, high, &sd);
+
+  if (buffer != x){
+    memcpy(buffer,x,nx*sizeof(double));
+  }
+
+  iqr =  IQR(buffer,nx);  /* buffer[(int)(0.75*nx + 0.5)] - buffer[(int)(0.25*nx+0.5)]; */
+  
+  *bw = bandwidth_adj*bandwidth(x,nx,iqr,sd,bandwidth_fn);
+}
+
+
+/**********************************************************************
+ **
+ ** static void kernel_density_grid(double *x, size_t nx, double *weights, double low, double high, double bw, 
+ **                                 int kernel_fn, int num_threads, struct density_workspace *ws)
+ **
+ ** double *x - data vector
+ ** size_t nx - length of x
+ ** double *weights - a weight for each observation in x. If NULL each observation gets equal weight
+ ** double low, high - range of the grid
+ ** double bw - bandwidth
+ ** int kernel_fn - which kernel function to use
+ ** int num_threads - number of threads to use when binning large inputs
+ ** struct density_workspace *ws - on output ws->kords contains the density at the
+ **                                ws->n grid points in ws->xords
+ **
+ **********************************************************************/
+
+static void kernel_density_grid(double *x, size_t nx, double *weights, double low, double high, double bw, int kernel_fn, int num_threads, struct density_workspace *ws){
+
+  size_t n = ws->n;
+  size_t n2 = 2*n;
+  size_t i;
+  double *kords = ws->kords;
+  double *y = ws->y;
+  double *xords = ws->xords;
+
+  for (i=0; i <= n; i++){
+    kords[i] = (double)i/(double)(2*n -1)*2*(high - low);
+  }  
+  for (i=n+1; i < 2*n; i++){
+    kords[i] = -kords[2*n - i];
+  }
+  
+  kernelize(kords, 2*n,bw,kernel_fn);
+
+  if (weights != NULL){
+    weighted_massdist(x, nx, weights, low, high, y, n, num_threads);
+  } else {
+    unweighted_massdist(x, nx, low, high, y, n, num_threads);
+  }
+  for (i=n; i < n2; i++){
+    y[i] = 0.0;
+  }
+
+  fft_density_convolve(ws);
+
+  for (i=0; i < n; i++){
+    xords[i] = (double)i/(double)(n -1)*(high - low)  + low;
+  }
+
+  for (i =0; i < n; i++){
+    kords[i] = kords[i]/n2;
+  }
+}
+
+
 /**********************************************************************
  **
  ** void KernelDensity(double *x, size_t nxxx,  double *weights, double *output, double *output_x, size_t nout, int kernel_fn, int bandwidth_fn, double bandwidth_adj)
@@ -651,17 +1055,22 @@ void KernelDensity(double *x, size_t nxxx, double *weights, double *output, doub
 
   size_t nuser = nout;
   size_t n;  /* = *nout;  */
-  size_t n2;  /* == 2*n;  */
   size_t i;
-  double low, high, iqr, bw, to, from;
-  double *kords;  /*  = R_Calloc(2*n,double);*/
+  double low, high, bw, to, from;
   double *buffer;  /*  = R_Calloc(nx,double);*/
-  double *y;  /*   = R_Calloc(2*n,double);*/
-  double *xords;  /*    = R_Calloc(n,double);*/
-
-  int kern_fn=kernel_fn;
-  int bw_fn=bandwidth_fn;
-  double bw_adj = bandwidth_adj;
+  struct density_workspace ws;
+  int num_threads = 1;
+#ifdef USE_PTHREADS
+  char *nthreads;
+
+  nthreads = getenv(THREADS_ENV_VAR);
+  if(nthreads != NULL){
+    num_threads = atoi(nthreads);
+    if(num_threads <= 0){
+      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
+    }
+  }
+#endif
 	
   n = (int)pow(2.0,ceil(log2(nuser))); 
 
@@ -669,73 +1078,37 @@ void KernelDensity(double *x, size_t nxxx, double *weights, double *output, doub
     n = 512;
   }
 
-  n2 = 2*n;
-
-  kords = R_Calloc(n2,double);
+  density_workspace_alloc(&ws, n);
   buffer = R_Calloc(nx,double);
-  y = R_Calloc(n2,double);
-  xords  = R_Calloc(n,double);
-
-  memcpy(buffer,x,nx*sizeof(double));
-
-
-  qsort(buffer,nx,sizeof(double),(int(*)(const void*, const void*))sort_double);
-  
-  low  = buffer[0];
-  high = buffer[nx-1];
-  iqr =  IQR(buffer,nx);  /* buffer[(int)(0.75*nx + 0.5)] - buffer[(int)(0.25*nx+0.5)]; */
-  
 
-  bw =bw_adj*bandwidth(x,nx,iqr,bw_fn);
+  kernel_density_range(x, nx, buffer, bandwidth_fn, bandwidth_adj, &low, &high, &bw);
   
   low = low - 7*bw;
   high = high + 7*bw;
   
+  kernel_density_grid(x, nx, weights, low, high, bw, kernel_fn, num_threads, &ws);
 
-  for (i=0; i <= n; i++){
-    kords[i] = (double)i/(double)(2*n -1)*2*(high - low);
-  }  
-  for (i=n+1; i < 2*n; i++){
-    kords[i] = -kords[2*n - i];
-  }
-  
-  /* bw = bandwidth(x,nx,iqr); */
-  
-  /* printf("iqr: %f bw: %f\n",iqr,bw);  */
-  
-  kernelize(kords, 2*n,bw,kern_fn);
-
-  weighted_massdist(x, nx, weights, low, high, y, n);
-
-  fft_density_convolve(y,kords,n2);
   to = high - 4*bw;  /* corrections to get on correct output range */
   from = low + 4* bw;
-  for (i=0; i < n; i++){
-    xords[i] = (double)i/(double)(n -1)*(high - low)  + low;
-  }
 
   for (i=0; i < nuser; i++){
     output_x[i] = (double)i/(double)(nuser -1)*(to - from)  + from;
   }
 
-  for (i =0; i < n; i++){
-    kords[i] = kords[i]/n2;
-  }
-
   /* to get results that agree with R really need to do linear interpolation */
 
-  linear_interpolate(xords, kords, output_x, output, n, nuser);
+  linear_interpolate(ws.xords, ws.kords, output_x, output, n, nuser);
 
-  R_Free(xords);
-  R_Free(y);
   R_Free(buffer);
-  R_Free(kords);
+  density_workspace_free(&ws);
 
 }
 
 /**
  **
- ** Note the following function assumes that data (x) is sorted
+ ** Note the following function partially reorders the data (x). 
+ ** The order statistics needed for the quartiles are found by selection
+ ** (rPsort) rather than by sorting all of x.
  **
  ** Aim is to duplicate R quantile function
  **
@@ -746,43 +1119,61 @@ static double IQR(double *x, int length){
 
   double lowindex, highindex;
   double lowfloor, highfloor;
-  double lowceil, highceil;
   /* int low_i, high_i; */
   double low_h, high_h;
+  int i, lowpos, highpos;
 
-
-  double qslow, qshigh;
+  double qslow, qshigh, next;
   
   lowindex = (double)(length -1)*0.25;
   highindex = (double)(length -1)*0.75;
 
   lowfloor = floor(lowindex);
   highfloor = floor(highindex);
-
-  lowceil = ceil(lowindex);
-  highceil = ceil(highindex);
   
   /*low_i = lowindex > lowfloor;
     high_i = highindex > highfloor; */
+
+  lowpos = (int)lowfloor;
+  highpos = (int)highfloor;
+
+  /* after rPsort(x, length, k) everything after position k is >= x[k], so the
+     next order statistic is the minimum of what follows */
+  rPsort(x, length, lowpos);
+  qslow = x[lowpos];
   
-  qslow = x[(int)lowfloor];
-  qshigh = x[(int)highfloor];
+  if (highpos > lowpos){
+    rPsort(&x[lowpos+1], length - lowpos - 1, highpos - lowpos - 1);
+  }
+  qshigh = x[highpos];
   
   low_h = lowindex - lowfloor;
   high_h = highindex - highfloor;
   
   if (low_h > 1e-10){
-    qslow = (1.0 - low_h)*qslow + low_h*x[(int)lowceil];
+    /* when highpos > lowpos the second selection leaves the smallest of these at or before highpos */
+    next = x[lowpos+1];
+    for (i=lowpos+2; i <= (highpos > lowpos ? highpos : length - 1); i++){
+      if (x[i] < next){
+	next = x[i];
+      }
+    }
+    qslow = (1.0 - low_h)*qslow + low_h*next;
   }
   if (high_h > 1e-10){
-    qshigh = (1.0 - high_h)*qshigh + high_h*x[(int)highceil];
+    next = x[highpos+1];
+    for (i=highpos+2; i < length; i++){
+      if (x[i] < next){
+	next = x[i];
+      }
+    }
+    qshigh = (1.0 - high_h)*qshigh + high_h*next;
   }
 
   return qshigh - qslow;
 
 }
 
-
 /**********************************************************************
  **
  ** void KernelDensity_lowmem(double *x, int nxxx, double *output,  double *output_x, size_t nout)
@@ -801,68 +1192,338 @@ void KernelDensity_lowmem(double *x, size_t nxxx, double *output, double *output
   size_t nx = nxxx;
 
   size_t n = nout;
-  size_t n2= 2*n;
   size_t i;
 
-  double low, high,iqr,bw,from,to;
-  double *kords = R_Calloc(2*n,double);
-  double *buffer = x; 
-  double *y = R_Calloc(2*n,double);
-  double *xords = R_Calloc(n,double);
+  double low, high,bw,from,to;
+  struct density_workspace ws;
 
-  qsort(buffer,nx,sizeof(double),(int(*)(const void*, const void*))sort_double);
- 
-  low  = buffer[0];
-  high = buffer[nx-1];
-  iqr =  IQR(buffer,nx); //buffer[(int)(0.75*nx+0.5)] - buffer[(int)(0.25*nx+0.5)];
-  
+  density_workspace_alloc(&ws, n);
 
-  bw = bandwidth_nrd0(x,nx,iqr);
+  kernel_density_range(x, nx, x, 0, 1.0, &low, &high, &bw);
   
   low = low - 7*bw;
   high = high + 7*bw;
-    
 
-  for (i=0; i <= n; i++){
-    kords[i] = (double)i/(double)(2*n -1)*2*(high - low);
-  }  
-  for (i=n+1; i < 2*n; i++){
-    kords[i] = -kords[2*n - i];
+  kernel_density_grid(x, nx, NULL, low, high, bw, 2, 1, &ws);
+
+  to = high - 4*bw;  /* corrections to get on correct output range */
+  from = low + 4* bw;
+
+  for (i=0; i < n; i++){
+    output_x[i] = (double)i/(double)(n -1)*(to - from)  + from;
   }
+
+  // to get results that agree with R really need to do linear interpolation
+
+  linear_interpolate(ws.xords, ws.kords, output_x, output, n, n);
   
-  //bw = bandwidth(x,nx,iqr);
-  
-  /* printf("bw: %f\n",bw);*/
+  density_workspace_free(&ws);
 
-  kernelize(kords, 2*n,bw,2);
+}
 
-  unweighted_massdist(x, nx, low, high, y, n);
 
-  fft_density_convolve(y,kords,n2);
+#ifdef USE_PTHREADS
+struct loop_data{
+  double *x;
+  double *weights;
+  double *output;
+  double *output_x;
+  double *low;
+  double *high;
+  double *bw;
+  size_t rows;
+  size_t cols;
+  size_t n;
+  size_t nout;
+  int kernel_fn;
+  int bandwidth_fn;
+  double bandwidth_adj;
+  int common_grid;
+  size_t start_col;
+  size_t end_col;
+};
+#endif
 
 
-  to = high - 4*bw;  /* corrections to get on correct output range */
-  from = low + 4* bw;
+/**********************************************************************
+ **
+ ** static void kernel_density_matrix_range(double *x, size_t rows, int bandwidth_fn, double bandwidth_adj,
+ **                                         double *low, double *high, double *bw, size_t start_col, size_t end_col)
+ **
+ ** compute the range and bandwidth for columns start_col to end_col (inclusive) of x
+ **
+ **********************************************************************/
 
-  for (i=0; i < n; i++){
-    xords[i] = (double)i/(double)(n -1)*(high - low)  + low;
-    output_x[i] = (double)i/(double)(n -1)*(to - from)  + from;
+static void kernel_density_matrix_range(double *x, size_t rows, int bandwidth_fn, double bandwidth_adj, double *low, double *high, double *bw, size_t start_col, size_t end_col){
+
+  size_t j;
+  double *buffer = R_Calloc(rows,double);
+
+  for (j = start_col; j <= end_col; j++){
+    kernel_density_range(&x[j*rows], rows, buffer, bandwidth_fn, bandwidth_adj, &low[j], &high[j], &bw[j]);
   }
 
-  for (i =0; i < n; i++){
-    kords[i] = kords[i]/n2;
+  R_Free(buffer);
+}
+
+
+/**********************************************************************
+ **
+ ** static void kernel_density_matrix_estimate(double *x, size_t rows, double *weights, double *output, double *output_x,
+ **                                            size_t nout, size_t n, int kernel_fn, int common_grid,
+ **                                            double *low, double *high, double *bw, size_t start_col, size_t end_col)
+ **
+ ** compute the densities for columns start_col to end_col (inclusive) of x, given the grid
+ ** ranges and bandwidths from kernel_density_matrix_range. One workspace is used for all the columns.
+ **
+ **********************************************************************/
+
+static void kernel_density_matrix_estimate(double *x, size_t rows, double *weights, double *output, double *output_x, size_t nout, size_t n, int kernel_fn, int common_grid, double *low, double *high, double *bw, size_t start_col, size_t end_col){
+
+  size_t i, j;
+  double from, to;
+  double *cur_x = output_x;
+  struct density_workspace ws;
+
+  density_workspace_alloc(&ws, n);
+
+  for (j = start_col; j <= end_col; j++){
+    kernel_density_grid(&x[j*rows], rows, (weights != NULL ? &weights[j*rows] : NULL), low[j], high[j], bw[j], kernel_fn, 1, &ws);
+    
+    if (!common_grid){
+      cur_x = &output_x[j*nout];
+      to = high[j] - 4*bw[j];  /* corrections to get on correct output range */
+      from = low[j] + 4*bw[j];
+      for (i=0; i < nout; i++){
+	cur_x[i] = (double)i/(double)(nout -1)*(to - from)  + from;
+      }
+    }
+
+    linear_interpolate(ws.xords, ws.kords, cur_x, &output[j*nout], n, nout);
   }
+  
+  density_workspace_free(&ws);
+}
 
-  // to get results that agree with R really need to do linear interpolation
 
-  linear_interpolate(xords, kords, output_x, output, n, n);
+#ifdef USE_PTHREADS
+static void *kernel_density_matrix_range_group(void *data){
+  struct loop_data *args = (struct loop_data *) data;
   
-  R_Free(xords);
-  R_Free(y);
-  R_Free(kords);
+  kernel_density_matrix_range(args->x, args->rows, args->bandwidth_fn, args->bandwidth_adj, args->low, args->high, args->bw, args->start_col, args->end_col);
+  return NULL;
+}
 
+static void *kernel_density_matrix_estimate_group(void *data){
+  struct loop_data *args = (struct loop_data *) data;
+  
+  kernel_density_matrix_estimate(args->x, args->rows, args->weights, args->output, args->output_x, args->nout, args->n, args->kernel_fn, args->common_grid, args->low, args->high, args->bw, args->start_col, args->end_col);
+  return NULL;
 }
+#endif
+
+
+/**********************************************************************
+ **
+ ** void KernelDensity_matrix(double *x, size_t rows, size_t cols, double *weights, double *output, double *output_x, size_t nout, 
+ **                           int kernel_fn, int bandwidth_fn, double bandwidth_adj, int common_grid)
+ **
+ ** double *x - data matrix (rows by cols). A density is computed for each column
+ ** size_t rows, cols - dimensions of x
+ ** double *weights - a weight for each observation in x (rows by cols). If NULL all observations are equally weighted
+ ** double *output - place to output density values (nout by cols)
+ ** double *output_x - x coordinates corresponding to output. If common_grid is non zero this is a vector of length nout 
+ **                    shared by every column, otherwise it is a nout by cols matrix
+ ** size_t nout - number of density values for each column
+ ** int kernel_fn - which kernel function to use (see above for integer code mapping)
+ ** int bandwidth_fn - which bandwidth function to use (see above for integer code mapping)
+ ** double bandwidth_adj - adjustment factor for bandwidth
+ ** int common_grid - if non zero all the densities are evaluated on a common set of x coordinates 
+ **                   covering the output range of every column
+ **
+ ** Each column gets the same result as KernelDensity() (when common_grid is 0). The columns are
+ ** divided among threads (R_THREADS) with each thread using its own workspace.
+ **
+ **********************************************************************/
+
+void KernelDensity_matrix(double *x, size_t rows, size_t cols, double *weights, double *output, double *output_x, size_t nout, int kernel_fn, int bandwidth_fn, double bandwidth_adj, int common_grid){
+
+  size_t j, n;
+  double from, to;
+  double *low, *high, *bw;
+#ifdef USE_PTHREADS
+  int i;
+  int t, returnCode, chunk_size, num_threads = 1;
+  double chunk_size_d, chunk_tot_d;
+  char *nthreads;
+  pthread_attr_t attr;
+  pthread_t *threads;
+  struct loop_data *args;
+  void *status;
+  size_t stacksize;
+#endif
+
+  if (cols == 0){
+    return;
+  }
+
+  n = (int)pow(2.0,ceil(log2(nout))); 
+
+  if (n < 512){
+    n = 512;
+  }
+
+  low = R_Calloc(cols,double);
+  high = R_Calloc(cols,double);
+  bw = R_Calloc(cols,double);
+
+#ifdef USE_PTHREADS
+  /* Initialize thread attribute */
+  pthread_attr_init(&attr);
+#ifdef PTHREAD_STACK_MIN
+  stacksize = PTHREAD_STACK_MIN + sysconf(_SC_PAGE_SIZE);
+#else
+  stacksize = 0x8000;
+#endif
+  nthreads = getenv(THREADS_ENV_VAR);
+  if(nthreads != NULL){
+    num_threads = atoi(nthreads);
+    if(num_threads <= 0){
+      error("The number of threads (enviroment variable %s) must be a positive integer, but the specified value was %s", THREADS_ENV_VAR, nthreads);
+    }
+  }
+  threads = (pthread_t *) R_Calloc(num_threads, pthread_t);
+
+  /* Set thread detached attribute */
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setstacksize (&attr, stacksize);
+  
+  /* this code works out how many threads to use and allocates ranges of columns to each thread */
+  /* The aim is to try to be as fair as possible in dividing up the matrix */
+  /* A special cases to be aware of: 
+    1) Number of columns is less than the number of threads
+  */
+  
+  if (num_threads < cols){
+    chunk_size = cols/num_threads;
+    chunk_size_d = ((double) cols)/((double) num_threads);
+  } else {
+    chunk_size = 1;
+    chunk_size_d = 1;
+  }
 
+  if(chunk_size == 0){
+    chunk_size = 1;
+  }
+  args = (struct loop_data *) R_Calloc((cols < num_threads ? cols : num_threads), struct loop_data);
+
+  args[0].x = x;
+  args[0].weights = weights;
+  args[0].output = output;
+  args[0].output_x = output_x;
+  args[0].low = low;
+  args[0].high = high;
+  args[0].bw = bw;
+  args[0].rows = rows;  
+  args[0].cols = cols;
+  args[0].n = n;
+  args[0].nout = nout;
+  args[0].kernel_fn = kernel_fn;
+  args[0].bandwidth_fn = bandwidth_fn;
+  args[0].bandwidth_adj = bandwidth_adj;
+  args[0].common_grid = common_grid;
+
+  t = 0; /* t = number of actual threads doing work */
+  chunk_tot_d = 0;
+  for (i=0; floor(chunk_tot_d+0.00001) < cols; i+=chunk_size){
+     if(t != 0){
+       memcpy(&(args[t]), &(args[0]), sizeof(struct loop_data));
+     }
+
+     args[t].start_col = i;     
+     /* take care of distribution of the remainder (when #chips%#threads != 0) */
+     chunk_tot_d += chunk_size_d;
+     // Add 0.00001 in case there was a rounding issue with the division
+     if(i+chunk_size < floor(chunk_tot_d+0.00001)){
+       args[t].end_col = i+chunk_size;
+       i++;
+     }
+     else{
+       args[t].end_col = i+chunk_size-1;
+     }
+     t++;
+  }
 
+  /* First pass: the range and bandwidth of each column */
+  for (i =0; i < t; i++){
+     returnCode = pthread_create(&threads[i], &attr, kernel_density_matrix_range_group, (void *) &(args[i]));
+     if (returnCode){
+         error("ERROR; return code from pthread_create() is %d\n", returnCode);
+     }
+  }
+  /* Wait for the other threads */
+  for(i = 0; i < t; i++){
+      returnCode = pthread_join(threads[i], &status);
+      if (returnCode){
+         error("ERROR; return code from pthread_join(thread #%d) is %d, exit status for thread was %d\n", 
+               i, returnCode, *((int *) status));
+      }
+  }
+#else
+  kernel_density_matrix_range(x, rows, bandwidth_fn, bandwidth_adj, low, high, bw, 0, cols-1);
+#endif
+
+  if (common_grid){
+    /* the output grid covers every column, each column's FFT grid is then widened to cover it */
+    from = low[0] - 3*bw[0];
+    to = high[0] + 3*bw[0];
+    for (j=1; j < cols; j++){
+      if (low[j] - 3*bw[j] < from){
+	from = low[j] - 3*bw[j];
+      }
+      if (high[j] + 3*bw[j] > to){
+	to = high[j] + 3*bw[j];
+      }
+    }
+    for (j=0; j < nout; j++){
+      output_x[j] = (double)j/(double)(nout -1)*(to - from)  + from;
+    }
+    for (j=0; j < cols; j++){
+      low[j] = from - 4*bw[j];
+      high[j] = to + 4*bw[j];
+    }
+  } else {
+    for (j=0; j < cols; j++){
+      low[j] = low[j] - 7*bw[j];
+      high[j] = high[j] + 7*bw[j];
+    }
+  }
 
+#ifdef USE_PTHREADS
+  /* Second pass: the densities */
+  for (i =0; i < t; i++){
+     returnCode = pthread_create(&threads[i], &attr, kernel_density_matrix_estimate_group, (void *) &(args[i]));
+     if (returnCode){
+         error("ERROR; return code from pthread_create() is %d\n", returnCode);
+     }
+  }
+  /* Wait for the other threads */
+  for(i = 0; i < t; i++){
+      returnCode = pthread_join(threads[i], &status);
+      if (returnCode){
+         error("ERROR; return code from pthread_join(thread #%d) is %d, exit status for thread was %d\n", 
+               i, returnCode, *((int *) status));
+      }
+  }
 
+  pthread_attr_destroy(&attr);  
+  R_Free(threads);
+  R_Free(args);  
+#else
+  kernel_density_matrix_estimate(x, rows, weights, output, output_x, nout, n, kernel_fn, common_grid, low, high, bw, 0, cols-1);
+#endif
+
+  R_Free(bw);
+  R_Free(high);
+  R_Free(low);
+}
@@ -3,5 +3,6 @@
 
 void KernelDensity(double *x, size_t nxxx, double *weights, double *output, double *output_x, size_t nout, int kernel_fn, int bandwidth_fn, double bandwidth_adj);
 void KernelDensity_lowmem(double *x, size_t nxxx, double *output, double *output_x, size_t nout);
+void KernelDensity_matrix(double *x, size_t rows, size_t cols, double *weights, double *output, double *output_x, size_t nout, int kernel_fn, int bandwidth_fn, double bandwidth_adj, int common_grid);
 
 #endif